@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""Compile-time and runtime benchmarks for the ptl compiler.
+
+Every program in the corpus is compiled and run several times. Its output
+is checked against bench/golden/<name>.out, and the median compile time,
+median run time and peak RSS of both steps are recorded as JSON. When a
+baseline file exists, any metric that got worse than --threshold percent
+is reported as a regression and the script exits with status 1.
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+COMPILER_DIR = os.path.dirname(BENCH_DIR)
+
+# Existing sample programs; every bench/kernels/*.ptl is added after these
+SAMPLE_PROGRAMS = ["fib.ptl", "vectors.ptl", "geometric_progression.ptl", "tiktactoe.ptl"]
+
+# Metric name -> absolute change below which a difference is treated as noise
+METRICS = {
+    "compile_ms": 2.0,
+    "run_ms": 2.0,
+    "compile_peak_rss_kb": 1024,
+    "run_peak_rss_kb": 1024,
+}
+
+
+def corpus():
+    programs = [os.path.join(COMPILER_DIR, name) for name in SAMPLE_PROGRAMS]
+    kernel_dir = os.path.join(BENCH_DIR, "kernels")
+    programs += sorted(os.path.join(kernel_dir, name)
+                       for name in os.listdir(kernel_dir) if name.endswith(".ptl"))
+    return programs
+
+
+def measure(command, stdin_path):
+    """Run command once and return (wall seconds, peak RSS in KB, exit code, stdout)."""
+    with open(stdin_path or os.devnull, "rb") as stdin, tempfile.TemporaryFile() as stdout:
+        start = time.perf_counter()
+        process = subprocess.Popen(command, stdin=stdin, stdout=stdout, stderr=subprocess.DEVNULL)
+        # wait4 gives this child's own rusage, unlike RUSAGE_CHILDREN
+        _, status, usage = os.wait4(process.pid, 0)
+        elapsed = time.perf_counter() - start
+        process.returncode = os.waitstatus_to_exitcode(status)
+
+        stdout.seek(0)
+        return elapsed, usage.ru_maxrss, process.returncode, stdout.read()
+
+
+def bench_program(args, source, work_dir):
+    name = os.path.splitext(os.path.basename(source))[0]
+    executable = os.path.join(work_dir, name)
+    input_path = os.path.join(BENCH_DIR, "inputs", name + ".in")
+    golden_path = os.path.join(BENCH_DIR, "golden", name + ".out")
+    if not os.path.exists(input_path):
+        input_path = None
+
+    compile_command = [args.compiler, "--no-cache", args.opt] + args.flag + ["--emit=exe", source, executable]
+    compile_times, compile_rss = [], []
+    for _ in range(args.runs):
+        elapsed, rss, code, _ = measure(compile_command, None)
+        if code != 0:
+            raise RuntimeError("compiling %s failed with exit code %d" % (source, code))
+        compile_times.append(elapsed)
+        compile_rss.append(rss)
+
+    run_times, run_rss = [], []
+    output = b""
+    for _ in range(args.runs):
+        elapsed, rss, _, output = measure([executable], input_path)
+        run_times.append(elapsed)
+        run_rss.append(rss)
+
+    if args.update_golden:
+        with open(golden_path, "wb") as golden:
+            golden.write(output)
+
+    output_ok = os.path.exists(golden_path) and open(golden_path, "rb").read() == output
+
+    return name, {
+        "compile_ms": round(statistics.median(compile_times) * 1000, 3),
+        "run_ms": round(statistics.median(run_times) * 1000, 3),
+        "compile_peak_rss_kb": max(compile_rss),
+        "run_peak_rss_kb": max(run_rss),
+        "output_ok": output_ok,
+    }
+
+
+def compare(results, baseline, threshold):
+    """Print every metric next to its baseline and return the regressions."""
+    # Results with other flags measure different code, not a regression
+    for setting, default in (("opt", None), ("flags", [])):
+        if baseline.get(setting, default) != results[setting]:
+            raise RuntimeError("baseline was measured with %s %r, not %r; rebuild it with the same settings" % (
+                setting, baseline.get(setting, default), results[setting]))
+
+    regressions = []
+    print("\n%-24s %-20s %12s %12s %9s" % ("benchmark", "metric", "baseline", "current", "change"))
+
+    for name, current in sorted(results["benchmarks"].items()):
+        previous = baseline.get("benchmarks", {}).get(name)
+        if not previous:
+            continue
+
+        for metric, noise in METRICS.items():
+            old, new = previous.get(metric), current[metric]
+            if not old:
+                continue
+
+            change = 100.0 * (new - old) / old
+            regressed = change > threshold and new - old > noise
+            print("%-24s %-20s %12.3f %12.3f %+8.1f%%%s" % (
+                name, metric, old, new, change, "  REGRESSION" if regressed else ""))
+            if regressed:
+                regressions.append((name, metric, change))
+
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler", default=os.path.join(COMPILER_DIR, "compiler"))
+    parser.add_argument("--opt", default="-O2", help="optimization flag passed to the compiler")
+    parser.add_argument("--flag", action="append", default=[],
+                        help="extra compiler flag such as --bounds-check; may be repeated")
+    parser.add_argument("--runs", type=int, default=5, help="repetitions per measurement")
+    parser.add_argument("--output", default=os.path.join(BENCH_DIR, "results.json"))
+    parser.add_argument("--baseline", default=os.path.join(BENCH_DIR, "baseline.json"),
+                        help="results to compare against; skipped if the file does not exist")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent slowdown or growth reported as a regression")
+    parser.add_argument("--update-golden", action="store_true",
+                        help="rewrite the golden outputs from this run")
+    args = parser.parse_args()
+
+    results = {"compiler": args.compiler, "opt": args.opt, "flags": args.flag, "runs": args.runs, "benchmarks": {}}
+    failed = False
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        for source in corpus():
+            name, result = bench_program(args, source, work_dir)
+            results["benchmarks"][name] = result
+            print("%-24s compile %9.3f ms  run %9.3f ms  rss %7d KB  %s" % (
+                name, result["compile_ms"], result["run_ms"],
+                max(result["compile_peak_rss_kb"], result["run_peak_rss_kb"]),
+                "ok" if result["output_ok"] else "OUTPUT MISMATCH"))
+            failed |= not result["output_ok"]
+
+    with open(args.output, "w") as out:
+        json.dump(results, out, indent=2, sort_keys=True)
+        out.write("\n")
+    print("Results written to %s" % args.output)
+
+    if os.path.exists(args.baseline) and os.path.abspath(args.baseline) != os.path.abspath(args.output):
+        with open(args.baseline) as baseline_file:
+            baseline = json.load(baseline_file)
+        try:
+            regressions = compare(results, baseline, args.threshold)
+        except RuntimeError as error:
+            print("\nCannot compare with %s: %s" % (args.baseline, error))
+            return 1
+        if regressions:
+            print("\n%d regression(s) above %.1f%%" % (len(regressions), args.threshold))
+            failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Generate large, valid .ptl programs for compiler scaling tests.
+
+The shape of the program is controlled by the number of functions and
+globals, the statements per block, the nesting depth of while/if blocks
+and the number of operators per expression. Every loop runs a bounded
+number of times, so the generated programs can also be executed.
+"""
+
+import argparse
+import random
+import sys
+
+OPERATORS = ["+", "-", "*"]
+COMPARISONS = ["<", "<=", ">", ">=", "==", "!="]
+
+# The first functions make no calls; every later function only calls these
+LEAF_FUNCTIONS = 3
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.lines = []
+
+    def emit(self, depth, text):
+        self.lines.append("    " * depth + text)
+
+    def expression(self, names, size):
+        """A random expression over names with size binary operators."""
+        if size == 0:
+            if self.random.random() < 0.3:
+                return str(self.random.randint(0, 99))
+            return self.random.choice(names)
+
+        left = self.random.randint(0, size - 1)
+        right = size - 1 - left
+        text = "%s %s %s" % (self.expression(names, left), self.random.choice(OPERATORS),
+                             self.expression(names, right))
+        return "(" + text + ")" if self.random.random() < 0.5 else text
+
+    def condition(self, names):
+        return "%s %s %s" % (self.random.choice(names), self.random.choice(COMPARISONS),
+                             self.expression(names, 1))
+
+    def block(self, depth, names, counters, callable_functions, nesting, in_loop=False):
+        """Emit statements_per_block statements, nesting blocks up to the depth limit."""
+        for _ in range(self.args.statements):
+            choice = self.random.random()
+
+            if nesting < self.args.depth and choice < 0.2 and counters:
+                # Bounded loop over a counter reserved for this nesting level
+                counter = counters[0]
+                self.emit(depth, "%s = 0;" % counter)
+                self.emit(depth, "while %s < %d" % (counter, self.args.loop_trips))
+                self.block(depth + 1, names, counters[1:], callable_functions, nesting + 1, True)
+                self.emit(depth + 1, "%s = %s + 1;" % (counter, counter))
+                self.emit(depth, "end")
+            elif nesting < self.args.depth and choice < 0.35:
+                self.emit(depth, "if %s then" % self.condition(names))
+                self.block(depth + 1, names, counters, callable_functions, nesting + 1, in_loop)
+                self.emit(depth, "else")
+                self.block(depth + 1, names, counters, callable_functions, nesting + 1, in_loop)
+                self.emit(depth, "end")
+            elif callable_functions and not in_loop and choice < 0.45:
+                # Calls stay out of loops so runtime grows linearly with program size
+                target = self.random.choice(callable_functions)
+                self.emit(depth, "%s = %s(%s, %s);" % (
+                    self.random.choice(names), target,
+                    self.expression(names, 1), self.expression(names, 1)))
+            else:
+                self.emit(depth, "%s = %s;" % (self.random.choice(names),
+                                               self.expression(names, self.args.expr_size)))
+
+    def function(self, index):
+        # The symbol table is flat, so locals get names unique to their function
+        prefix = "f%d_" % index
+        names = [prefix + "a", prefix + "b"] + [prefix + "v%d" % i for i in range(self.args.locals)]
+        counters = [prefix + "c%d" % i for i in range(self.args.depth)]
+
+        self.emit(0, "func fn%d(int %sa, int %sb) -> int" % (index, prefix, prefix))
+        for name in names[2:] + counters:
+            self.emit(1, "int %s;" % name)
+        for name in names[2:]:
+            self.emit(1, "%s = %s;" % (name, self.expression(names[:2], 1)))
+
+        # Functions are generated in order, so only earlier ones can be called.
+        # Only leaf functions are called, which keeps call chains short.
+        callable_functions = ["fn%d" % i for i in range(LEAF_FUNCTIONS)] if index >= LEAF_FUNCTIONS else []
+        self.block(1, names, counters, callable_functions, 0)
+
+        self.emit(1, "return %s;" % self.expression(names, 2))
+        self.emit(0, "end")
+        self.emit(0, "")
+
+    def program(self):
+        for index in range(self.args.functions):
+            self.function(index)
+
+        globals_ = ["g%d" % i for i in range(max(1, self.args.globals))]
+        counters = ["loop%d" % i for i in range(self.args.depth)]
+        for name in globals_ + counters:
+            self.emit(0, "int %s;" % name)
+        for name in globals_:
+            self.emit(0, "%s = %d;" % (name, self.random.randint(0, 9)))
+
+        callable_functions = ["fn%d" % i for i in range(self.args.functions)]
+        self.block(0, globals_, counters, callable_functions, 0)
+
+        self.emit(0, "writeln(%s);" % " + ".join(globals_[:8]))
+        return "\n".join(self.lines) + "\n"
+
+
+def parse_args(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--functions", type=int, default=10)
+    parser.add_argument("--globals", type=int, default=10)
+    parser.add_argument("--locals", type=int, default=4, help="local variables per function")
+    parser.add_argument("--statements", type=int, default=10, help="statements per block")
+    parser.add_argument("--depth", type=int, default=2, help="maximum block nesting depth")
+    parser.add_argument("--expr-size", type=int, default=4, help="binary operators per expression")
+    parser.add_argument("--loop-trips", type=int, default=3, help="iterations of every loop")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", help="write the program here instead of stdout")
+    return parser.parse_args(argv)
+
+
+def generate(args):
+    return Generator(args).program()
+
+
+def main():
+    args = parse_args()
+    text = generate(args)
+    if args.output:
+        with open(args.output, "w") as out:
+            out.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
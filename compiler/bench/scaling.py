@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Measure how compile time and memory scale with program size.
+
+Programs from gen_program.py are compiled while one generator parameter
+grows and the others stay fixed. The --time-report phases and the peak RSS
+of every compile are recorded. A growth exponent is then fitted on a
+log-log scale against the number of source lines: about 1.0 means a phase
+is linear, and about 2.0 points at a linear scan inside a loop.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import gen_program
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+COMPILER_DIR = os.path.dirname(BENCH_DIR)
+
+PHASES = ["lex", "parse", "functions", "codegen", "optimize", "write-output"]
+
+# Phases faster than this at the largest size are too noisy to fit
+MIN_FIT_MS = 5.0
+
+
+def compile_program(args, source, work_dir):
+    """Compile source once and return (phase -> wall ms, total ms, peak RSS KB)."""
+    command = [args.compiler, "--no-cache", args.opt, "--emit=obj", "--time-report=json",
+               source, os.path.join(work_dir, "out.o")]
+
+    with tempfile.TemporaryFile() as stderr:
+        process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=stderr)
+        _, status, usage = os.wait4(process.pid, 0)
+        process.returncode = os.waitstatus_to_exitcode(status)
+
+        stderr.seek(0)
+        output = stderr.read().decode(errors="replace")
+
+    if process.returncode != 0:
+        raise RuntimeError("compiling %s failed:\n%s" % (source, output[-2000:]))
+
+    report_line = [line for line in output.splitlines() if line.startswith('{"files"')][-1]
+    report = json.loads(report_line)["files"][0]
+    phases = {phase["name"]: phase["wall_ms"] for phase in report["phases"]}
+    return phases, report["total_wall_ms"], usage.ru_maxrss
+
+
+def fit_exponent(sizes, values):
+    """Least-squares slope of log(value) against log(size)."""
+    points = [(math.log(s), math.log(v)) for s, v in zip(sizes, values) if s > 0 and v > 0]
+    if len(points) < 2:
+        return None
+
+    mean_x = sum(x for x, _ in points) / len(points)
+    mean_y = sum(y for _, y in points) / len(points)
+    variance = sum((x - mean_x) ** 2 for x, _ in points)
+    if variance == 0:
+        return None
+    return sum((x - mean_x) * (y - mean_y) for x, y in points) / variance
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler", default=os.path.join(COMPILER_DIR, "compiler"))
+    parser.add_argument("--opt", default="-O0", help="optimization flag passed to the compiler")
+    parser.add_argument("--param", default="statements",
+                        choices=["functions", "globals", "locals", "statements", "depth", "expr_size"],
+                        help="generator parameter to grow")
+    parser.add_argument("--sizes", default="5,10,20,40", help="comma separated values of --param")
+    parser.add_argument("--runs", type=int, default=3, help="compiles per size; the fastest is kept")
+    parser.add_argument("--output", help="write the measurements and exponents as JSON")
+    parser.add_argument("--max-exponent", type=float,
+                        help="fail if any phase grows faster than this power of the input size")
+    args, generator_argv = parser.parse_known_args()
+    generator_args = gen_program.parse_args(generator_argv)
+
+    sizes = [int(size) for size in args.sizes.split(",")]
+    rows = []
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        for size in sizes:
+            setattr(generator_args, args.param, size)
+            source = os.path.join(work_dir, "program.ptl")
+            text = gen_program.generate(generator_args)
+            with open(source, "w") as out:
+                out.write(text)
+
+            best = None
+            for _ in range(args.runs):
+                measurement = compile_program(args, source, work_dir)
+                if best is None or measurement[1] < best[1]:
+                    best = measurement
+
+            phases, total_ms, rss_kb = best
+            rows.append({"size": size, "lines": text.count("\n"), "total_ms": total_ms,
+                         "peak_rss_kb": rss_kb, "phases": phases})
+
+    print("%-8s %8s" % (args.param, "lines") + "".join(" %12s" % p for p in PHASES) +
+          " %10s %10s" % ("total", "rss KB"))
+    for row in rows:
+        print("%-8d %8d" % (row["size"], row["lines"]) +
+              "".join(" %12.3f" % row["phases"].get(p, 0.0) for p in PHASES) +
+              " %10.3f %10d" % (row["total_ms"], row["peak_rss_kb"]))
+
+    lines = [row["lines"] for row in rows]
+    exponents = {}
+    for phase in PHASES:
+        values = [row["phases"].get(phase, 0.0) for row in rows]
+        if values[-1] >= MIN_FIT_MS:
+            exponents[phase] = fit_exponent(lines, values)
+    exponents["total"] = fit_exponent(lines, [row["total_ms"] for row in rows])
+    exponents["peak_rss"] = fit_exponent(lines, [row["peak_rss_kb"] for row in rows])
+
+    print("\nGrowth exponent against source lines:")
+    failed = []
+    for name, exponent in exponents.items():
+        if exponent is None:
+            continue
+        over = args.max_exponent is not None and exponent > args.max_exponent
+        print("  %-14s %5.2f%s" % (name, exponent, "  TOO STEEP" if over else ""))
+        if over:
+            failed.append(name)
+
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump({"param": args.param, "opt": args.opt, "rows": rows, "exponents": exponents,
+                       "generator": vars(generator_args)}, out, indent=2, sort_keys=True)
+            out.write("\n")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,711 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "bounds_check.h"
+#include "runtime.h"
+#include "compiler.h"
+
+// Ranges never leave the int range: arithmetic that could wrap around
+// makes the result unknown
+#define UNKNOWN_RANGE ((Range){ INT_MIN, INT_MAX })
+
+// Weights of the in bounds and out of bounds edges, as clang gives
+// __builtin_expect
+#define LIKELY_WEIGHT   2000
+#define UNLIKELY_WEIGHT 1
+
+typedef struct {
+    long low;
+    long high;
+} Range;
+
+// How a loop assigns one variable
+typedef struct {
+    const char *name;
+    int direction;  // 1 only increased, -1 only decreased, by literal steps; 0 anything else
+} Assignment;
+
+typedef struct {
+    Assignment *items;
+    int count;
+    int capacity;
+    int calls;  // Calls a function of the program or stores through a reference, which may assign globals
+} AssignmentSet;
+
+static int enabled(CodegenContext *ctx) {
+    return ctx->options.bounds_check;
+}
+
+// Where name is stored in the function being generated
+static LLVMValueRef get_storage(CodegenContext *ctx, const char *name) {
+    for (ValueMap *entry = ctx->value_map; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) return entry->value;
+    }
+    return NULL;
+}
+
+// Parameters passed by reference may share their storage with any other
+// non-local variable, so nothing is kept about them
+static int is_reference(LLVMValueRef storage) {
+    return !storage || (!LLVMIsAAllocaInst(storage) && !LLVMIsAGlobalVariable(storage));
+}
+
+static IndexRange *find_range(IndexRange *ranges, const char *name) {
+    for (IndexRange *range = ranges; range != NULL; range = range->next) {
+        if (strcmp(range->name, name) == 0) return range;
+    }
+    return NULL;
+}
+
+void free_index_ranges(IndexRange *ranges) {
+    while (ranges) {
+        IndexRange *next = ranges->next;
+        free(ranges->name);
+        free(ranges);
+        ranges = next;
+    }
+}
+
+static IndexRange *copy_ranges(IndexRange *ranges) {
+    IndexRange *copy = NULL;
+    IndexRange **tail = &copy;
+    for (IndexRange *range = ranges; range != NULL; range = range->next) {
+        IndexRange *entry = (IndexRange *)malloc(sizeof(IndexRange));
+        if (!entry) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            abort_compilation();
+        }
+        *entry = *range;
+        entry->name = strdup(range->name);
+        entry->next = NULL;
+        *tail = entry;
+        tail = &entry->next;
+    }
+    return copy;
+}
+
+static void forget_range(IndexRange **ranges, const char *name) {
+    for (IndexRange **link = ranges; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            IndexRange *range = *link;
+            *link = range->next;
+            free(range->name);
+            free(range);
+            return;
+        }
+    }
+}
+
+static void set_range(CodegenContext *ctx, IndexRange **ranges, const char *name, Range value) {
+    forget_range(ranges, name);
+    if (value.low == INT_MIN && value.high == INT_MAX) return;
+
+    LLVMValueRef storage = get_storage(ctx, name);
+    if (is_reference(storage)) return;
+
+    IndexRange *range = (IndexRange *)malloc(sizeof(IndexRange));
+    if (!range) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+    range->name = strdup(name);
+    range->low = value.low;
+    range->high = value.high;
+    range->local = LLVMIsAAllocaInst(storage) != NULL;
+    range->next = *ranges;
+    *ranges = range;
+}
+
+static Range make_range(long low, long high) {
+    if (low < INT_MIN || high > INT_MAX) return UNKNOWN_RANGE;
+    return (Range){ low, high };
+}
+
+static long min4(long a, long b, long c, long d) {
+    long m = a < b ? a : b;
+    m = m < c ? m : c;
+    return m < d ? m : d;
+}
+
+static long max4(long a, long b, long c, long d) {
+    long m = a > b ? a : b;
+    m = m > c ? m : c;
+    return m > d ? m : d;
+}
+
+// Values an int expression can have
+static Range get_range(IndexRange *ranges, Expression *expr) {
+    switch (expr->type) {
+        case EXPR_INT_LITERAL:
+            return make_range(expr->data.int_value, expr->data.int_value);
+
+        case EXPR_VAR: {
+            IndexRange *range = find_range(ranges, expr->data.var_name);
+            return range ? make_range(range->low, range->high) : UNKNOWN_RANGE;
+        }
+
+        case EXPR_UNARY_OP: {
+            if (expr->data.unary_op.operator != MINUS) return UNKNOWN_RANGE;
+            Range operand = get_range(ranges, expr->data.unary_op.operand);
+            return make_range(-operand.high, -operand.low);
+        }
+
+        case EXPR_BINARY_OP: {
+            Range left = get_range(ranges, expr->data.binary_op.left);
+            Range right = get_range(ranges, expr->data.binary_op.right);
+            switch (expr->data.binary_op.operator) {
+                case PLUS:  return make_range(left.low + right.low, left.high + right.high);
+                case MINUS: return make_range(left.low - right.high, left.high - right.low);
+                case TIMES: {
+                    // Both sides are within the int range, so the products fit in a long
+                    long a = left.low * right.low, b = left.low * right.high;
+                    long c = left.high * right.low, d = left.high * right.high;
+                    return make_range(min4(a, b, c, d), max4(a, b, c, d));
+                }
+                default:
+                    return UNKNOWN_RANGE;
+            }
+        }
+
+        default:
+            return UNKNOWN_RANGE;
+    }
+}
+
+// A comparison of a variable with an expression, such as i < n + 1
+typedef struct {
+    const char *name;
+    int operator;  // As if the variable was on the left
+    Expression *bound;
+} Comparison;
+
+static int is_comparison(int operator) {
+    return operator == LT || operator == LE || operator == GT || operator == GE ||
+           operator == EQUAL || operator == NEQUAL;
+}
+
+// Whether condition, or its negation when negated is set, compares a variable
+static int get_comparison(Expression *condition, int negated, Comparison *comparison) {
+    if (!condition || condition->type != EXPR_BINARY_OP) return 0;
+
+    int operator = condition->data.binary_op.operator;
+    Expression *left = condition->data.binary_op.left;
+    Expression *right = condition->data.binary_op.right;
+    if (!is_comparison(operator)) return 0;
+
+    // Put the variable on the left: E < v is v > E
+    if (left->type != EXPR_VAR && right->type == EXPR_VAR) {
+        Expression *swap = left;
+        left = right;
+        right = swap;
+        switch (operator) {
+            case LT: operator = GT; break;
+            case LE: operator = GE; break;
+            case GT: operator = LT; break;
+            case GE: operator = LE; break;
+            default: break;
+        }
+    }
+    if (left->type != EXPR_VAR) return 0;
+
+    if (negated) {
+        switch (operator) {
+            case LT:     operator = GE; break;
+            case LE:     operator = GT; break;
+            case GT:     operator = LE; break;
+            case GE:     operator = LT; break;
+            case EQUAL:  operator = NEQUAL; break;
+            case NEQUAL: operator = EQUAL; break;
+        }
+    }
+
+    comparison->name = left->data.var_name;
+    comparison->operator = operator;
+    comparison->bound = right;
+    return 1;
+}
+
+// Whether condition is a conjunction, which its negation is when negated
+// is set: a and b, or not (a or b)
+static int is_conjunction(Expression *condition, int negated) {
+    return condition && condition->type == EXPR_BINARY_OP &&
+           condition->data.binary_op.operator == (negated ? OR : AND);
+}
+
+// Narrow the range of the int variables that condition (or its negation,
+// when negated is set) compares with something of known range, for code
+// that runs only when it holds
+static void assume(CodegenContext *ctx, IndexRange **ranges, Expression *condition, int negated,
+                   SymbolTable *symbol_table) {
+    if (is_conjunction(condition, negated)) {
+        assume(ctx, ranges, condition->data.binary_op.left, negated, symbol_table);
+        assume(ctx, ranges, condition->data.binary_op.right, negated, symbol_table);
+        return;
+    }
+
+    Comparison comparison;
+    if (!get_comparison(condition, negated, &comparison)) return;
+
+    Symbol *symbol = lookup_symbol(symbol_table, comparison.name);
+    if (!symbol || symbol->type != TYPE_INT || symbol->is_array) return;
+
+    Range bound = get_range(*ranges, comparison.bound);
+    IndexRange *known = find_range(*ranges, comparison.name);
+    long low = known ? known->low : INT_MIN;
+    long high = known ? known->high : INT_MAX;
+
+    switch (comparison.operator) {
+        case LT:    if (bound.high - 1 < high) high = bound.high - 1; break;
+        case LE:    if (bound.high < high) high = bound.high; break;
+        case GT:    if (bound.low + 1 > low) low = bound.low + 1; break;
+        case GE:    if (bound.low > low) low = bound.low; break;
+        case EQUAL:
+            if (bound.low > low) low = bound.low;
+            if (bound.high < high) high = bound.high;
+            break;
+        default:
+            return;
+    }
+
+    // An empty range is code that never runs; nothing is gained from it
+    if (low > high) return;
+    set_range(ctx, ranges, comparison.name, (Range){ low, high });
+}
+
+static Assignment *find_assignment(AssignmentSet *set, const char *name) {
+    for (int i = 0; i < set->count; i++) {
+        if (strcmp(set->items[i].name, name) == 0) return &set->items[i];
+    }
+    return NULL;
+}
+
+// Whether value is name plus or minus a literal; the step is signed
+static int get_step(const char *name, Expression *value, long *step) {
+    if (value->type != EXPR_BINARY_OP) return 0;
+
+    int operator = value->data.binary_op.operator;
+    Expression *left = value->data.binary_op.left;
+    Expression *right = value->data.binary_op.right;
+    if (operator == PLUS && left->type == EXPR_INT_LITERAL) {
+        Expression *swap = left;
+        left = right;
+        right = swap;
+    }
+    if ((operator != PLUS && operator != MINUS) || left->type != EXPR_VAR ||
+        strcmp(left->data.var_name, name) != 0 || right->type != EXPR_INT_LITERAL) {
+        return 0;
+    }
+
+    *step = operator == PLUS ? right->data.int_value : -(long)right->data.int_value;
+    return 1;
+}
+
+// value is NULL for reads and declarations
+static void add_assignment(AssignmentSet *set, const char *name, Expression *value, int nested) {
+    long step = 0;
+    int direction = 0;
+    if (value && !nested && get_step(name, value, &step)) {
+        direction = step >= 0 ? 1 : -1;
+    }
+
+    Assignment *assignment = find_assignment(set, name);
+    if (assignment) {
+        if (assignment->direction != direction) assignment->direction = 0;
+        return;
+    }
+
+    if (set->count == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 8;
+        set->items = (Assignment *)realloc(set->items, set->capacity * sizeof(Assignment));
+        if (!set->items) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            abort_compilation();
+        }
+    }
+    set->items[set->count++] = (Assignment){ name, direction };
+}
+
+// An assignment or read of name. The first decides where name is stored,
+// as a declaration within the scanned code comes before its uses.
+static void add_store(CodegenContext *ctx, AssignmentSet *set, const char *name, Expression *value, int nested) {
+    if (!find_assignment(set, name) && is_reference(get_storage(ctx, name))) set->calls = 1;
+    add_assignment(set, name, value, nested);
+}
+
+static void scan_expression(AssignmentSet *set, Expression *expr) {
+    if (!expr) return;
+
+    switch (expr->type) {
+        case EXPR_BINARY_OP:
+            scan_expression(set, expr->data.binary_op.left);
+            scan_expression(set, expr->data.binary_op.right);
+            break;
+        case EXPR_UNARY_OP:
+            scan_expression(set, expr->data.unary_op.operand);
+            break;
+        case EXPR_FUNC_CALL:
+            set->calls = 1;
+            for (ExpressionList *arg = expr->data.func_call.args; arg != NULL; arg = arg->next) {
+                // The parameter may be a reference
+                if (arg->expr->type == EXPR_VAR) {
+                    add_assignment(set, arg->expr->data.var_name, NULL, 1);
+                }
+                scan_expression(set, arg->expr);
+            }
+            break;
+        case EXPR_ARRAY_ACCESS:
+            for (ExpressionList *index = expr->data.array_access.indices; index != NULL; index = index->next) {
+                scan_expression(set, index->expr);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void scan_commands(CodegenContext *ctx, AssignmentSet *set, CommandList *list, int nested);
+
+// Collect what cmd assigns. nested is set inside loops within the scanned
+// statement, whose assignments may run any number of times.
+static void scan_command(CodegenContext *ctx, AssignmentSet *set, Command *cmd, int nested) {
+    switch (cmd->type) {
+        case CMD_DECLARE_VAR:
+            add_assignment(set, cmd->data.declare_var.name, NULL, nested);
+            break;
+        case CMD_ASSIGN:
+            for (ExpressionList *index = cmd->data.assign.indices; index != NULL; index = index->next) {
+                scan_expression(set, index->expr);
+            }
+            scan_expression(set, cmd->data.assign.value);
+            if (!cmd->data.assign.indices) {
+                add_store(ctx, set, cmd->data.assign.name, cmd->data.assign.value, nested);
+            }
+            break;
+        case CMD_READ:
+            add_store(ctx, set, cmd->data.read.var_name, NULL, nested);
+            break;
+        case CMD_WRITE:
+            scan_expression(set, cmd->data.write.expr);
+            break;
+        case CMD_WHILE:
+            scan_expression(set, cmd->data.while_cmd.condition);
+            scan_commands(ctx, set, cmd->data.while_cmd.while_block, 1);
+            break;
+        case CMD_DO_WHILE:
+            scan_expression(set, cmd->data.do_while_cmd.condition);
+            scan_commands(ctx, set, cmd->data.do_while_cmd.do_while_block, 1);
+            break;
+        case CMD_REPEAT_UNTIL:
+            scan_commands(ctx, set, cmd->data.repeat_until_cmd.repeat_until_block, 1);
+            break;
+        case CMD_IF:
+            scan_expression(set, cmd->data.if_cmd.condition);
+            scan_commands(ctx, set, cmd->data.if_cmd.then_block, nested);
+            break;
+        case CMD_IF_ELSE:
+            scan_expression(set, cmd->data.if_else_cmd.condition);
+            scan_commands(ctx, set, cmd->data.if_else_cmd.then_block, nested);
+            scan_commands(ctx, set, cmd->data.if_else_cmd.else_block, nested);
+            break;
+        case CMD_EXPRESSION:
+            scan_expression(set, cmd->data.expression.expr);
+            break;
+        case CMD_RETURN:
+            scan_expression(set, cmd->data.return_cmd.return_value);
+            break;
+        default:
+            break;
+    }
+}
+
+static void scan_commands(CodegenContext *ctx, AssignmentSet *set, CommandList *list, int nested) {
+    if (!list) return;
+    for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+        scan_command(ctx, set, cmd, nested);
+    }
+}
+
+// Ranges that still hold after what set assigns
+static void forget_assigned(IndexRange **ranges, AssignmentSet *set) {
+    IndexRange **link = ranges;
+    while (*link) {
+        IndexRange *range = *link;
+        if ((set->calls && !range->local) || find_assignment(set, range->name)) {
+            *link = range->next;
+            free(range->name);
+            free(range);
+        } else {
+            link = &range->next;
+        }
+    }
+}
+
+static Expression *get_loop_condition(Command *loop) {
+    switch (loop->type) {
+        case CMD_WHILE:    return loop->data.while_cmd.condition;
+        case CMD_DO_WHILE: return loop->data.do_while_cmd.condition;
+        default:           return NULL;
+    }
+}
+
+static CommandList *get_loop_body(Command *loop) {
+    switch (loop->type) {
+        case CMD_WHILE:    return loop->data.while_cmd.while_block;
+        case CMD_DO_WHILE: return loop->data.do_while_cmd.do_while_block;
+        default:           return loop->data.repeat_until_cmd.repeat_until_block;
+    }
+}
+
+// How far name can move in direction, while condition (or its negation)
+// holds, before it wraps around; -1 when the condition does not bound it.
+// invariant has the ranges that hold throughout the loop.
+static long get_room(IndexRange *invariant, Expression *condition, int negated,
+                     const char *name, int direction) {
+    if (is_conjunction(condition, negated)) {
+        long left = get_room(invariant, condition->data.binary_op.left, negated, name, direction);
+        long right = get_room(invariant, condition->data.binary_op.right, negated, name, direction);
+        return left > right ? left : right;
+    }
+
+    Comparison comparison;
+    if (!get_comparison(condition, negated, &comparison) || strcmp(comparison.name, name) != 0) return -1;
+
+    Range bound = get_range(invariant, comparison.bound);
+    if (direction > 0) {
+        if (bound.high == INT_MAX) return -1;
+        switch (comparison.operator) {
+            case LT:    return INT_MAX - (bound.high - 1);
+            case LE:
+            case EQUAL: return INT_MAX - bound.high;
+            default:    return -1;
+        }
+    }
+
+    if (bound.low == INT_MIN) return -1;
+    switch (comparison.operator) {
+        case GT:    return (bound.low + 1) - INT_MIN;
+        case GE:
+        case EQUAL: return bound.low - INT_MIN;
+        default:    return -1;
+    }
+}
+
+static long guarded_room(IndexRange *invariant, CommandList *list, const char *name, int direction, long room);
+
+static long guarded_branch_room(IndexRange *invariant, CommandList *list, Expression *condition, int negated,
+                                const char *name, int direction, long room) {
+    long guard = get_room(invariant, condition, negated, name, direction);
+    return guarded_room(invariant, list, name, direction, guard > room ? guard : room);
+}
+
+// Room name has left after list when it had room before, or -1 when one
+// of its steps may wrap around. A step is safe when the loop condition or
+// an if around it bounds name, as in: if j > 0 then j = j - 1; end
+static long guarded_room(IndexRange *invariant, CommandList *list, const char *name, int direction, long room) {
+    if (!list) return room;
+
+    for (Command *cmd = list->head; cmd != NULL && room >= 0; cmd = cmd->next) {
+        switch (cmd->type) {
+            case CMD_ASSIGN: {
+                long step;
+                if (cmd->data.assign.indices || strcmp(cmd->data.assign.name, name) != 0) break;
+                if (!get_step(name, cmd->data.assign.value, &step)) return -1;
+                if (step < 0) step = -step;
+                room = room >= step ? room - step : -1;
+                break;
+            }
+            case CMD_IF: {
+                long then_room = guarded_branch_room(invariant, cmd->data.if_cmd.then_block,
+                                                     cmd->data.if_cmd.condition, 0, name, direction, room);
+                room = then_room < room ? then_room : room;
+                break;
+            }
+            case CMD_IF_ELSE: {
+                long then_room = guarded_branch_room(invariant, cmd->data.if_else_cmd.then_block,
+                                                     cmd->data.if_else_cmd.condition, 0, name, direction, room);
+                long else_room = guarded_branch_room(invariant, cmd->data.if_else_cmd.else_block,
+                                                     cmd->data.if_else_cmd.condition, 1, name, direction, room);
+                room = then_room < else_room ? then_room : else_room;
+                break;
+            }
+            default:
+                // Loops within the loop leave name alone, or it would not
+                // move in one direction
+                break;
+        }
+    }
+    return room;
+}
+
+IndexRange *bounds_enter_loop(CodegenContext *ctx, Command *loop) {
+    if (!enabled(ctx)) return NULL;
+
+    IndexRange *before = copy_ranges(ctx->index_ranges);
+    AssignmentSet set = { 0 };
+    scan_expression(&set, get_loop_condition(loop));
+    scan_commands(ctx, &set, get_loop_body(loop), 0);
+
+    // What the loop does not assign holds in every iteration
+    forget_assigned(&ctx->index_ranges, &set);
+
+    // A variable the loop only moves in one direction keeps the bound it
+    // started from, such as i >= 0 in i = 0; while i < 10 ... i = i + 1,
+    // provided no step can wrap it around
+    Expression *condition = get_loop_condition(loop);
+    for (int i = 0; i < set.count; i++) {
+        Assignment *assignment = &set.items[i];
+        int direction = assignment->direction;
+        IndexRange *start = find_range(before, assignment->name);
+        if (!start || direction == 0 || (set.calls && !start->local)) continue;
+
+        // Room at the start of each pass over the body: a while tests its
+        // condition before every pass, a do-while before all but the first
+        long room = 0;
+        if (loop->type != CMD_REPEAT_UNTIL) {
+            room = get_room(ctx->index_ranges, condition, 0, assignment->name, direction);
+            if (room < 0) room = 0;
+        }
+        if (loop->type == CMD_DO_WHILE) {
+            long start_room = direction > 0 ? INT_MAX - start->high : start->low - INT_MIN;
+            if (start_room < room) room = start_room;
+        }
+        if (guarded_room(ctx->index_ranges, get_loop_body(loop), assignment->name, direction, room) < 0) {
+            continue;
+        }
+
+        Range range = direction > 0 ? (Range){ start->low, INT_MAX } : (Range){ INT_MIN, start->high };
+        set_range(ctx, &ctx->index_ranges, assignment->name, range);
+    }
+
+    free(set.items);
+    return before;
+}
+
+void bounds_begin_loop_body(CodegenContext *ctx, Command *loop, SymbolTable *symbol_table) {
+    if (!enabled(ctx) || loop->type != CMD_WHILE) return;
+
+    // The body runs when the condition held
+    assume(ctx, &ctx->index_ranges, loop->data.while_cmd.condition, 0, symbol_table);
+}
+
+IndexRange *bounds_enter_if(CodegenContext *ctx, Expression *condition, SymbolTable *symbol_table) {
+    if (!enabled(ctx)) return NULL;
+
+    IndexRange *before = copy_ranges(ctx->index_ranges);
+    assume(ctx, &ctx->index_ranges, condition, 0, symbol_table);
+    return before;
+}
+
+void bounds_enter_else(CodegenContext *ctx, Expression *condition, SymbolTable *symbol_table, IndexRange *before) {
+    if (!enabled(ctx)) return;
+
+    free_index_ranges(ctx->index_ranges);
+    ctx->index_ranges = copy_ranges(before);
+    assume(ctx, &ctx->index_ranges, condition, 1, symbol_table);
+}
+
+void bounds_leave(CodegenContext *ctx, Command *statement, IndexRange *before) {
+    if (!enabled(ctx)) return;
+
+    AssignmentSet set = { 0 };
+    scan_command(ctx, &set, statement, 0);
+    forget_assigned(&before, &set);
+    free(set.items);
+
+    free_index_ranges(ctx->index_ranges);
+    ctx->index_ranges = before;
+}
+
+void bounds_assign(CodegenContext *ctx, const char *name, Symbol *symbol, Expression *value) {
+    if (!enabled(ctx)) return;
+
+    Range range = UNKNOWN_RANGE;
+    if (value && symbol && symbol->type == TYPE_INT && !symbol->is_array) {
+        range = get_range(ctx->index_ranges, value);
+    }
+
+    // Assigning a reference may assign the global it refers to
+    if (is_reference(get_storage(ctx, name))) {
+        AssignmentSet set = { .calls = 1 };
+        forget_assigned(&ctx->index_ranges, &set);
+    }
+    set_range(ctx, &ctx->index_ranges, name, range);
+}
+
+void bounds_call(CodegenContext *ctx, ExpressionList *args) {
+    if (!enabled(ctx)) return;
+
+    AssignmentSet set = { .calls = 1 };
+    for (ExpressionList *arg = args; arg != NULL; arg = arg->next) {
+        if (arg->expr->type == EXPR_VAR) add_assignment(&set, arg->expr->data.var_name, NULL, 1);
+    }
+    forget_assigned(&ctx->index_ranges, &set);
+    free(set.items);
+}
+
+IndexRange *bounds_begin_function(CodegenContext *ctx) {
+    IndexRange *outer = ctx->index_ranges;
+    ctx->index_ranges = NULL;
+    return outer;
+}
+
+void bounds_end_function(CodegenContext *ctx, IndexRange *outer) {
+    free_index_ranges(ctx->index_ranges);
+    ctx->index_ranges = outer;
+}
+
+static LLVMValueRef get_array_name(CodegenContext *ctx, const char *name) {
+    char global_name[256];
+    snprintf(global_name, sizeof(global_name), "__ptl_array_name.%s", name);
+
+    LLVMValueRef global = LLVMGetNamedGlobal(ctx->module, global_name);
+    if (!global) {
+        global = LLVMBuildGlobalString(ctx->builder, name, global_name);
+        LLVMSetLinkage(global, LLVMPrivateLinkage);
+        LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+    }
+    return LLVMConstPointerCast(global, LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0));
+}
+
+void build_bounds_check(CodegenContext *ctx, Symbol *array, int dimension,
+                        Expression *index, LLVMValueRef index_value) {
+    if (!enabled(ctx) || dimension >= array->num_dimensions) return;
+    if (LLVMGetTypeKind(LLVMTypeOf(index_value)) != LLVMIntegerTypeKind) return;
+
+    int size = array->array_dimensions[dimension];
+    Range range = get_range(ctx->index_ranges, index);
+    if (range.low >= 0 && range.high < size) return;
+
+    LLVMContextRef context = ctx->context;
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(context);
+    LLVMValueRef index32 = LLVMBuildIntCast2(ctx->builder, index_value, i32_type, 1, "index");
+
+    // One unsigned compare also catches negative indices
+    LLVMValueRef in_bounds = LLVMBuildICmp(ctx->builder, LLVMIntULT, index32,
+                                           LLVMConstInt(i32_type, size, 0), "in_bounds");
+    LLVMBasicBlockRef ok_block = LLVMAppendBasicBlockInContext(context, ctx->current_function, "in_bounds");
+    LLVMBasicBlockRef error_block = LLVMAppendBasicBlockInContext(context, ctx->current_function, "out_of_bounds");
+    LLVMValueRef branch = LLVMBuildCondBr(ctx->builder, in_bounds, ok_block, error_block);
+
+    LLVMMetadataRef weights[] = {
+        LLVMMDStringInContext2(context, "branch_weights", 14),
+        LLVMValueAsMetadata(LLVMConstInt(i32_type, LIKELY_WEIGHT, 0)),
+        LLVMValueAsMetadata(LLVMConstInt(i32_type, UNLIKELY_WEIGHT, 0))
+    };
+    LLVMSetMetadata(branch, LLVMGetMDKindIDInContext(context, "prof", 4),
+                    LLVMMetadataAsValue(context, LLVMMDNodeInContext2(context, weights, 3)));
+
+    LLVMPositionBuilderAtEnd(ctx->builder, error_block);
+    LLVMValueRef args[] = {
+        get_array_name(ctx, array->name),
+        index32,
+        LLVMConstInt(i32_type, size, 0),
+        LLVMConstInt(i32_type, ctx->line, 0)
+    };
+    build_runtime_call(ctx, RUNTIME_BOUNDS_ERROR, args);
+    LLVMBuildUnreachable(ctx->builder);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, ok_block);
+}
@@ -0,0 +1,58 @@
+#ifndef BOUNDS_CHECK_H
+#define BOUNDS_CHECK_H
+
+#include "code_generator.h"
+
+// --bounds-check guards array indices: an index outside its dimension
+// stops the program with the array name and the .ptl line instead of
+// reading or writing past the array.
+//
+// Checks that cannot fail are left out. While generating a function the
+// compiler keeps the range each int variable is known to be in: literals
+// and what +, - and * make of them, loop variables that only count up or
+// down (i = 0; while i < 10 ... i = i + 1), and variables an if or a loop
+// condition tested. An index whose range lies inside its dimension is not
+// checked.
+// Every function below does nothing without --bounds-check.
+
+// Values an int variable can hold at the statement being generated
+typedef struct IndexRange {
+    char *name;
+    long low;
+    long high;  // Inclusive
+    int local;  // A local of the function, so only calls passing it can assign it
+    struct IndexRange *next;
+} IndexRange;
+
+// Check index_value, generated from index, against dimension number
+// dimension (from 0) of array
+void build_bounds_check(CodegenContext *ctx, Symbol *array, int dimension,
+                        Expression *index, LLVMValueRef index_value);
+
+// The variable name is assigned value (NULL: a value of unknown range,
+// as read and declarations give)
+void bounds_assign(CodegenContext *ctx, const char *name, Symbol *symbol, Expression *value);
+
+// A function of the program was called with args. It may have assigned
+// any global, and the variables passed to reference parameters.
+void bounds_call(CodegenContext *ctx, ExpressionList *args);
+
+// Control flow. The enter functions return the ranges known before the
+// statement, which bounds_leave restores less what the statement assigns.
+// Loop conditions are generated between bounds_enter_loop and
+// bounds_begin_loop_body; a while's condition holds in its body, and an
+// if's in its then block and its negation in the else block.
+IndexRange *bounds_enter_loop(CodegenContext *ctx, Command *loop);
+void bounds_begin_loop_body(CodegenContext *ctx, Command *loop, SymbolTable *symbol_table);
+IndexRange *bounds_enter_if(CodegenContext *ctx, Expression *condition, SymbolTable *symbol_table);
+void bounds_enter_else(CodegenContext *ctx, Expression *condition, SymbolTable *symbol_table, IndexRange *before);
+void bounds_leave(CodegenContext *ctx, Command *statement, IndexRange *before);
+
+// Function bodies start knowing nothing: they run when called, not where
+// they are defined. Returns the ranges of the code around the definition.
+IndexRange *bounds_begin_function(CodegenContext *ctx);
+void bounds_end_function(CodegenContext *ctx, IndexRange *outer);
+
+void free_index_ranges(IndexRange *ranges);
+
+#endif
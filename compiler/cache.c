@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm-c/TargetMachine.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "compiler.h"
+#include "import.h"
+#include "log.h"
+
+// Identifies the compiler binary: a rebuilt compiler never reuses old entries
+#define COMPILER_BUILD_ID COMPILER_VERSION " llvm-" LLVM_VERSION_STRING " " __DATE__ " " __TIME__
+
+static char cache_directory[1024];
+static long cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+static int cache_enabled = 0;
+
+static CacheStats stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int make_directories(const char *path) {
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer), "%s", path);
+
+    for (char *p = buffer + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buffer, 0755) != 0 && errno != EEXIST) return 0;
+            *p = '/';
+        }
+    }
+    return mkdir(buffer, 0755) == 0 || errno == EEXIST;
+}
+
+void cache_configure(const char *directory, long max_bytes) {
+    if (directory) {
+        snprintf(cache_directory, sizeof(cache_directory), "%s", directory);
+    } else if (getenv("PTL_CACHE_DIR")) {
+        snprintf(cache_directory, sizeof(cache_directory), "%s", getenv("PTL_CACHE_DIR"));
+    } else if (getenv("XDG_CACHE_HOME")) {
+        snprintf(cache_directory, sizeof(cache_directory), "%s/ptl", getenv("XDG_CACHE_HOME"));
+    } else if (getenv("HOME")) {
+        snprintf(cache_directory, sizeof(cache_directory), "%s/.cache/ptl", getenv("HOME"));
+    } else {
+        cache_enabled = 0;
+        return;
+    }
+
+    cache_max_bytes = max_bytes > 0 ? max_bytes : CACHE_DEFAULT_MAX_BYTES;
+    cache_enabled = make_directories(cache_directory);
+    if (!cache_enabled) {
+        LOG_WARN("Warning: Could not create cache directory '%s', caching disabled\n", cache_directory);
+    }
+}
+
+static int hash_file_contents(uint64_t *hash, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return 0;
+
+    char buffer[8192];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        *hash = fnv1a_update(*hash, buffer, count);
+    }
+    fclose(file);
+    return 1;
+}
+
+int cache_job_key(const CompileJob *job, char key[CACHE_KEY_SIZE]) {
+    // Diagnostic dumps and JIT runs need the full pipeline to execute, and
+    // source on stdin can only be read once
+    if (!cache_enabled || job->run_mode || job->emit_flags != 0 || job->options.remarks != REMARKS_NONE ||
+        job->options.output_kind == OUTPUT_NONE || strcmp(job->input_filename, "-") == 0) {
+        return 0;
+    }
+
+    // Covers the modules the source imports, so editing one invalidates the output
+    uint64_t hash = FNV_OFFSET_BASIS;
+    if (!hash_import_closure(&hash, job->input_filename)) return 0;
+
+    // The profile steers optimization, so its contents are part of the key
+    if (job->options.profile_use_filename &&
+        !hash_file_contents(&hash, job->options.profile_use_filename)) {
+        return 0;
+    }
+
+    char flags[96];
+    snprintf(flags, sizeof(flags), "kind=%d opt=%d profile=%d debug=%d float=%d bounds=%d",
+             (int)job->options.output_kind, job->options.optimization_level,
+             job->options.profile_use_filename != NULL, job->options.debug_info, job->options.float_math,
+             job->options.bounds_check);
+
+    hash = fnv1a_update_string(hash, COMPILER_BUILD_ID);
+    hash = fnv1a_update_string(hash, flags);
+    hash = fnv1a_update_string(hash, job->options.instrument_filename);
+
+    // Debug info names the source file and the directory it is relative to
+    if (job->options.debug_info) {
+        char directory[PATH_MAX];
+        if (!getcwd(directory, sizeof(directory))) directory[0] = '\0';
+        hash = fnv1a_update_string(hash, job->input_filename);
+        hash = fnv1a_update_string(hash, directory);
+    }
+
+    hash = fnv1a_update_string(hash, job->options.target_triple);
+    hash = fnv1a_update_string(hash, job->options.target_cpu);
+    hash = fnv1a_update_string(hash, job->options.target_features);
+    // Code for the host CPU is only reused on the same kind of CPU
+    if (job->options.target_cpu && strcmp(job->options.target_cpu, TARGET_CPU_NATIVE) == 0) {
+        char *host_cpu = LLVMGetHostCPUName();
+        char *host_features = LLVMGetHostCPUFeatures();
+        hash = fnv1a_update_string(hash, host_cpu);
+        hash = fnv1a_update_string(hash, host_features);
+        LLVMDisposeMessage(host_cpu);
+        LLVMDisposeMessage(host_features);
+    }
+    if (job->options.output_kind == OUTPUT_EXECUTABLE) {
+        hash = fnv1a_update_string(hash, getenv("PTL_LINKER"));
+    }
+
+    snprintf(key, CACHE_KEY_SIZE, "%016llx", (unsigned long long)hash);
+    return 1;
+}
+
+int cache_module_key(const char *path, int bounds_check, char key[CACHE_KEY_SIZE]) {
+    if (!cache_enabled) return 0;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    if (!hash_import_closure(&hash, path)) return 0;
+
+    // Module bitcode is unoptimized, so --bounds-check is the only flag it depends on
+    char flags[32];
+    snprintf(flags, sizeof(flags), "module bounds=%d", bounds_check);
+    hash = fnv1a_update_string(hash, COMPILER_BUILD_ID);
+    hash = fnv1a_update_string(hash, flags);
+
+    snprintf(key, CACHE_KEY_SIZE, "%016llx", (unsigned long long)hash);
+    return 1;
+}
+
+static int copy_file(const char *source, const char *destination) {
+    int in = open(source, O_RDONLY);
+    if (in < 0) return 0;
+
+    struct stat info;
+    if (fstat(in, &info) != 0) {
+        close(in);
+        return 0;
+    }
+
+    int out = open(destination, O_WRONLY | O_CREAT | O_TRUNC, info.st_mode & 0777);
+    if (out < 0) {
+        close(in);
+        return 0;
+    }
+
+    char buffer[65536];
+    ssize_t count;
+    int ok = 1;
+    while ((count = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, count) != count) {
+            ok = 0;
+            break;
+        }
+    }
+    if (count < 0) ok = 0;
+
+    // Keep the executable bit of linked outputs
+    fchmod(out, info.st_mode & 0777);
+
+    close(in);
+    close(out);
+    return ok;
+}
+
+int cache_fetch(const char *key, const char *output_filename) {
+    char entry[1200];
+    snprintf(entry, sizeof(entry), "%s/%s", cache_directory, key);
+
+    int hit = access(entry, R_OK) == 0 && copy_file(entry, output_filename);
+    if (hit) {
+        // Refresh the entry so eviction treats it as recently used
+        utimes(entry, NULL);
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if (hit) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return hit;
+}
+
+char *cache_fetch_data(const char *key, size_t *size) {
+    char entry[1200];
+    snprintf(entry, sizeof(entry), "%s/%s", cache_directory, key);
+
+    char *data = NULL;
+    FILE *file = fopen(entry, "rb");
+    struct stat info;
+    if (file && fstat(fileno(file), &info) == 0) {
+        data = (char *)malloc(info.st_size > 0 ? info.st_size : 1);
+        if (data && fread(data, 1, info.st_size, file) != (size_t)info.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t)info.st_size;
+    }
+    if (file) fclose(file);
+
+    if (data) {
+        utimes(entry, NULL);
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    if (data) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return data;
+}
+
+typedef struct CacheEntry {
+    char name[CACHE_KEY_SIZE];
+    time_t last_used;
+    long size;
+} CacheEntry;
+
+static int compare_entries_by_age(const void *a, const void *b) {
+    const CacheEntry *left = (const CacheEntry *)a;
+    const CacheEntry *right = (const CacheEntry *)b;
+    if (left->last_used < right->last_used) return -1;
+    if (left->last_used > right->last_used) return 1;
+    return 0;
+}
+
+static int is_cache_entry_name(const char *name) {
+    if (strlen(name) != CACHE_KEY_SIZE - 1) return 0;
+    return strspn(name, "0123456789abcdef") == CACHE_KEY_SIZE - 1;
+}
+
+// Remove the least recently used entries until the cache fits its size bound
+static void evict_entries() {
+    DIR *dir = opendir(cache_directory);
+    if (!dir) return;
+
+    int capacity = 64;
+    int count = 0;
+    long total = 0;
+    CacheEntry *entries = (CacheEntry *)malloc(capacity * sizeof(CacheEntry));
+    if (!entries) {
+        closedir(dir);
+        return;
+    }
+
+    struct dirent *item;
+    while ((item = readdir(dir)) != NULL) {
+        if (!is_cache_entry_name(item->d_name)) continue;
+
+        char path[1300];
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", cache_directory, item->d_name);
+        if (stat(path, &info) != 0) continue;
+
+        if (count == capacity) {
+            // Out of memory: leave eviction to a later store
+            CacheEntry *grown = (CacheEntry *)realloc(entries, 2 * capacity * sizeof(CacheEntry));
+            if (!grown) {
+                free(entries);
+                closedir(dir);
+                return;
+            }
+            entries = grown;
+            capacity *= 2;
+        }
+        memcpy(entries[count].name, item->d_name, CACHE_KEY_SIZE);
+        entries[count].last_used = info.st_mtime;
+        entries[count].size = (long)info.st_size;
+        total += entries[count].size;
+        count++;
+    }
+    closedir(dir);
+
+    if (total > cache_max_bytes) {
+        qsort(entries, count, sizeof(CacheEntry), compare_entries_by_age);
+
+        for (int i = 0; i < count && total > cache_max_bytes; i++) {
+            char path[1300];
+            snprintf(path, sizeof(path), "%s/%s", cache_directory, entries[i].name);
+            if (unlink(path) == 0) {
+                total -= entries[i].size;
+                stats.evictions++;
+                stats.evicted_bytes += entries[i].size;
+            }
+        }
+    }
+
+    free(entries);
+}
+
+void cache_store(const char *key, const char *output_filename) {
+    char entry[1200];
+    char temporary[1300];
+    snprintf(entry, sizeof(entry), "%s/%s", cache_directory, key);
+    snprintf(temporary, sizeof(temporary), "%s.%d.%lx.tmp", entry, (int)getpid(),
+             (unsigned long)pthread_self());
+
+    // Publish through a rename so concurrent compilers never see a partial entry
+    if (!copy_file(output_filename, temporary) || rename(temporary, entry) != 0) {
+        unlink(temporary);
+        LOG_WARN("Warning: Could not store '%s' in the compilation cache\n", output_filename);
+        return;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    stats.stores++;
+    evict_entries();
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_store_data(const char *key, const void *data, size_t size) {
+    char entry[1200];
+    char temporary[1300];
+    snprintf(entry, sizeof(entry), "%s/%s", cache_directory, key);
+    snprintf(temporary, sizeof(temporary), "%s.%d.%lx.tmp", entry, (int)getpid(),
+             (unsigned long)pthread_self());
+
+    FILE *file = fopen(temporary, "wb");
+    int ok = file && fwrite(data, 1, size, file) == size;
+    if (file && fclose(file) != 0) ok = 0;
+
+    if (!ok || rename(temporary, entry) != 0) {
+        unlink(temporary);
+        LOG_WARN("Warning: Could not store entry %s in the compilation cache\n", key);
+        return;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    stats.stores++;
+    evict_entries();
+    pthread_mutex_unlock(&cache_lock);
+}
+
+CacheStats cache_get_stats() {
+    pthread_mutex_lock(&cache_lock);
+    CacheStats result = stats;
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+void print_cache_stats(FILE *out) {
+    CacheStats current = cache_get_stats();
+    int lookups = current.hits + current.misses;
+
+    fprintf(out, "Compilation cache: %s\n", cache_enabled ? cache_directory : "disabled");
+    fprintf(out, "  hits:      %d\n", current.hits);
+    fprintf(out, "  misses:    %d\n", current.misses);
+    fprintf(out, "  hit rate:  %.1f%%\n", lookups ? 100.0 * current.hits / lookups : 0.0);
+    fprintf(out, "  stored:    %d\n", current.stores);
+    fprintf(out, "  evicted:   %d (%ld bytes)\n", current.evictions, current.evicted_bytes);
+}
@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+
+// Bump whenever code generation changes in a way that alters the output
+#define COMPILER_VERSION "0.6.0"
+
+// Default upper bound on the total size of cached outputs
+#define CACHE_DEFAULT_MAX_BYTES (256L * 1024 * 1024)
+
+#define CACHE_KEY_SIZE 17
+
+struct CompileJob;
+
+// Hit/miss counters of the current process
+typedef struct CacheStats {
+    int hits;
+    int misses;
+    int stores;
+    int evictions;
+    long evicted_bytes;
+} CacheStats;
+
+// Select the cache directory and size bound. A NULL directory uses
+// $PTL_CACHE_DIR, then $XDG_CACHE_HOME/ptl, then ~/.cache/ptl.
+void cache_configure(const char *directory, long max_bytes);
+
+// Compute the cache key of a job from its source text, the compiler
+// version and every flag that affects the output. Returns 0 if the job
+// produces nothing that can be cached.
+int cache_job_key(const struct CompileJob *job, char key[CACHE_KEY_SIZE]);
+
+// Compute the cache key of the bitcode of an imported module from its
+// source, the source of the modules it imports and whether it has bounds checks
+int cache_module_key(const char *path, int bounds_check, char key[CACHE_KEY_SIZE]);
+
+// Copy a cached output to output_filename. Returns 1 on a hit.
+int cache_fetch(const char *key, const char *output_filename);
+
+// Store a freshly generated output and evict old entries past the size bound
+void cache_store(const char *key, const char *output_filename);
+
+// Read a cached entry into memory. Returns NULL on a miss; free the result.
+char *cache_fetch_data(const char *key, size_t *size);
+
+// Store an entry from memory, like cache_store
+void cache_store_data(const char *key, const void *data, size_t size);
+
+CacheStats cache_get_stats();
+void print_cache_stats(FILE *out);
+
+#endif
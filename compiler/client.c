@@ -0,0 +1,139 @@
+// Thin client for `compiler --serve`. It takes the same command line as
+// compiler and forwards it, with its working directory, environment and
+// stdio, to the resident server. When no server is listening it runs the
+// real compiler instead, so scripts can always call it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.h"
+
+extern char **environ;
+
+static int connect_to_server(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, socket_path);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0) return -1;
+
+    if (connect(connection, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(connection);
+        return -1;
+    }
+    return connection;
+}
+
+// Run $PTL_COMPILER, or the compiler next to this binary, in this process
+static int run_local_compiler(char *argv[]) {
+    char compiler[PATH_MAX];
+    const char *configured = getenv("PTL_COMPILER");
+    char self[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length >= 0) self[length] = '\0';
+
+    if (configured && configured[0] != '\0') {
+        snprintf(compiler, sizeof(compiler), "%s", configured);
+    } else if (length < 0) {
+        snprintf(compiler, sizeof(compiler), "compiler");
+    } else {
+        char directory[PATH_MAX];
+        snprintf(directory, sizeof(directory), "%s", self);
+        snprintf(compiler, sizeof(compiler), "%s/compiler", dirname(directory));
+    }
+
+    // Installed as `compiler` itself, the fallback would run this client again
+    char resolved[PATH_MAX];
+    if (length >= 0 && realpath(compiler, resolved) != NULL && strcmp(resolved, self) == 0) {
+        fprintf(stderr, "Error: No compile server and '%s' is this client; set PTL_COMPILER to the real compiler\n",
+                compiler);
+        return 1;
+    }
+
+    execvp(compiler, argv);
+    fprintf(stderr, "Error: No compile server and could not run '%s'\n", compiler);
+    return 1;
+}
+
+static int append_string(char **buffer, int *size, int *capacity, const char *text) {
+    int length = strlen(text) + 1;
+    if (*size + length > COMPILE_PAYLOAD_MAX) return -1;
+
+    while (*size + length > *capacity) {
+        *capacity *= 2;
+        *buffer = (char *)realloc(*buffer, *capacity);
+    }
+    memcpy(*buffer + *size, text, length);
+    *size += length;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char socket_path[PATH_MAX];
+    const char *configured = getenv("PTL_COMPILE_SERVER");
+    if (configured && configured[0] != '\0') {
+        snprintf(socket_path, sizeof(socket_path), "%s", configured);
+    } else {
+        default_server_socket_path(socket_path, sizeof(socket_path));
+    }
+
+    int connection = connect_to_server(socket_path);
+    if (connection < 0) {
+        return run_local_compiler(argv);
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return 1;
+    }
+
+    int capacity = 4096;
+    int size = 0;
+    char *payload = (char *)malloc(capacity);
+    int envc = 0;
+    int failed = append_string(&payload, &size, &capacity, cwd);
+
+    for (int i = 0; i < argc && !failed; i++) {
+        failed = append_string(&payload, &size, &capacity, argv[i]);
+    }
+    for (char **entry = environ; *entry && !failed; entry++, envc++) {
+        failed = append_string(&payload, &size, &capacity, *entry);
+    }
+    if (failed) {
+        fprintf(stderr, "Error: Command line and environment are too large for the compile server\n");
+        return 1;
+    }
+
+    CompileRequestHeader header;
+    header.magic = COMPILE_REQUEST_MAGIC;
+    header.argc = argc;
+    header.envc = envc;
+    header.payload_size = size;
+
+    int fds[COMPILE_REQUEST_FDS] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    if (send_request_header(connection, &header, fds) != 0 ||
+        write_all(connection, payload, size) != 0) {
+        fprintf(stderr, "Error: Could not send request to compile server '%s'\n", socket_path);
+        return 1;
+    }
+    free(payload);
+
+    int32_t exit_code;
+    if (read_all(connection, &exit_code, sizeof(exit_code)) != 0) {
+        fprintf(stderr, "Error: Compile server closed the connection\n");
+        return 1;
+    }
+
+    close(connection);
+    return exit_code;
+}
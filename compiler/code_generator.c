@@ -1,49 +1,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <pthread.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include "code_generator.h"
-
-static FILE *output_file = NULL;
-static LLVMContextRef context = NULL;
-static LLVMModuleRef module = NULL;
-static LLVMBuilderRef builder = NULL;
-static SymbolTable *current_symbol_table = NULL;
-static FunctionTable *current_function_table = NULL;
-static const char *saved_output_filename = NULL;
-static int if_counter = 0;
-
-typedef struct ValueMap {
-    char *name;
-    LLVMValueRef value;
-    struct ValueMap *next;
-} ValueMap;
-
-static ValueMap *value_map = NULL;
-static LLVMValueRef current_function = NULL;
-
-static void add_to_value_map(const char *name, LLVMValueRef value) {
-    ValueMap *new_entry = (ValueMap *)malloc(sizeof(ValueMap));
+#include "compiler.h"
+#include "import.h"
+#include "runtime.h"
+#include "debug_info.h"
+#include "remarks.h"
+#include "bounds_check.h"
+#include "hash.h"
+#include "mem_report.h"
+#include "log.h"
+
+static void add_to_value_map(CodegenContext *ctx, const char *name, LLVMValueRef value) {
+    ValueMap *new_entry = (ValueMap *)tracked_malloc(ALLOC_VALUE_MAP, sizeof(ValueMap));
     if (!new_entry) {
         fprintf(stderr, "Error: Memory allocation failed\n");
-        exit(1);
+        abort_compilation();
     }
 
-    new_entry->name = strdup(name);
+    new_entry->name = tracked_strdup(name);
     new_entry->value = value;
-    new_entry->next = value_map;
-    value_map = new_entry;
+    new_entry->next = ctx->value_map;
+    ctx->value_map = new_entry;
+}
+
+static void declare_symbol(CodegenContext *ctx, SymbolTable *table, const char *name, DataType type,
+                           int line, ArrayDimension *dims) {
+    // Parallel code generation inserts the symbols of every function up front
+    if (ctx->symbols_declared) return;
+
+    insert_symbol(table, name, type, line, dims);
 }
 
-static LLVMValueRef get_value(const char *name) {
+static LLVMValueRef get_value(CodegenContext *ctx, const char *name) {
     if (!name) {
         fprintf(stderr, "Error: NULL variable name passed to get_value\n");
-        exit(1);
+        abort_compilation();
         return NULL;
     }
 
-    for (ValueMap *entry = value_map; entry != NULL; entry = entry->next) {
+    for (ValueMap *entry = ctx->value_map; entry != NULL; entry = entry->next) {
         if (!entry->name) {
             continue;
         }
@@ -53,73 +63,71 @@ static LLVMValueRef get_value(const char *name) {
         }
     }
 
-    if (!module) {
+    if (!ctx->module) {
         fprintf(stderr, "Error: Module is NULL when checking for global variable '%s'\n", name);
-        exit(1);
+        abort_compilation();
         return NULL;
     }
 
-    LLVMValueRef global = LLVMGetNamedGlobal(module, name);
+    LLVMValueRef global = ctx->hide_globals ? NULL : LLVMGetNamedGlobal(ctx->module, name);
     if (global) {
         return global;
     }
 
     fprintf(stderr, "Error: Variable '%s' not found in value map or as global\n", name);
-    exit(1);
+    abort_compilation();
     return NULL;
 }
 
-static LLVMTypeRef get_llvm_type(DataType type) {
+static LLVMTypeRef get_llvm_type(CodegenContext *ctx, DataType type) {
     switch (type) {
-        case TYPE_INT:   return LLVMInt32Type();
-        case TYPE_FLOAT: return LLVMFloatType();
-        case TYPE_CHAR:  return LLVMInt8Type();
-        case TYPE_STRING: return LLVMPointerType(LLVMInt8Type(), 0);
-        case TYPE_BOOL:  return LLVMInt1Type();
-        default:         return LLVMVoidType();
+        case TYPE_INT:   return LLVMInt32TypeInContext(ctx->context);
+        case TYPE_FLOAT: return LLVMFloatTypeInContext(ctx->context);
+        case TYPE_CHAR:  return LLVMInt8TypeInContext(ctx->context);
+        case TYPE_STRING: return LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
+        case TYPE_BOOL:  return LLVMInt1TypeInContext(ctx->context);
+        default:         return LLVMVoidTypeInContext(ctx->context);
     }
 }
 
-static void cleanup_value_map() {
-    ValueMap *current = value_map;
+static void cleanup_value_map(CodegenContext *ctx) {
+    ValueMap *current = ctx->value_map;
     while (current != NULL) {
         ValueMap *next = current->next;
         free(current->name);
         free(current);
         current = next;
     }
-    value_map = NULL;
+    ctx->value_map = NULL;
 }
 
-static LLVMBasicBlockRef entry_block = NULL;
-static LLVMValueRef main_function = NULL;
 
-static LLVMValueRef create_string_constant(const char *str) {
+static LLVMValueRef create_string_constant(CodegenContext *ctx, const char *str) {
     if (!str) return NULL;
 
-    LLVMValueRef str_global = LLVMBuildGlobalStringPtr(builder, str, "str_const");
+    LLVMValueRef str_global = LLVMBuildGlobalStringPtr(ctx->builder, str, "str_const");
     return str_global;
 }
 
-static LLVMValueRef create_string_variable(const char *name, int max_length) {
+static LLVMValueRef create_string_variable(CodegenContext *ctx, const char *name, int max_length) {
     int length = max_length > 0 ? max_length : 256;
-    LLVMTypeRef string_type = LLVMArrayType(LLVMInt8Type(), length);
+    LLVMTypeRef string_type = LLVMArrayType(LLVMInt8TypeInContext(ctx->context), length);
 
-    if (current_function != main_function) {
-        LLVMValueRef alloca = LLVMBuildAlloca(builder, string_type, name);
+    if (ctx->current_function != ctx->main_function) {
+        LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, string_type, name);
         LLVMSetAlignment(alloca, 1);
 
-        LLVMValueRef zero_char = LLVMConstInt(LLVMInt8Type(), 0, 0);
+        LLVMValueRef zero_char = LLVMConstInt(LLVMInt8TypeInContext(ctx->context), 0, 0);
         LLVMValueRef indices[] = {
-            LLVMConstInt(LLVMInt32Type(), 0, 0),
-            LLVMConstInt(LLVMInt32Type(), 0, 0)
+            LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0),
+            LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0)
         };
-        LLVMValueRef first_char_ptr = LLVMBuildGEP2(builder, string_type, alloca, indices, 2, "first_char");
-        LLVMBuildStore(builder, zero_char, first_char_ptr);
+        LLVMValueRef first_char_ptr = LLVMBuildGEP2(ctx->builder, string_type, alloca, indices, 2, "first_char");
+        LLVMBuildStore(ctx->builder, zero_char, first_char_ptr);
 
         return alloca;
     } else {
-        LLVMValueRef global = LLVMAddGlobal(module, string_type, name);
+        LLVMValueRef global = LLVMAddGlobal(ctx->module, string_type, name);
         LLVMSetInitializer(global, LLVMConstNull(string_type));
         LLVMSetLinkage(global, LLVMCommonLinkage);
         LLVMSetAlignment(global, 1);
@@ -127,50 +135,36 @@ static LLVMValueRef create_string_variable(const char *name, int max_length) {
     }
 }
 
-static LLVMValueRef get_strlen_function() {
-    LLVMValueRef strlen_func = LLVMGetNamedFunction(module, "strlen");
+static LLVMValueRef get_strlen_function(CodegenContext *ctx) {
+    LLVMValueRef strlen_func = LLVMGetNamedFunction(ctx->module, "strlen");
     if (strlen_func) {
         return strlen_func;
     }
 
-    LLVMTypeRef param_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-    LLVMTypeRef strlen_type = LLVMFunctionType(LLVMInt32Type(), param_types, 1, 0);
-    strlen_func = LLVMAddFunction(module, "strlen", strlen_type);
+    LLVMTypeRef param_types[] = { LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0) };
+    LLVMTypeRef strlen_type = LLVMFunctionType(LLVMInt32TypeInContext(ctx->context), param_types, 1, 0);
+    strlen_func = LLVMAddFunction(ctx->module, "strlen", strlen_type);
 
     return strlen_func;
 }
 
 
-static LLVMValueRef get_strcpy_function() {
-    LLVMValueRef strcpy_func = LLVMGetNamedFunction(module, "strcpy");
-    if (strcpy_func) {
-        return strcpy_func;
-    }
-
-    LLVMTypeRef str_ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
-    LLVMTypeRef param_types[] = { str_ptr_type, str_ptr_type };
-    LLVMTypeRef strcpy_type = LLVMFunctionType(str_ptr_type, param_types, 2, 0);
-    strcpy_func = LLVMAddFunction(module, "strcpy", strcpy_type);
-
-    return strcpy_func;
-}
-
-static LLVMValueRef get_strcmp_function() {
-    LLVMValueRef strcmp_func = LLVMGetNamedFunction(module, "strcmp");
+static LLVMValueRef get_strcmp_function(CodegenContext *ctx) {
+    LLVMValueRef strcmp_func = LLVMGetNamedFunction(ctx->module, "strcmp");
     if (strcmp_func) {
         return strcmp_func;
     }
 
-    LLVMTypeRef str_ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
+    LLVMTypeRef str_ptr_type = LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
     LLVMTypeRef param_types[] = { str_ptr_type, str_ptr_type };
-    LLVMTypeRef strcmp_type = LLVMFunctionType(LLVMInt32Type(), param_types, 2, 0);
-    strcmp_func = LLVMAddFunction(module, "strcmp", strcmp_type);
+    LLVMTypeRef strcmp_type = LLVMFunctionType(LLVMInt32TypeInContext(ctx->context), param_types, 2, 0);
+    strcmp_func = LLVMAddFunction(ctx->module, "strcmp", strcmp_type);
 
     return strcmp_func;
 }
 
-static LLVMTypeRef get_array_type(Symbol *symbol) {
-    LLVMTypeRef element_type = get_llvm_type(symbol->type);
+static LLVMTypeRef get_array_type(CodegenContext *ctx, Symbol *symbol) {
+    LLVMTypeRef element_type = get_llvm_type(ctx, symbol->type);
     LLVMTypeRef result = element_type;
 
     for (int i = symbol->num_dimensions - 1; i >= 0; i--) {
@@ -180,56 +174,800 @@ static LLVMTypeRef get_array_type(Symbol *symbol) {
     return result;
 }
 
-void init_code_generation(const char *output_filename, SymbolTable *symbol_table, FunctionTable *function_table) {
-    saved_output_filename = strdup(output_filename);
+static pthread_once_t native_target_once = PTHREAD_ONCE_INIT;
+
+static void initialize_native_target_once() {
+    LLVMInitializeNativeTarget();
+    LLVMInitializeNativeAsmPrinter();
+}
 
-    context = LLVMGetGlobalContext();
-    module = LLVMModuleCreateWithNameInContext(output_filename, context);
-    builder = LLVMCreateBuilderInContext(context);
+void initialize_native_target() {
+    // Target registration is not thread-safe, so it must only ever run once
+    pthread_once(&native_target_once, initialize_native_target_once);
+}
 
-    current_symbol_table = symbol_table;
-    current_function_table = function_table;
+// Set up a module in context with an empty main function to generate into
+static CodegenContext *create_codegen_context(const char *output_filename, LLVMContextRef context,
+                                              SymbolTable *symbol_table, FunctionTable *function_table,
+                                              const CodegenOptions *options) {
+    Profile *profile = NULL;
+    if (options->instrument_filename) {
+        profile = create_profile();
+    } else if (options->profile_use_filename) {
+        profile = read_profile(options->profile_use_filename);
+        if (!profile) abort_compilation();
+    }
 
-    output_file = fopen("debug_output.ll", "w");
-    if (!output_file) {
-        fprintf(stderr, "Warning: Could not open debug output file\n");
-        exit(1);
+    CodegenContext *ctx = (CodegenContext *)calloc(1, sizeof(CodegenContext));
+    if (!ctx) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
     }
 
-    LLVMTypeRef main_return_type = LLVMInt32TypeInContext(context);
+    ctx->profile = profile;
+    ctx->options = *options;
+    if (ctx->options.optimization_level < 0) ctx->options.optimization_level = 0;
+    if (ctx->options.optimization_level > 3) ctx->options.optimization_level = 3;
+    ctx->output_filename = strdup(output_filename);
+
+    ctx->context = context;
+    ctx->module = LLVMModuleCreateWithNameInContext(output_filename, ctx->context);
+    ctx->builder = LLVMCreateBuilderInContext(ctx->context);
+
+    ctx->symbol_table = symbol_table;
+    ctx->function_table = function_table;
+    ctx->function_cache_state = FNV_OFFSET_BASIS;
+
+    LLVMTypeRef main_return_type = LLVMInt32TypeInContext(ctx->context);
     LLVMTypeRef main_function_type = LLVMFunctionType(main_return_type, NULL, 0, 0);
-    main_function = LLVMAddFunction(module, "main", main_function_type);
+    ctx->main_function = LLVMAddFunction(ctx->module, "main", main_function_type);
+
+    ctx->entry_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->main_function, "entry");
+    LLVMPositionBuilderAtEnd(ctx->builder, ctx->entry_block);
+    ctx->current_function = ctx->main_function;
+
+    // Remarks are reported against the source lines the debug info records
+    if (options->debug_info || options->remarks != REMARKS_NONE) {
+        ctx->debug = create_debug_info(ctx, options->source_filename);
+        debug_begin_function(ctx, ctx->main_function, NULL);
+    }
+
+    return ctx;
+}
+
+CodegenContext *init_code_generation(const char *output_filename, SymbolTable *symbol_table,
+                                     FunctionTable *function_table, const CodegenOptions *options) {
+    // Every compilation owns its LLVM context, so compilations can run on
+    // separate threads, and the JIT can take the module without copying it.
+    LLVMOrcThreadSafeContextRef ts_context = LLVMOrcCreateNewThreadSafeContext();
+    CodegenContext *ctx = create_codegen_context(output_filename, LLVMOrcThreadSafeContextGetContext(ts_context),
+                                                 symbol_table, function_table, options);
+    ctx->ts_context = ts_context;
+    return ctx;
+}
+
+static LLVMValueRef get_runtime_function(CodegenContext *ctx, const char *name, LLVMTypeRef type) {
+    LLVMValueRef function = LLVMGetNamedFunction(ctx->module, name);
+    return function ? function : LLVMAddFunction(ctx->module, name, type);
+}
+
+static LLVMValueRef create_profile_counter(CodegenContext *ctx, LLVMTypeRef type, const char *name) {
+    LLVMValueRef counter = LLVMAddGlobal(ctx->module, type, name);
+    LLVMSetInitializer(counter, LLVMConstNull(type));
+    LLVMSetLinkage(counter, LLVMInternalLinkage);
+    LLVMSetAlignment(counter, 8);
+    return counter;
+}
+
+static void increment_profile_counter(CodegenContext *ctx, LLVMValueRef counter, LLVMValueRef amount) {
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(ctx->context);
+    LLVMValueRef count = LLVMBuildLoad2(ctx->builder, i64_type, counter, "profile_count");
+    LLVMBuildStore(ctx->builder, LLVMBuildAdd(ctx->builder, count, amount, "profile_count"), counter);
+}
+
+// Attach !prof metadata made of a tag and 32- or 64-bit counts
+static LLVMValueRef profile_metadata(CodegenContext *ctx, const char *tag, LLVMTypeRef count_type,
+                                     const uint64_t *counts, int count) {
+    LLVMMetadataRef operands[3];
+    operands[0] = LLVMMDStringInContext2(ctx->context, tag, strlen(tag));
+    for (int i = 0; i < count; i++) {
+        operands[i + 1] = LLVMValueAsMetadata(LLVMConstInt(count_type, counts[i], 0));
+    }
+    return LLVMMetadataAsValue(ctx->context, LLVMMDNodeInContext2(ctx->context, operands, count + 1));
+}
+
+static unsigned profile_metadata_kind(CodegenContext *ctx) {
+    return LLVMGetMDKindIDInContext(ctx->context, "prof", 4);
+}
+
+// Called with the builder at the entry of function: count its calls when
+// instrumenting, or attach the entry count of the profile being used
+static void begin_profiled_function(CodegenContext *ctx, LLVMValueRef function, const char *name, uint64_t hash) {
+    ctx->profile_function = NULL;
+    ctx->profile_site = 0;
+    if (!ctx->profile) return;
+
+    if (ctx->options.instrument_filename) {
+        ProfileFunction *record = add_profile_function(ctx->profile, name, hash);
+        record->entry_counter = create_profile_counter(ctx, LLVMInt64TypeInContext(ctx->context), "profile_entry");
+        increment_profile_counter(ctx, record->entry_counter, LLVMConstInt(LLVMInt64TypeInContext(ctx->context), 1, 0));
+        ctx->profile_function = record;
+        return;
+    }
+
+    ProfileFunction *record = find_profile_function(ctx->profile, name);
+    if (!record) return;
+    if (record->hash != hash) {
+        LOG_WARN("Warning: Profile of '%s' does not match its source, ignoring it\n", name);
+        return;
+    }
+
+    ctx->profile_function = record;
+    LLVMValueRef entry_count = profile_metadata(ctx, "function_entry_count", LLVMInt64TypeInContext(ctx->context),
+                                                &record->entry_count, 1);
+    LLVMGlobalSetMetadata(function, profile_metadata_kind(ctx), LLVMValueAsMetadata(entry_count));
+}
+
+// Conditional branch of an if or a loop. Instrumented builds count which
+// way it goes; with --profile-use it gets the measured branch weights.
+// Both number the branches of a function in the order they are generated.
+static LLVMValueRef build_profiled_cond_br(CodegenContext *ctx, LLVMValueRef condition,
+                                           LLVMBasicBlockRef then_block, LLVMBasicBlockRef else_block) {
+    ProfileFunction *record = ctx->profile_function;
+    int site = ctx->profile_site++;
+
+    if (record && ctx->options.instrument_filename) {
+        LLVMTypeRef i64_type = LLVMInt64TypeInContext(ctx->context);
+        LLVMTypeRef pair_type = LLVMArrayType(i64_type, 2);
+        LLVMValueRef counters = create_profile_counter(ctx, pair_type, "profile_branch");
+        add_profile_site(record, counters);
+
+        LLVMValueRef taken = LLVMBuildZExt(ctx->builder, condition, i64_type, "taken");
+        LLVMValueRef not_taken = LLVMBuildSub(ctx->builder, LLVMConstInt(i64_type, 1, 0), taken, "not_taken");
+        for (int i = 0; i < 2; i++) {
+            LLVMValueRef indices[] = {
+                LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0),
+                LLVMConstInt(LLVMInt32TypeInContext(ctx->context), i, 0)
+            };
+            LLVMValueRef counter = LLVMBuildInBoundsGEP2(ctx->builder, pair_type, counters, indices, 2, "profile_counter");
+            increment_profile_counter(ctx, counter, i == 0 ? taken : not_taken);
+        }
+    }
+
+    LLVMValueRef branch = LLVMBuildCondBr(ctx->builder, condition, then_block, else_block);
+
+    if (record && !ctx->options.instrument_filename && site < record->site_count) {
+        // Weights are 32-bit; scale large counts down, and keep never-taken
+        // edges at 1 like clang does so they stay distinguishable from unknown
+        uint64_t weights[2] = { record->site_counts[2 * site], record->site_counts[2 * site + 1] };
+        uint64_t largest = weights[0] > weights[1] ? weights[0] : weights[1];
+        uint64_t scale = largest / UINT32_MAX + 1;
+        for (int i = 0; i < 2; i++) {
+            weights[i] = weights[i] / scale + 1;
+        }
+        LLVMSetMetadata(branch, profile_metadata_kind(ctx),
+                        profile_metadata(ctx, "branch_weights", LLVMInt32TypeInContext(ctx->context), weights, 2));
+    }
+
+    return branch;
+}
+
+// Called with the back edge of each loop once its body is built, and the
+// counters from before the body. With --reassoc, innermost loops that do
+// float arithmetic get llvm.loop.vectorize.enable: without fast-math flags
+// on the instructions, that hint is what lets the vectorizer reorder a
+// float sum into vector lanes.
+static void hint_float_loop(CodegenContext *ctx, LLVMValueRef back_edge, int float_operations, int loops_built) {
+    int innermost = ctx->loops_built == loops_built;
+    ctx->loops_built++;
+    if (!(ctx->options.float_math & FLOAT_REASSOC) || !back_edge || !innermost ||
+        ctx->float_operations == float_operations) {
+        return;
+    }
+
+    LLVMContextRef context = ctx->context;
+    LLVMMetadataRef enable[] = {
+        LLVMMDStringInContext2(context, "llvm.loop.vectorize.enable", 26),
+        LLVMValueAsMetadata(LLVMConstInt(LLVMInt1TypeInContext(context), 1, 0))
+    };
+
+    // A loop ID refers to itself
+    LLVMMetadataRef self = LLVMTemporaryMDNode(context, NULL, 0);
+    LLVMMetadataRef operands[] = { self, LLVMMDNodeInContext2(context, enable, 2) };
+    LLVMMetadataRef loop_id = LLVMMDNodeInContext2(context, operands, 2);
+    LLVMMetadataReplaceAllUsesWith(self, loop_id);
+
+    LLVMSetMetadata(back_edge, LLVMGetMDKindIDInContext(context, "llvm.loop", 9),
+                    LLVMMetadataAsValue(context, loop_id));
+}
+
+// Define __ptl_profile_dump, which writes every counter of the module to
+// $PTL_PROFILE_FILE or the path given to --instrument. Executables run it
+// at exit through llvm.global_dtors; the JIT calls it after main returns.
+static void emit_profile_dump(CodegenContext *ctx, int run_at_exit) {
+    LLVMContextRef context = ctx->context;
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(context);
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(context);
+    LLVMTypeRef string_type = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+
+    LLVMTypeRef getenv_args[] = { string_type };
+    LLVMTypeRef fopen_args[] = { string_type, string_type };
+    LLVMTypeRef fprintf_args[] = { string_type, string_type };
+    LLVMTypeRef fclose_args[] = { string_type };
+    LLVMTypeRef getenv_type = LLVMFunctionType(string_type, getenv_args, 1, 0);
+    LLVMTypeRef fopen_type = LLVMFunctionType(string_type, fopen_args, 2, 0);
+    LLVMTypeRef fprintf_type = LLVMFunctionType(i32_type, fprintf_args, 2, 1);
+    LLVMTypeRef fclose_type = LLVMFunctionType(i32_type, fclose_args, 1, 0);
+    LLVMValueRef getenv_function = get_runtime_function(ctx, "getenv", getenv_type);
+    LLVMValueRef fopen_function = get_runtime_function(ctx, "fopen", fopen_type);
+    LLVMValueRef fprintf_function = get_runtime_function(ctx, "fprintf", fprintf_type);
+    LLVMValueRef fclose_function = get_runtime_function(ctx, "fclose", fclose_type);
+
+    LLVMTypeRef dump_type = LLVMFunctionType(LLVMVoidTypeInContext(context), NULL, 0, 0);
+    LLVMValueRef dump = LLVMAddFunction(ctx->module, PROFILE_DUMP_FUNCTION, dump_type);
+    LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(context, dump, "entry");
+    LLVMBasicBlockRef write_block = LLVMAppendBasicBlockInContext(context, dump, "write");
+    LLVMBasicBlockRef done_block = LLVMAppendBasicBlockInContext(context, dump, "done");
+
+    LLVMBasicBlockRef old_block = LLVMGetInsertBlock(ctx->builder);
+    LLVMPositionBuilderAtEnd(ctx->builder, entry);
+    // The dump function has no debug info, so it must not pick up lines of main
+    LLVMSetCurrentDebugLocation2(ctx->builder, NULL);
+
+    LLVMValueRef variable = LLVMBuildGlobalStringPtr(ctx->builder, PROFILE_FILE_ENV, "profile_env");
+    LLVMValueRef from_env = LLVMBuildCall2(ctx->builder, getenv_type, getenv_function, &variable, 1, "profile_path");
+    LLVMValueRef unset = LLVMBuildIsNull(ctx->builder, from_env, "unset");
+    LLVMValueRef default_path = LLVMBuildGlobalStringPtr(ctx->builder, ctx->options.instrument_filename, "profile_default");
+    LLVMValueRef path = LLVMBuildSelect(ctx->builder, unset, default_path, from_env, "path");
+    LLVMValueRef open_args[] = { path, LLVMBuildGlobalStringPtr(ctx->builder, "w", "mode") };
+    LLVMValueRef file = LLVMBuildCall2(ctx->builder, fopen_type, fopen_function, open_args, 2, "file");
+    LLVMBuildCondBr(ctx->builder, LLVMBuildIsNotNull(ctx->builder, file, "opened"), write_block, done_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, write_block);
+    LLVMValueRef header_args[] = {
+        file,
+        LLVMBuildGlobalStringPtr(ctx->builder, "ptl-profile %d\n", "profile_header"),
+        LLVMConstInt(i32_type, PROFILE_FORMAT_VERSION, 0)
+    };
+    LLVMBuildCall2(ctx->builder, fprintf_type, fprintf_function, header_args, 3, "");
+
+    LLVMValueRef function_format = LLVMBuildGlobalStringPtr(ctx->builder, "function %s %016llx %llu %d\n", "profile_function");
+    LLVMValueRef site_format = LLVMBuildGlobalStringPtr(ctx->builder, "%llu %llu\n", "profile_site");
+    LLVMTypeRef pair_type = LLVMArrayType(i64_type, 2);
+
+    for (ProfileFunction *record = ctx->profile->functions; record != NULL; record = record->next) {
+        LLVMValueRef function_args[] = {
+            file,
+            function_format,
+            LLVMBuildGlobalStringPtr(ctx->builder, record->name, "profile_name"),
+            LLVMConstInt(i64_type, record->hash, 0),
+            LLVMBuildLoad2(ctx->builder, i64_type, record->entry_counter, "entry_count"),
+            LLVMConstInt(i32_type, record->site_count, 0)
+        };
+        LLVMBuildCall2(ctx->builder, fprintf_type, fprintf_function, function_args, 6, "");
+
+        for (int site = 0; site < record->site_count; site++) {
+            LLVMValueRef site_args[4] = { file, site_format };
+            for (int i = 0; i < 2; i++) {
+                LLVMValueRef indices[] = { LLVMConstInt(i32_type, 0, 0), LLVMConstInt(i32_type, i, 0) };
+                LLVMValueRef counter = LLVMBuildInBoundsGEP2(ctx->builder, pair_type, record->site_counters[site],
+                                                             indices, 2, "profile_counter");
+                site_args[i + 2] = LLVMBuildLoad2(ctx->builder, i64_type, counter, "count");
+            }
+            LLVMBuildCall2(ctx->builder, fprintf_type, fprintf_function, site_args, 4, "");
+        }
+    }
+
+    LLVMBuildCall2(ctx->builder, fclose_type, fclose_function, &file, 1, "");
+    LLVMBuildBr(ctx->builder, done_block);
+
+    LLVMPositionBuilderAtEnd(ctx->builder, done_block);
+    LLVMBuildRetVoid(ctx->builder);
+
+    if (old_block) {
+        LLVMPositionBuilderAtEnd(ctx->builder, old_block);
+    }
+
+    if (run_at_exit) {
+        LLVMValueRef fields[] = { LLVMConstInt(i32_type, 65535, 0), dump, LLVMConstNull(string_type) };
+        LLVMValueRef destructor = LLVMConstStructInContext(context, fields, 3, 0);
+        LLVMTypeRef destructors_type = LLVMArrayType(LLVMTypeOf(destructor), 1);
+        LLVMValueRef destructors = LLVMAddGlobal(ctx->module, destructors_type, "llvm.global_dtors");
+        LLVMSetLinkage(destructors, LLVMAppendingLinkage);
+        LLVMSetInitializer(destructors, LLVMConstArray(LLVMTypeOf(destructor), &destructor, 1));
+    }
+}
+
+static void finish_main_function(CodegenContext *ctx) {
+    LLVMBuildRet(ctx->builder, LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0));
+    finish_debug_info(ctx);
+}
+
+static void set_float_math_attribute(CodegenContext *ctx, LLVMValueRef function, const char *kind) {
+    LLVMAttributeRef attribute = LLVMCreateStringAttribute(ctx->context, kind, strlen(kind), "true", 4);
+    LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, attribute);
+}
+
+// The C API of LLVM 14 cannot put fast-math flags on instructions, so the
+// relaxations are given to every function as attributes, which the
+// backend and the vectorizer's reduction analysis read. The inliner keeps
+// them only where caller and callee agree, so the runtime library and
+// imported modules get them too.
+static void apply_float_math(CodegenContext *ctx) {
+    int float_math = ctx->options.float_math;
+    if (!(float_math & (FLOAT_REASSOC | FLOAT_FINITE))) return;
+
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
+
+        if (float_math & FLOAT_FINITE) {
+            set_float_math_attribute(ctx, function, "no-nans-fp-math");
+            set_float_math_attribute(ctx, function, "no-infs-fp-math");
+            set_float_math_attribute(ctx, function, "no-signed-zeros-fp-math");
+            set_float_math_attribute(ctx, function, "approx-func-fp-math");
+        }
+        if ((float_math & FLOAT_FAST_MATH) == FLOAT_FAST_MATH) {
+            set_float_math_attribute(ctx, function, "unsafe-fp-math");
+        }
+    }
+}
+
+static void optimize_module(CodegenContext *ctx, LLVMTargetMachineRef target_machine) {
+    apply_float_math(ctx);
+    if (ctx->options.optimization_level == 0) return;
+
+    char pipeline[32];
+    snprintf(pipeline, sizeof(pipeline), "default<O%d>", ctx->options.optimization_level);
+
+    RemarkLog remarks;
+    begin_remarks(ctx, &remarks);
+
+    CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_OPTIMIZE);
+    LLVMPassBuilderOptionsRef pass_options = LLVMCreatePassBuilderOptions();
+    LLVMErrorRef error = LLVMRunPasses(ctx->module, pipeline, target_machine, pass_options);
+    LLVMDisposePassBuilderOptions(pass_options);
+    time_report_leave(ctx->time_report, previous_phase);
+
+    end_remarks(ctx, &remarks);
+
+    if (error) {
+        char *message = LLVMGetErrorMessage(error);
+        fprintf(stderr, "Error: Could not run optimization pipeline '%s': %s\n", pipeline, message);
+        LLVMDisposeErrorMessage(message);
+        abort_compilation();
+    }
+}
+
+static void write_ir_output(CodegenContext *ctx) {
+    if (!ctx->options.ir_output_filename) return;
+
+    // Streams straight to the file instead of building the whole module text in memory
+    CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_PRINT_IR);
+    char *message = NULL;
+    if (LLVMPrintModuleToFile(ctx->module, ctx->options.ir_output_filename, &message)) {
+        fprintf(stderr, "Error: Could not write IR to file '%s': %s\n", ctx->options.ir_output_filename, message);
+        LLVMDisposeMessage(message);
+        abort_compilation();
+    }
+    time_report_leave(ctx->time_report, previous_phase);
+}
+
+void dispose_code_generation(CodegenContext *ctx) {
+    if (!ctx) return;
+
+    if (ctx->builder) LLVMDisposeBuilder(ctx->builder);
+    free_debug_info(ctx->debug);  // Finishing it needs the module
+    if (ctx->module) LLVMDisposeModule(ctx->module);
+    free_imported_modules(ctx->imports);  // Modules not linked yet still belong to the context
+    if (ctx->ts_context) LLVMOrcDisposeThreadSafeContext(ctx->ts_context);
+    cleanup_value_map(ctx);
+    free_command_list(ctx->waiting_commands);
+    free_profile(ctx->profile);
+    free_index_ranges(ctx->index_ranges);
+
+    free(ctx->output_filename);
+    free(ctx);
+}
+
+static void check_llvm_error(LLVMErrorRef error, const char *action) {
+    if (!error) return;
+
+    char *message = LLVMGetErrorMessage(error);
+    fprintf(stderr, "Error: Could not %s: %s\n", action, message);
+    LLVMDisposeErrorMessage(message);
+    abort_compilation();
+}
+
+static int has_target_options(const CodegenOptions *options) {
+    return options->target_triple || options->target_cpu || options->target_features;
+}
+
+// Object files run anywhere the triple does unless a CPU is asked for;
+// JIT code only ever runs here, so it is tuned for the host by default
+static LLVMTargetMachineRef create_target_machine(CodegenContext *ctx, int for_jit) {
+    initialize_native_target();
+
+    char *triple = ctx->options.target_triple ? LLVMNormalizeTargetTriple(ctx->options.target_triple)
+                                              : LLVMGetDefaultTargetTriple();
+    LLVMTargetRef target = NULL;
+    char *message = NULL;
+    if (LLVMGetTargetFromTriple(triple, &target, &message)) {
+        fprintf(stderr, "Error: Could not find target for '%s': %s\n", triple, message);
+        LLVMDisposeMessage(message);
+        LLVMDisposeMessage(triple);
+        abort_compilation();
+    }
+
+    const char *cpu = ctx->options.target_cpu;
+    if (!cpu) cpu = for_jit ? TARGET_CPU_NATIVE : "generic";
+    const char *features = ctx->options.target_features ? ctx->options.target_features : "";
+
+    char *host_cpu = NULL;
+    char *host_features = NULL;
+    if (strcmp(cpu, TARGET_CPU_NATIVE) == 0) {
+        host_cpu = LLVMGetHostCPUName();
+        cpu = host_cpu;
+        if (!ctx->options.target_features) {
+            host_features = LLVMGetHostCPUFeatures();
+            features = host_features;
+        }
+    }
+
+    LLVMCodeGenOptLevel codegen_level = LLVMCodeGenLevelNone;
+    switch (ctx->options.optimization_level) {
+        case 1: codegen_level = LLVMCodeGenLevelLess; break;
+        case 2: codegen_level = LLVMCodeGenLevelDefault; break;
+        case 3: codegen_level = LLVMCodeGenLevelAggressive; break;
+    }
+
+    LLVMTargetMachineRef target_machine = LLVMCreateTargetMachine(
+        target, triple, cpu, features, codegen_level, LLVMRelocPIC, LLVMCodeModelDefault);
+    LLVMDisposeMessage(triple);
+    if (host_cpu) LLVMDisposeMessage(host_cpu);
+    if (host_features) LLVMDisposeMessage(host_features);
+
+    if (!target_machine) {
+        fprintf(stderr, "Error: Could not create target machine\n");
+        abort_compilation();
+    }
+
+    return target_machine;
+}
+
+static void set_function_target_attribute(CodegenContext *ctx, LLVMValueRef function, const char *kind, const char *value) {
+    LLVMRemoveStringAttributeAtIndex(function, LLVMAttributeFunctionIndex, kind, strlen(kind));
+    if (value[0] == '\0') return;
+
+    LLVMAttributeRef attribute = LLVMCreateStringAttribute(ctx->context, kind, strlen(kind), value, strlen(value));
+    LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, attribute);
+}
+
+// Give the module the triple and data layout of target_machine, and every
+// function its CPU and features. The vectorizer and the inliner look at
+// the function attributes, and the runtime library and imported modules
+// were compiled without them.
+static void apply_target(CodegenContext *ctx, LLVMTargetMachineRef target_machine) {
+    char *triple = LLVMGetTargetMachineTriple(target_machine);
+    LLVMSetTarget(ctx->module, triple);
+    LLVMDisposeMessage(triple);
+
+    LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(target_machine);
+    char *layout = LLVMCopyStringRepOfTargetData(data_layout);
+    LLVMSetDataLayout(ctx->module, layout);
+    LLVMDisposeMessage(layout);
+    LLVMDisposeTargetData(data_layout);
+
+    char *cpu = LLVMGetTargetMachineCPU(target_machine);
+    char *features = LLVMGetTargetMachineFeatureString(target_machine);
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
+
+        set_function_target_attribute(ctx, function, "target-cpu", cpu);
+        set_function_target_attribute(ctx, function, "target-features", features);
+    }
+    LLVMDisposeMessage(cpu);
+    LLVMDisposeMessage(features);
+}
+
+static void emit_object_file(CodegenContext *ctx, LLVMTargetMachineRef target_machine, const char *object_filename) {
+    CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_WRITE_OUTPUT);
+    char *message = NULL;
+    if (LLVMTargetMachineEmitToFile(target_machine, ctx->module, (char *)object_filename,
+                                    LLVMObjectFile, &message)) {
+        fprintf(stderr, "Error: Could not write object file '%s': %s\n", object_filename, message);
+        LLVMDisposeMessage(message);
+        abort_compilation();
+    }
+    time_report_leave(ctx->time_report, previous_phase);
+}
+
+static void link_executable(const char *object_filename, const char *executable_filename) {
+    const char *linker = getenv("PTL_LINKER");
+    if (!linker || linker[0] == '\0') {
+        linker = "cc";
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        abort_compilation();
+    }
+
+    if (pid == 0) {
+        execlp(linker, linker, object_filename, "-o", executable_filename, (char *)NULL);
+        fprintf(stderr, "Error: Could not run linker '%s'\n", linker);
+        _exit(127);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Error: Linking '%s' failed\n", executable_filename);
+        abort_compilation();
+    }
+}
+
+void finalize_code_generation(CodegenContext *ctx) {
+    if (!ctx->module) return;
 
-    entry_block = LLVMAppendBasicBlockInContext(context, main_function, "entry");
-    LLVMPositionBuilderAtEnd(builder, entry_block);
-    current_function = main_function;
+    finish_main_function(ctx);
+    if (ctx->options.instrument_filename) {
+        emit_profile_dump(ctx, 1);
+    }
+
+    link_imported_modules(ctx);
+    link_runtime(ctx);
+
+    if (ctx->options.output_kind == OUTPUT_NONE || ctx->options.output_kind == OUTPUT_BITCODE) {
+        // Bitcode stays target independent unless a target is asked for
+        LLVMTargetMachineRef target_machine = NULL;
+        if (has_target_options(&ctx->options)) {
+            target_machine = create_target_machine(ctx, 0);
+            apply_target(ctx, target_machine);
+        }
+        optimize_module(ctx, target_machine);
+        if (target_machine) LLVMDisposeTargetMachine(target_machine);
+
+        CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_WRITE_OUTPUT);
+        if (ctx->options.output_kind == OUTPUT_BITCODE &&
+            LLVMWriteBitcodeToFile(ctx->module, ctx->output_filename) != 0) {
+            fprintf(stderr, "Error: Could not write bitcode to file '%s'\n", ctx->output_filename);
+            abort_compilation();
+        }
+        time_report_leave(ctx->time_report, previous_phase);
+    } else {
+        LLVMTargetMachineRef target_machine = create_target_machine(ctx, 0);
+        apply_target(ctx, target_machine);
+        optimize_module(ctx, target_machine);
+
+        if (ctx->options.output_kind == OUTPUT_OBJECT) {
+            emit_object_file(ctx, target_machine, ctx->output_filename);
+        } else {
+            char object_filename[1024];
+            snprintf(object_filename, sizeof(object_filename), "%s.o", ctx->output_filename);
+
+            emit_object_file(ctx, target_machine, object_filename);
+
+            CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_LINK);
+            link_executable(object_filename, ctx->output_filename);
+            remove(object_filename);
+            time_report_leave(ctx->time_report, previous_phase);
+        }
+
+        LLVMDisposeTargetMachine(target_machine);
+    }
+
+    write_ir_output(ctx);
+}
+
+// The JIT compiles for the host, so optimize with its vector widths and costs
+static void optimize_jit_module(CodegenContext *ctx) {
+    LLVMTargetMachineRef target_machine = create_target_machine(ctx, 1);
+    apply_target(ctx, target_machine);
+    optimize_module(ctx, target_machine);
+    LLVMDisposeTargetMachine(target_machine);
+}
+
+// An LLJIT whose code can call printf, scanf, strcpy... of the running process
+static LLVMOrcLLJITRef create_process_jit() {
+    initialize_native_target();
+
+    LLVMOrcLLJITRef jit = NULL;
+    check_llvm_error(LLVMOrcCreateLLJIT(&jit, NULL), "create LLJIT instance");
+
+    LLVMOrcJITDylibRef main_dylib = LLVMOrcLLJITGetMainJITDylib(jit);
+    LLVMOrcDefinitionGeneratorRef process_symbols = NULL;
+    check_llvm_error(LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(
+                         &process_symbols, LLVMOrcLLJITGetGlobalPrefix(jit), NULL, NULL),
+                     "create process symbol generator");
+    LLVMOrcJITDylibAddGenerator(main_dylib, process_symbols);
+
+    return jit;
+}
+
+int run_code_generation(CodegenContext *ctx) {
+    if (!ctx->module) return 1;
+
+    finish_main_function(ctx);
+    if (ctx->options.instrument_filename) {
+        emit_profile_dump(ctx, 0);
+    }
+    link_imported_modules(ctx);
+    link_runtime(ctx);
+    optimize_jit_module(ctx);
+    write_ir_output(ctx);
+
+    CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_JIT);
+
+    LLVMOrcLLJITRef jit = create_process_jit();
+    LLVMOrcJITDylibRef main_dylib = LLVMOrcLLJITGetMainJITDylib(jit);
+
+    // The JIT takes ownership of the module
+    LLVMOrcThreadSafeModuleRef ts_module = LLVMOrcCreateNewThreadSafeModule(ctx->module, ctx->ts_context);
+    ctx->module = NULL;
+    check_llvm_error(LLVMOrcLLJITAddLLVMIRModule(jit, main_dylib, ts_module), "add module to JIT");
+
+    LLVMOrcExecutorAddress main_address = 0;
+    check_llvm_error(LLVMOrcLLJITLookup(jit, &main_address, "main"), "look up 'main'");
+
+    int (*jit_main)(void) = (int (*)(void)) main_address;
+    time_report_enter(ctx->time_report, PHASE_EXECUTE);
+    int exit_code = jit_main();
+    fflush(stdout);
+    time_report_leave(ctx->time_report, previous_phase);
+
+    // Static destructors do not run in the JIT, so write the profile here
+    if (ctx->options.instrument_filename) {
+        LLVMOrcExecutorAddress dump_address = 0;
+        check_llvm_error(LLVMOrcLLJITLookup(jit, &dump_address, PROFILE_DUMP_FUNCTION),
+                         "look up '" PROFILE_DUMP_FUNCTION "'");
+        ((void (*)(void)) dump_address)();
+    }
+
+    check_llvm_error(LLVMOrcDisposeLLJIT(jit), "dispose LLJIT instance");
+    return exit_code;
+}
+
+JitSession *create_jit_session() {
+    JitSession *session = (JitSession *)calloc(1, sizeof(JitSession));
+    if (!session) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    session->jit = create_process_jit();
+    session->ts_context = LLVMOrcCreateNewThreadSafeContext();
+    return session;
+}
+
+int jit_session_defines(JitSession *session, const char *name) {
+    for (JitDefinition *definition = session->definitions; definition != NULL; definition = definition->next) {
+        if (strcmp(definition->name, name) == 0) return 1;
+    }
+    return 0;
+}
+
+CodegenContext *begin_jit_entry(JitSession *session, SymbolTable *symbol_table,
+                                FunctionTable *function_table, const CodegenOptions *options) {
+    char entry_name[64];
+    snprintf(entry_name, sizeof(entry_name), "__ptl_entry_%d", ++session->entry_count);
+
+    LLVMContextRef context = LLVMOrcThreadSafeContextGetContext(session->ts_context);
+    CodegenContext *ctx = create_codegen_context(entry_name, context, symbol_table, function_table, options);
+
+    // The top-level statements of the entry become a function of their own
+    LLVMSetValueName2(ctx->main_function, entry_name, strlen(entry_name));
+
+    // Earlier entries live in the JIT; declare what they defined so that
+    // lookups by name find it and the JIT links the references
+    for (JitDefinition *definition = session->definitions; definition != NULL; definition = definition->next) {
+        if (definition->is_function) {
+            LLVMAddFunction(ctx->module, definition->name, definition->type);
+        } else {
+            LLVMAddGlobal(ctx->module, definition->type, definition->name);
+        }
+    }
+
+    return ctx;
+}
+
+static void free_jit_definitions(JitDefinition *definition) {
+    while (definition != NULL) {
+        JitDefinition *next = definition->next;
+        free(definition->name);
+        free(definition);
+        definition = next;
+    }
+}
+
+static JitDefinition *add_jit_definition(JitDefinition *head, LLVMValueRef value, int is_function) {
+    JitDefinition *definition = (JitDefinition *)malloc(sizeof(JitDefinition));
+    if (!definition) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    size_t length;
+    definition->name = strdup(LLVMGetValueName2(value, &length));
+    definition->type = LLVMGlobalGetValueType(value);
+    definition->is_function = is_function;
+    definition->next = head;
+    return definition;
 }
 
-void finalize_code_generation() {
-    if (!module) return;
+int run_jit_entry(JitSession *session, CodegenContext *ctx) {
+    if (!ctx->module) return 1;
+
+    finish_main_function(ctx);
 
-    LLVMBuildRet(builder, LLVMConstInt(LLVMInt32Type(), 0, 0));
+    // Later entries declare these globals, which cannot bind to common symbols
+    for (LLVMValueRef global = LLVMGetFirstGlobal(ctx->module); global != NULL; global = LLVMGetNextGlobal(global)) {
+        if (LLVMGetLinkage(global) == LLVMCommonLinkage) {
+            LLVMSetLinkage(global, LLVMExternalLinkage);
+        }
+    }
+
+    link_imported_modules(ctx);
+    link_runtime(ctx);
+    optimize_jit_module(ctx);
+    write_ir_output(ctx);
+
+    JitDefinition *added = NULL;
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (function != ctx->main_function && !LLVMIsDeclaration(function) &&
+            LLVMGetLinkage(function) != LLVMInternalLinkage) {
+            added = add_jit_definition(added, function, 1);
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(ctx->module); global != NULL; global = LLVMGetNextGlobal(global)) {
+        LLVMLinkage linkage = LLVMGetLinkage(global);
+        if (!LLVMIsDeclaration(global) && linkage != LLVMPrivateLinkage && linkage != LLVMInternalLinkage) {
+            added = add_jit_definition(added, global, 0);
+        }
+    }
+
+    size_t length;
+    char *entry_name = strdup(LLVMGetValueName2(ctx->main_function, &length));
 
-    if (LLVMWriteBitcodeToFile(module, saved_output_filename) != 0) {
-        fprintf(stderr, "Error: Could not write bitcode to file '%s'\n", saved_output_filename);
-        exit(1);
+    // The JIT takes ownership of the module; the context stays with the session
+    LLVMOrcJITDylibRef main_dylib = LLVMOrcLLJITGetMainJITDylib(session->jit);
+    LLVMOrcThreadSafeModuleRef ts_module = LLVMOrcCreateNewThreadSafeModule(ctx->module, session->ts_context);
+    ctx->module = NULL;
+
+    LLVMErrorRef error = LLVMOrcLLJITAddLLVMIRModule(session->jit, main_dylib, ts_module);
+    LLVMOrcExecutorAddress entry_address = 0;
+    if (!error) {
+        error = LLVMOrcLLJITLookup(session->jit, &entry_address, entry_name);
+    }
+    free(entry_name);
+    if (error) {
+        free_jit_definitions(added);
+        check_llvm_error(error, "compile entry");
     }
 
-    if (output_file) {
-        char *ir_string = LLVMPrintModuleToString(module);
-        fprintf(output_file, "%s", ir_string);
-        LLVMDisposeMessage(ir_string);
-        fclose(output_file);
+    // Only entries that compiled contribute definitions to later ones
+    while (added != NULL) {
+        JitDefinition *next = added->next;
+        added->next = session->definitions;
+        session->definitions = added;
+        added = next;
     }
 
-    LLVMDisposeBuilder(builder);
-    LLVMDisposeModule(module);
-    cleanup_value_map();
+    int (*entry)(void) = (int (*)(void)) entry_address;
+    int result = entry();
+    fflush(stdout);
+    return result;
+}
+
+void dispose_jit_session(JitSession *session) {
+    if (!session) return;
 
-    output_file = NULL;
-    context = NULL;
-    module = NULL;
-    builder = NULL;
+    check_llvm_error(LLVMOrcDisposeLLJIT(session->jit), "dispose LLJIT instance");
+    LLVMOrcDisposeThreadSafeContext(session->ts_context);
+    free_jit_definitions(session->definitions);
+    free(session);
 }
 
 int isComparisonOp(int operator) {
@@ -238,12 +976,12 @@ int isComparisonOp(int operator) {
            operator == EQUAL || operator == NEQUAL;
 }
 
-LLVMValueRef generate_function_call(const char *func_name, ExpressionList *args, SymbolTable *symbol_table) {
+LLVMValueRef generate_function_call(CodegenContext *ctx, const char *func_name, ExpressionList *args, SymbolTable *symbol_table) {
     // Look up the function in LLVM module
-    LLVMValueRef function = LLVMGetNamedFunction(module, func_name);
+    LLVMValueRef function = LLVMGetNamedFunction(ctx->module, func_name);
     if (!function) {
         fprintf(stderr, "Error: Function '%s' not found\n", func_name);
-        exit(1);
+        abort_compilation();
         return NULL;
     }
 
@@ -266,15 +1004,17 @@ LLVMValueRef generate_function_call(const char *func_name, ExpressionList *args,
             // Check if this is an array variable
             if (arg->expr->type == EXPR_VAR) {
                 Symbol *sym = lookup_symbol(symbol_table, arg->expr->data.var_name);
-                if (sym && sym->is_array) {
-                    // For arrays, just get the pointer (don't load)
-                    arg_values[i] = get_value(arg->expr->data.var_name);
+                int by_reference = i < (int)LLVMCountParams(function) &&
+                    LLVMGetTypeKind(LLVMTypeOf(LLVMGetParam(function, i))) == LLVMPointerTypeKind;
+                if ((sym && sym->is_array) || by_reference) {
+                    // For arrays and reference parameters, just get the pointer (don't load)
+                    arg_values[i] = get_value(ctx, arg->expr->data.var_name);
                 } else {
                     // For scalars, generate normally
-                    arg_values[i] = generate_expression_code(arg->expr, symbol_table);
+                    arg_values[i] = generate_expression_code(ctx, arg->expr, symbol_table);
                 }
             } else {
-                arg_values[i] = generate_expression_code(arg->expr, symbol_table);
+                arg_values[i] = generate_expression_code(ctx, arg->expr, symbol_table);
             }
 
             if (!arg_values[i]) {
@@ -290,7 +1030,8 @@ LLVMValueRef generate_function_call(const char *func_name, ExpressionList *args,
     LLVMTypeRef func_type = LLVMGlobalGetValueType(function);
 
     // Generate call
-    LLVMValueRef call = LLVMBuildCall2(builder, func_type, function, arg_values, arg_count, "call");
+    LLVMValueRef call = LLVMBuildCall2(ctx->builder, func_type, function, arg_values, arg_count, "call");
+    bounds_call(ctx, args);
 
     if (arg_values) {
         free(arg_values);
@@ -299,17 +1040,60 @@ LLVMValueRef generate_function_call(const char *func_name, ExpressionList *args,
     return call;
 }
 
-LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_table) {
-    if (!expr || !builder) return NULL;
+// A multiply just built for an operand of + or -, which nothing else uses
+static int is_fusable_product(LLVMValueRef value) {
+    return LLVMIsAInstruction(value) && LLVMGetInstructionOpcode(value) == LLVMFMul && !LLVMGetFirstUse(value);
+}
+
+// Replace product by llvm.fmuladd(a, b, addend), which the backend emits
+// as one fused multiply-add where the target has one
+static LLVMValueRef build_fmuladd(CodegenContext *ctx, LLVMValueRef product, LLVMValueRef addend, int negate_product) {
+    LLVMTypeRef float_type = LLVMFloatTypeInContext(ctx->context);
+    unsigned id = LLVMLookupIntrinsicID("llvm.fmuladd", 12);
+    LLVMValueRef fmuladd = LLVMGetIntrinsicDeclaration(ctx->module, id, &float_type, 1);
+    LLVMTypeRef fmuladd_type = LLVMIntrinsicGetType(ctx->context, id, &float_type, 1);
+
+    LLVMValueRef args[3] = { LLVMGetOperand(product, 0), LLVMGetOperand(product, 1), addend };
+    if (negate_product) {
+        args[0] = LLVMBuildFNeg(ctx->builder, args[0], "fneg");
+    }
+    LLVMInstructionEraseFromParent(product);
+    return LLVMBuildCall2(ctx->builder, fmuladd_type, fmuladd, args, 3, "fmuladd");
+}
+
+static LLVMValueRef build_float_arithmetic(CodegenContext *ctx, int operator, LLVMValueRef left, LLVMValueRef right) {
+    ctx->float_operations++;
+
+    if ((ctx->options.float_math & FLOAT_CONTRACT) && (operator == PLUS || operator == MINUS)) {
+        if (is_fusable_product(left)) {
+            LLVMValueRef addend = operator == MINUS ? LLVMBuildFNeg(ctx->builder, right, "fneg") : right;
+            return build_fmuladd(ctx, left, addend, 0);
+        }
+        if (is_fusable_product(right)) {
+            return build_fmuladd(ctx, right, left, operator == MINUS);
+        }
+    }
+
+    switch (operator) {
+        case PLUS:   return LLVMBuildFAdd(ctx->builder, left, right, "fadd");
+        case MINUS:  return LLVMBuildFSub(ctx->builder, left, right, "fsub");
+        case TIMES:  return LLVMBuildFMul(ctx->builder, left, right, "fmul");
+        case DIVIDE: return LLVMBuildFDiv(ctx->builder, left, right, "fdiv");
+        default:     return NULL;
+    }
+}
+
+LLVMValueRef generate_expression_code(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table) {
+    if (!expr || !ctx->builder) return NULL;
     switch (expr->type) {
         case EXPR_STRING_LITERAL:
-            return create_string_constant(expr->data.string_value);
+            return create_string_constant(ctx, expr->data.string_value);
 
         case EXPR_VAR: {
-            LLVMValueRef var_alloca = get_value(expr->data.var_name);
+            LLVMValueRef var_alloca = get_value(ctx, expr->data.var_name);
             if (!var_alloca) {
                 fprintf(stderr, "Error: Variable '%s' not found\n", expr->data.var_name);
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
 
@@ -321,41 +1105,41 @@ LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_tabl
                 var_type = LLVMGetAllocatedType(var_alloca);
             } else {
                 fprintf(stderr, "Error: Variable '%s' is neither global nor local alloca\n", expr->data.var_name);
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
 
             if (!var_type || LLVMGetTypeKind(var_type) == LLVMVoidTypeKind) {
                 fprintf(stderr, "Error: Variable '%s' has void or null type\n", expr->data.var_name);
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
 
-            return LLVMBuildLoad2(builder, var_type, var_alloca, "load");
+            return LLVMBuildLoad2(ctx->builder, var_type, var_alloca, "load");
         }
 
         case EXPR_INT_LITERAL:
-            return LLVMConstInt(LLVMInt32Type(), expr->data.int_value, 0);
+            return LLVMConstInt(LLVMInt32TypeInContext(ctx->context), expr->data.int_value, 0);
 
         case EXPR_FLOAT_LITERAL:
-            return LLVMConstReal(LLVMFloatType(), expr->data.float_value);
+            return LLVMConstReal(LLVMFloatTypeInContext(ctx->context), expr->data.float_value);
 
         case EXPR_CHAR_LITERAL:
-            return LLVMConstInt(LLVMInt8Type(), expr->data.char_value, 0);
+            return LLVMConstInt(LLVMInt8TypeInContext(ctx->context), expr->data.char_value, 0);
 
         case EXPR_BOOL_LITERAL:
-            return LLVMConstInt(LLVMInt1Type(), expr->data.bool_value ? 1 : 0, 0);
+            return LLVMConstInt(LLVMInt1TypeInContext(ctx->context), expr->data.bool_value ? 1 : 0, 0);
 
         case EXPR_FUNC_CALL:
-            return generate_function_call(expr->data.func_call.func_name,
+            return generate_function_call(ctx, expr->data.func_call.func_name,
                                         expr->data.func_call.args, symbol_table);
 
         case EXPR_ARRAY_ACCESS: {
-            LLVMValueRef array_ptr = get_value(expr->data.array_access.array_name);
+            LLVMValueRef array_ptr = get_value(ctx, expr->data.array_access.array_name);
             if (!array_ptr) {
                 fprintf(stderr, "Error: Array '%s' not found\n",
                         expr->data.array_access.array_name);
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
 
@@ -364,19 +1148,19 @@ LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_tabl
                 if (symbol->is_array) {
                     return array_ptr;
                 } else {
-                    LLVMTypeRef string_type = LLVMArrayType(LLVMInt8Type(), 256);
+                    LLVMTypeRef string_type = LLVMArrayType(LLVMInt8TypeInContext(ctx->context), 256);
                     LLVMValueRef indices[] = {
-                        LLVMConstInt(LLVMInt32Type(), 0, 0),
-                        LLVMConstInt(LLVMInt32Type(), 0, 0)
+                        LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0),
+                        LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0)
                     };
-                    return LLVMBuildGEP2(builder, string_type, array_ptr, indices, 2, "str_ptr");
+                    return LLVMBuildGEP2(ctx->builder, string_type, array_ptr, indices, 2, "str_ptr");
                 }
             }
 
             if (!symbol || !symbol->is_array) {
                 fprintf(stderr, "Error: '%s' is not an array\n",
                         expr->data.array_access.array_name);
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
 
@@ -390,156 +1174,151 @@ LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_tabl
 
             // Build GEP indices
             LLVMValueRef *indices = (LLVMValueRef*)malloc((index_count + 1) * sizeof(LLVMValueRef));
-            indices[0] = LLVMConstInt(LLVMInt32Type(), 0, 0);
+            indices[0] = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0);
 
             idx = expr->data.array_access.indices;
             for (int i = 0; i < index_count; i++) {
-                indices[i + 1] = generate_expression_code(idx->expr, symbol_table);
+                indices[i + 1] = generate_expression_code(ctx, idx->expr, symbol_table);
+                build_bounds_check(ctx, symbol, i, idx->expr, indices[i + 1]);
                 idx = idx->next;
             }
 
-            LLVMTypeRef array_type = get_array_type(symbol);
-            LLVMTypeRef element_type = get_llvm_type(symbol->type);
+            LLVMTypeRef array_type = get_array_type(ctx, symbol);
+            LLVMTypeRef element_type = get_llvm_type(ctx, symbol->type);
 
-            LLVMValueRef gep = LLVMBuildGEP2(builder, array_type, array_ptr,
+            LLVMValueRef gep = LLVMBuildGEP2(ctx->builder, array_type, array_ptr,
                                              indices, index_count + 1, "arrayidx");
 
             free(indices);
 
-            return LLVMBuildLoad2(builder, element_type, gep, "arrayload");
+            return LLVMBuildLoad2(ctx->builder, element_type, gep, "arrayload");
         }
 
         case EXPR_BINARY_OP: {
-            LLVMValueRef left = generate_expression_code(expr->data.binary_op.left, symbol_table);
-            LLVMValueRef right = generate_expression_code(expr->data.binary_op.right, symbol_table);
+            LLVMValueRef left = generate_expression_code(ctx, expr->data.binary_op.left, symbol_table);
+            LLVMValueRef right = generate_expression_code(ctx, expr->data.binary_op.right, symbol_table);
             if (!left || !right) return NULL;
 
-            DataType left_type = get_expression_type(expr->data.binary_op.left, symbol_table);
-            DataType right_type = get_expression_type(expr->data.binary_op.right, symbol_table);
+            DataType left_type = get_expression_type(ctx, expr->data.binary_op.left, symbol_table);
+            DataType right_type = get_expression_type(ctx, expr->data.binary_op.right, symbol_table);
 
             if (left_type == TYPE_STRING || right_type == TYPE_STRING) {
                 fprintf(stderr, "Error: Unsupported string operation\n");
-                exit(1);
+                abort_compilation();
             }
 
             if (expr->data.binary_op.operator == AND || expr->data.binary_op.operator == OR) {
                 if (LLVMGetTypeKind(LLVMTypeOf(left)) != LLVMIntegerTypeKind ||
                     LLVMGetIntTypeWidth(LLVMTypeOf(left)) != 1) {
-                    left = LLVMBuildICmp(builder, LLVMIntNE, left,
+                    left = LLVMBuildICmp(ctx->builder, LLVMIntNE, left,
                         LLVMConstInt(LLVMTypeOf(left), 0, 0), "left_to_bool");
                 }
 
                 if (LLVMGetTypeKind(LLVMTypeOf(right)) != LLVMIntegerTypeKind ||
                     LLVMGetIntTypeWidth(LLVMTypeOf(right)) != 1) {
-                    right = LLVMBuildICmp(builder, LLVMIntNE, right,
+                    right = LLVMBuildICmp(ctx->builder, LLVMIntNE, right,
                         LLVMConstInt(LLVMTypeOf(right), 0, 0), "right_to_bool");
                 }
 
                 if (expr->data.binary_op.operator == AND) {
-                    return LLVMBuildAnd(builder, left, right, "logical_and");
+                    return LLVMBuildAnd(ctx->builder, left, right, "logical_and");
                 } else {
-                    return LLVMBuildOr(builder, left, right, "logical_or");
+                    return LLVMBuildOr(ctx->builder, left, right, "logical_or");
                 }
             }
             if (isComparisonOp(expr->data.binary_op.operator)) {
                 if (left_type == TYPE_INT && right_type == TYPE_INT) {
                     switch (expr->data.binary_op.operator) {
-                        case LT:     return LLVMBuildICmp(builder, LLVMIntSLT, left, right, "lt");
-                        case LE:     return LLVMBuildICmp(builder, LLVMIntSLE, left, right, "le");
-                        case GT:     return LLVMBuildICmp(builder, LLVMIntSGT, left, right, "gt");
-                        case GE:     return LLVMBuildICmp(builder, LLVMIntSGE, left, right, "ge");
-                        case EQUAL:  return LLVMBuildICmp(builder, LLVMIntEQ, left, right, "eq");
-                        case NEQUAL: return LLVMBuildICmp(builder, LLVMIntNE, left, right, "ne");
+                        case LT:     return LLVMBuildICmp(ctx->builder, LLVMIntSLT, left, right, "lt");
+                        case LE:     return LLVMBuildICmp(ctx->builder, LLVMIntSLE, left, right, "le");
+                        case GT:     return LLVMBuildICmp(ctx->builder, LLVMIntSGT, left, right, "gt");
+                        case GE:     return LLVMBuildICmp(ctx->builder, LLVMIntSGE, left, right, "ge");
+                        case EQUAL:  return LLVMBuildICmp(ctx->builder, LLVMIntEQ, left, right, "eq");
+                        case NEQUAL: return LLVMBuildICmp(ctx->builder, LLVMIntNE, left, right, "ne");
                         default:     return NULL;
                     }
                 }
                 else if (left_type == TYPE_FLOAT || right_type == TYPE_FLOAT) {
                     if (left_type == TYPE_INT) {
-                        left = LLVMBuildSIToFP(builder, left, LLVMFloatType(), "int_to_float_left");
+                        left = LLVMBuildSIToFP(ctx->builder, left, LLVMFloatTypeInContext(ctx->context), "int_to_float_left");
                     }
                     if (right_type == TYPE_INT) {
-                        right = LLVMBuildSIToFP(builder, right, LLVMFloatType(), "int_to_float_right");
+                        right = LLVMBuildSIToFP(ctx->builder, right, LLVMFloatTypeInContext(ctx->context), "int_to_float_right");
                     }
 
                     switch (expr->data.binary_op.operator) {
-                        case LT:     return LLVMBuildFCmp(builder, LLVMRealOLT, left, right, "flt");
-                        case LE:     return LLVMBuildFCmp(builder, LLVMRealOLE, left, right, "fle");
-                        case GT:     return LLVMBuildFCmp(builder, LLVMRealOGT, left, right, "fgt");
-                        case GE:     return LLVMBuildFCmp(builder, LLVMRealOGE, left, right, "fge");
-                        case EQUAL:  return LLVMBuildFCmp(builder, LLVMRealOEQ, left, right, "feq");
-                        case NEQUAL: return LLVMBuildFCmp(builder, LLVMRealONE, left, right, "fne");
+                        case LT:     return LLVMBuildFCmp(ctx->builder, LLVMRealOLT, left, right, "flt");
+                        case LE:     return LLVMBuildFCmp(ctx->builder, LLVMRealOLE, left, right, "fle");
+                        case GT:     return LLVMBuildFCmp(ctx->builder, LLVMRealOGT, left, right, "fgt");
+                        case GE:     return LLVMBuildFCmp(ctx->builder, LLVMRealOGE, left, right, "fge");
+                        case EQUAL:  return LLVMBuildFCmp(ctx->builder, LLVMRealOEQ, left, right, "feq");
+                        case NEQUAL: return LLVMBuildFCmp(ctx->builder, LLVMRealONE, left, right, "fne");
                         default:     return NULL;
                     }
                 }
             }
             if (left_type == TYPE_INT && right_type == TYPE_INT) {
                 switch (expr->data.binary_op.operator) {
-                    case PLUS:   return LLVMBuildAdd(builder, left, right, "add");
-                    case MINUS:  return LLVMBuildSub(builder, left, right, "sub");
-                    case TIMES:  return LLVMBuildMul(builder, left, right, "mul");
-                    case DIVIDE: return LLVMBuildSDiv(builder, left, right, "div");
+                    case PLUS:   return LLVMBuildAdd(ctx->builder, left, right, "add");
+                    case MINUS:  return LLVMBuildSub(ctx->builder, left, right, "sub");
+                    case TIMES:  return LLVMBuildMul(ctx->builder, left, right, "mul");
+                    case DIVIDE: return LLVMBuildSDiv(ctx->builder, left, right, "div");
                     default:     return NULL;
                 }
             }
             else if (left_type == TYPE_FLOAT || right_type == TYPE_FLOAT) {
 
                 if (left_type == TYPE_INT) {
-                    left = LLVMBuildSIToFP(builder, left, LLVMFloatType(), "int_to_float_left");
+                    left = LLVMBuildSIToFP(ctx->builder, left, LLVMFloatTypeInContext(ctx->context), "int_to_float_left");
                 }
                 if (right_type == TYPE_INT) {
-                    right = LLVMBuildSIToFP(builder, right, LLVMFloatType(), "int_to_float_right");
+                    right = LLVMBuildSIToFP(ctx->builder, right, LLVMFloatTypeInContext(ctx->context), "int_to_float_right");
                 }
 
-                switch (expr->data.binary_op.operator) {
-                    case PLUS:   return LLVMBuildFAdd(builder, left, right, "fadd");
-                    case MINUS:  return LLVMBuildFSub(builder, left, right, "fsub");
-                    case TIMES:  return LLVMBuildFMul(builder, left, right, "fmul");
-                    case DIVIDE: return LLVMBuildFDiv(builder, left, right, "fdiv");
-                    default:     return NULL;
-                }
+                return build_float_arithmetic(ctx, expr->data.binary_op.operator, left, right);
             }
             else if (left_type == TYPE_FLOAT && right_type == TYPE_FLOAT) {
                 switch (expr->data.binary_op.operator) {
-                    case PLUS:   return LLVMBuildFAdd(builder, left, right, "fadd");
-                    case MINUS:  return LLVMBuildFSub(builder, left, right, "fsub");
-                    case TIMES:  return LLVMBuildFMul(builder, left, right, "fmul");
-                    case DIVIDE: return LLVMBuildFDiv(builder, left, right, "fdiv");
-                    case LT:     return LLVMBuildFCmp(builder, LLVMRealOLT, left, right, "flt");
-                    case LE:     return LLVMBuildFCmp(builder, LLVMRealOLE, left, right, "fle");
-                    case GT:     return LLVMBuildFCmp(builder, LLVMRealOGT, left, right, "fgt");
-                    case GE:     return LLVMBuildFCmp(builder, LLVMRealOGE, left, right, "fge");
-                    case EQUAL:  return LLVMBuildFCmp(builder, LLVMRealOEQ, left, right, "feq");
-                    case NEQUAL: return LLVMBuildFCmp(builder, LLVMRealONE, left, right, "fne");
+                    case PLUS:
+                    case MINUS:
+                    case TIMES:
+                    case DIVIDE: return build_float_arithmetic(ctx, expr->data.binary_op.operator, left, right);
+                    case LT:     return LLVMBuildFCmp(ctx->builder, LLVMRealOLT, left, right, "flt");
+                    case LE:     return LLVMBuildFCmp(ctx->builder, LLVMRealOLE, left, right, "fle");
+                    case GT:     return LLVMBuildFCmp(ctx->builder, LLVMRealOGT, left, right, "fgt");
+                    case GE:     return LLVMBuildFCmp(ctx->builder, LLVMRealOGE, left, right, "fge");
+                    case EQUAL:  return LLVMBuildFCmp(ctx->builder, LLVMRealOEQ, left, right, "feq");
+                    case NEQUAL: return LLVMBuildFCmp(ctx->builder, LLVMRealONE, left, right, "fne");
                     default:     return NULL;
                 }
             }
             else {
                 fprintf(stderr, "Warning: Mixed type operations not fully supported\n");
-                exit(1);
+                abort_compilation();
                 return NULL;
             }
         }
 
         case EXPR_UNARY_OP: {
-            LLVMValueRef operand = generate_expression_code(expr->data.unary_op.operand, symbol_table);
+            LLVMValueRef operand = generate_expression_code(ctx, expr->data.unary_op.operand, symbol_table);
             if (!operand) return NULL;
 
-            DataType operand_type = get_expression_type(expr->data.unary_op.operand, symbol_table);
+            DataType operand_type = get_expression_type(ctx, expr->data.unary_op.operand, symbol_table);
 
             switch (expr->data.unary_op.operator) {
                 case MINUS:
                     if (operand_type == TYPE_INT)
-                        return LLVMBuildNeg(builder, operand, "neg");
+                        return LLVMBuildNeg(ctx->builder, operand, "neg");
                     else if (operand_type == TYPE_FLOAT)
-                        return LLVMBuildFNeg(builder, operand, "fneg");
+                        return LLVMBuildFNeg(ctx->builder, operand, "fneg");
                     break;
                 case NOT:
                     if (LLVMGetTypeKind(LLVMTypeOf(operand)) != LLVMIntegerTypeKind ||
                         LLVMGetIntTypeWidth(LLVMTypeOf(operand)) != 1) {
-                        operand = LLVMBuildICmp(builder, LLVMIntNE, operand,
+                        operand = LLVMBuildICmp(ctx->builder, LLVMIntNE, operand,
                                 LLVMConstInt(LLVMTypeOf(operand), 0, 0), "to_bool");
                     }
-                    return LLVMBuildNot(builder, operand, "logical_not");
+                    return LLVMBuildNot(ctx->builder, operand, "logical_not");
                 default:
                     return NULL;
             }
@@ -549,20 +1328,20 @@ LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_tabl
     return NULL;
 }
 
-LLVMValueRef generate_float_expression_code(Expression *expr, SymbolTable *symbol_table) {
-    LLVMValueRef value = generate_expression_code(expr, symbol_table);
-    DataType expr_type = get_expression_type(expr, symbol_table);
+LLVMValueRef generate_float_expression_code(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table) {
+    LLVMValueRef value = generate_expression_code(ctx, expr, symbol_table);
+    DataType expr_type = get_expression_type(ctx, expr, symbol_table);
 
     if (value && expr_type != TYPE_FLOAT) {
         if (expr_type == TYPE_INT) {
-            return LLVMBuildSIToFP(builder, value, LLVMFloatType(), "int2float");
+            return LLVMBuildSIToFP(ctx->builder, value, LLVMFloatTypeInContext(ctx->context), "int2float");
         }
     }
 
     return value;
 }
 
-DataType get_expression_type(Expression *expr, SymbolTable *symbol_table) {
+DataType get_expression_type(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table) {
     if (!expr) return TYPE_UNKNOWN;
 
     switch (expr->type) {
@@ -585,16 +1364,16 @@ DataType get_expression_type(Expression *expr, SymbolTable *symbol_table) {
             return symbol ? symbol->type : TYPE_UNKNOWN;
         }
         case EXPR_FUNC_CALL: {
-            if (current_function && strcmp(expr->data.func_call.func_name, LLVMGetValueName(current_function)) == 0) {
-                LLVMTypeRef return_type = get_current_function_return_type();
+            if (ctx->current_function && strcmp(expr->data.func_call.func_name, LLVMGetValueName(ctx->current_function)) == 0) {
+                LLVMTypeRef return_type = get_current_function_return_type(ctx);
                 return llvm_type_to_data_type(return_type);
             }
 
             return TYPE_INT;
         }
         case EXPR_BINARY_OP: {
-            DataType left_type = get_expression_type(expr->data.binary_op.left, symbol_table);
-            DataType right_type = get_expression_type(expr->data.binary_op.right, symbol_table);
+            DataType left_type = get_expression_type(ctx, expr->data.binary_op.left, symbol_table);
+            DataType right_type = get_expression_type(ctx, expr->data.binary_op.right, symbol_table);
 
             switch (expr->data.binary_op.operator) {
                 case LT:
@@ -616,7 +1395,7 @@ DataType get_expression_type(Expression *expr, SymbolTable *symbol_table) {
             }
         }
         case EXPR_UNARY_OP: {
-            DataType operand_type = get_expression_type(expr->data.unary_op.operand, symbol_table);
+            DataType operand_type = get_expression_type(ctx, expr->data.unary_op.operand, symbol_table);
 
             switch (expr->data.unary_op.operator) {
                 case NOT:
@@ -660,20 +1439,20 @@ DataType llvm_type_to_data_type(LLVMTypeRef llvm_type) {
     }
 }
 
-LLVMTypeRef get_current_function_return_type() {
-    if (!current_function) {
+LLVMTypeRef get_current_function_return_type(CodegenContext *ctx) {
+    if (!ctx->current_function) {
         return NULL;
     }
 
-    LLVMTypeRef function_type = LLVMGlobalGetValueType(current_function);
+    LLVMTypeRef function_type = LLVMGlobalGetValueType(ctx->current_function);
     LLVMTypeRef return_type = LLVMGetReturnType(function_type);
 
     return return_type;
 }
 
-static LLVMValueRef create_global_variable(const char *name, DataType type) {
-    LLVMTypeRef llvm_type = get_llvm_type(type);
-    LLVMValueRef global = LLVMAddGlobal(module, llvm_type, name);
+static LLVMValueRef create_global_variable(CodegenContext *ctx, const char *name, DataType type) {
+    LLVMTypeRef llvm_type = get_llvm_type(ctx, type);
+    LLVMValueRef global = LLVMAddGlobal(ctx->module, llvm_type, name);
 
     if (type == TYPE_FLOAT) {
         LLVMSetInitializer(global, LLVMConstReal(llvm_type, 0.0));
@@ -687,32 +1466,6 @@ static LLVMValueRef create_global_variable(const char *name, DataType type) {
     return global;
 }
 
-static LLVMValueRef get_printf_function() {
-    LLVMValueRef printf_func = LLVMGetNamedFunction(module, "printf");
-    if (printf_func) {
-        return printf_func;
-    }
-
-    LLVMTypeRef printf_arg_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-    LLVMTypeRef printf_type = LLVMFunctionType(LLVMInt32Type(), printf_arg_types, 1, 1);
-    printf_func = LLVMAddFunction(module, "printf", printf_type);
-
-    return printf_func;
-}
-
-static LLVMValueRef get_scanf_function() {
-    LLVMValueRef scanf_func = LLVMGetNamedFunction(module, "scanf");
-    if (scanf_func) {
-        return scanf_func;
-    }
-
-    LLVMTypeRef scanf_arg_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-    LLVMTypeRef scanf_type = LLVMFunctionType(LLVMInt32Type(), scanf_arg_types, 1, 1);
-    scanf_func = LLVMAddFunction(module, "scanf", scanf_type);
-
-    return scanf_func;
-}
-
 const char* get_format_for_type(DataType type) {
     switch (type) {
         case TYPE_INT:   return "%d";
@@ -723,166 +1476,708 @@ const char* get_format_for_type(DataType type) {
     }
 }
 
-void generate_function_definitions(CommandList *list) {
-    if (!list) return;
+// Add the prototype of the function current to the module
+static LLVMValueRef declare_function(CodegenContext *ctx, Command *current) {
+    // Generate function signature
+    const char *func_name = current->data.func_def.name;
+    DataType return_type = current->data.func_def.return_type;
+    Parameter *params = current->data.func_def.params;
+    // Count parameters
+    int param_count = 0;
+    Parameter *param = params;
+    while (param != NULL) {
+        param_count++;
+        param = param->next;
+    }
 
-    Command *current = list->head;
-    while (current != NULL) {
-        if (current->type == CMD_FUNC_DEF) {
-            // Generate function signature
-            const char *func_name = current->data.func_def.name;
-            DataType return_type = current->data.func_def.return_type;
-            Parameter *params = current->data.func_def.params;
-            // Count parameters
-            int param_count = 0;
-            Parameter *param = params;
-            while (param != NULL) {
-                param_count++;
-                param = param->next;
-            }
+    // Create parameter types array
+    LLVMTypeRef *param_types = NULL;
+    if (param_count > 0) {
+        param_types = (LLVMTypeRef*)malloc(param_count * sizeof(LLVMTypeRef));
+        param = params;
+        for (int i = 0; i < param_count; i++) {
+            if (param->is_reference || param->array_dims != NULL) {
+                // Pass as pointer
+                if (param->array_dims != NULL) {
+                    // Array parameter - create pointer to array type
+                    Symbol temp_symbol;
+                    temp_symbol.type = param->type;
+                    temp_symbol.is_array = 1;
+
+                    // Count and store dimensions
+                    int dim_count = 0;
+                    ArrayDimension *d = param->array_dims;
+                    while (d != NULL) {
+                        dim_count++;
+                        d = d->next;
+                    }
 
-            // Create parameter types array
-            LLVMTypeRef *param_types = NULL;
-            if (param_count > 0) {
-                param_types = (LLVMTypeRef*)malloc(param_count * sizeof(LLVMTypeRef));
-                param = params;
-                for (int i = 0; i < param_count; i++) {
-                    if (param->is_reference || param->array_dims != NULL) {
-                        // Pass as pointer
-                        if (param->array_dims != NULL) {
-                            // Array parameter - create pointer to array type
-                            Symbol temp_symbol;
-                            temp_symbol.type = param->type;
-                            temp_symbol.is_array = 1;
-
-                            // Count and store dimensions
-                            int dim_count = 0;
-                            ArrayDimension *d = param->array_dims;
-                            while (d != NULL) {
-                                dim_count++;
-                                d = d->next;
-                            }
-
-                            temp_symbol.num_dimensions = dim_count;
-                            temp_symbol.array_dimensions = (int*)malloc(dim_count * sizeof(int));
-
-                            d = param->array_dims;
-                            for (int j = 0; j < dim_count; j++) {
-                                temp_symbol.array_dimensions[j] = d->size;
-                                d = d->next;
-                            }
-
-                            LLVMTypeRef array_type = get_array_type(&temp_symbol);
-                            param_types[i] = LLVMPointerType(array_type, 0);
-
-                            free(temp_symbol.array_dimensions);
-                        } else {
-                            // Reference parameter - simple pointer
-                            param_types[i] = LLVMPointerType(get_llvm_type(param->type), 0);
-                        }
-                    } else {
-                        // Value parameter
-                        param_types[i] = get_llvm_type(param->type);
+                    temp_symbol.num_dimensions = dim_count;
+                    temp_symbol.array_dimensions = (int*)malloc(dim_count * sizeof(int));
+
+                    d = param->array_dims;
+                    for (int j = 0; j < dim_count; j++) {
+                        temp_symbol.array_dimensions[j] = d->size;
+                        d = d->next;
                     }
-                    param = param->next;
+
+                    LLVMTypeRef array_type = get_array_type(ctx, &temp_symbol);
+                    param_types[i] = LLVMPointerType(array_type, 0);
+
+                    free(temp_symbol.array_dimensions);
+                } else {
+                    // Reference parameter - simple pointer
+                    param_types[i] = LLVMPointerType(get_llvm_type(ctx, param->type), 0);
                 }
+            } else {
+                // Value parameter
+                param_types[i] = get_llvm_type(ctx, param->type);
             }
+            param = param->next;
+        }
+    }
 
-            // Create function type
-            LLVMTypeRef ret_type = get_llvm_type(return_type);
-            LLVMTypeRef func_type = LLVMFunctionType(ret_type, param_types, param_count, 0);
+    // Create function type
+    LLVMTypeRef ret_type = get_llvm_type(ctx, return_type);
+    LLVMTypeRef func_type = LLVMFunctionType(ret_type, param_types, param_count, 0);
 
-            // Create function
-            LLVMValueRef func = LLVMAddFunction(module, func_name, func_type);
+    // LLVM would rename the new function, leaving calls bound to the old one
+    if (LLVMGetNamedFunction(ctx->module, func_name)) {
+        fprintf(stderr, "Error: Function '%s' is already defined\n", func_name);
+        abort_compilation();
+    }
 
-            // Set parameter names
-            param = params;
-            for (int i = 0; i < param_count; i++) {
-                LLVMValueRef param_val = LLVMGetParam(func, i);
-                LLVMSetValueName(param_val, param->name);
-                param = param->next;
-            }
+    // Create function
+    LLVMValueRef func = LLVMAddFunction(ctx->module, func_name, func_type);
 
-            // Create entry block for function
-            LLVMBasicBlockRef func_entry = LLVMAppendBasicBlock(func, "entry");
-            LLVMValueRef old_function = current_function;
-            current_function = func;
+    if (param_types) {
+        free(param_types);
+    }
+    return func;
+}
 
-            // Save current position and switch to function
-            LLVMBasicBlockRef old_block = LLVMGetInsertBlock(builder);
-            LLVMPositionBuilderAtEnd(builder, func_entry);
+// Generate the body of the function cmd into func, its declaration
+static void generate_function_body(CodegenContext *ctx, Command *current, LLVMValueRef func) {
+    const char *func_name = current->data.func_def.name;
+    DataType return_type = current->data.func_def.return_type;
+    Parameter *params = current->data.func_def.params;
+    int param_count = 0;
+    Parameter *param = params;
+    while (param != NULL) {
+        param_count++;
+        param = param->next;
+    }
 
-            // Create allocas for parameters
-            param = params;
-            for (int i = 0; i < param_count; i++) {
-                LLVMValueRef param_val = LLVMGetParam(func, i);
+    // Set parameter names
+    param = params;
+    for (int i = 0; i < param_count; i++) {
+        LLVMValueRef param_val = LLVMGetParam(func, i);
+        LLVMSetValueName(param_val, param->name);
+        param = param->next;
+    }
 
-                if (param->is_reference || param->array_dims != NULL) {
-                    // For references and arrays, just store the pointer
-                    add_to_value_map(param->name, param_val);
-                } else {
-                    // For value parameters, create alloca and store
-                    LLVMTypeRef param_type = get_llvm_type(param->type);
-                    LLVMValueRef alloca = LLVMBuildAlloca(builder, param_type, param->name);
-                    LLVMBuildStore(builder, param_val, alloca);
-                    add_to_value_map(param->name, alloca);
-                }
+    // Create entry block for function
+    LLVMBasicBlockRef func_entry = LLVMAppendBasicBlockInContext(ctx->context, func, "entry");
+    LLVMValueRef old_function = ctx->current_function;
+    ctx->current_function = func;
+
+    // Save current position and switch to function
+    LLVMBasicBlockRef old_block = LLVMGetInsertBlock(ctx->builder);
+    ValueMap *outer_values = ctx->value_map;
+    LLVMPositionBuilderAtEnd(ctx->builder, func_entry);
+
+    LLVMMetadataRef outer_scope = debug_begin_function(ctx, func, current);
+    IndexRange *outer_ranges = bounds_begin_function(ctx);
+
+    ProfileFunction *old_profile_function = ctx->profile_function;
+    int old_profile_site = ctx->profile_site;
+    begin_profiled_function(ctx, func, func_name, hash_command(FNV_OFFSET_BASIS, current));
+
+    // Create allocas for parameters
+    param = params;
+    for (int i = 0; i < param_count; i++) {
+        LLVMValueRef param_val = LLVMGetParam(func, i);
+
+        if (param->is_reference || param->array_dims != NULL) {
+            // For references and arrays, just store the pointer
+            add_to_value_map(ctx, param->name, param_val);
+        } else {
+            // For value parameters, create alloca and store
+            LLVMTypeRef param_type = get_llvm_type(ctx, param->type);
+            LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, param_type, param->name);
+            LLVMBuildStore(ctx->builder, param_val, alloca);
+            add_to_value_map(ctx, param->name, alloca);
+        }
+        debug_declare_parameter(ctx, param, i + 1, get_value(ctx, param->name), current->line_number);
 
-                // Insert into symbol table with array dimensions if applicable
-                insert_symbol(current->data.func_def.body->symbol_table,
-                              param->name, param->type, 0, param->array_dims);
+        // Insert into symbol table with array dimensions if applicable
+        declare_symbol(ctx, current->data.func_def.body->symbol_table,
+                      param->name, param->type, 0, param->array_dims);
 
-                param = param->next;
-            }
+        param = param->next;
+    }
 
-            // Generate function body
-            generate_code_for_command_list(current->data.func_def.body);
-
-            // If no return statement, add default return
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                if (return_type == TYPE_INT) {
-                    LLVMBuildRet(builder, LLVMConstInt(LLVMInt32Type(), 0, 0));
-                } else if (return_type == TYPE_FLOAT) {
-                    LLVMBuildRet(builder, LLVMConstReal(LLVMFloatType(), 0.0));
-                } else if (return_type == TYPE_BOOL) {
-                    LLVMBuildRet(builder, LLVMConstInt(LLVMInt1Type(), 0, 0));
-                } else if (return_type == TYPE_CHAR) {
-                    LLVMBuildRet(builder, LLVMConstInt(LLVMInt8Type(), 0, 0));
-                } else {
-                    LLVMBuildRetVoid(builder);
-                }
-            }
+    // Generate function body
+    generate_code_for_command_list(ctx, current->data.func_def.body);
+
+    // If no return statement, add default return
+    if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+        if (return_type == TYPE_INT) {
+            LLVMBuildRet(ctx->builder, LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0));
+        } else if (return_type == TYPE_FLOAT) {
+            LLVMBuildRet(ctx->builder, LLVMConstReal(LLVMFloatTypeInContext(ctx->context), 0.0));
+        } else if (return_type == TYPE_BOOL) {
+            LLVMBuildRet(ctx->builder, LLVMConstInt(LLVMInt1TypeInContext(ctx->context), 0, 0));
+        } else if (return_type == TYPE_CHAR) {
+            LLVMBuildRet(ctx->builder, LLVMConstInt(LLVMInt8TypeInContext(ctx->context), 0, 0));
+        } else {
+            LLVMBuildRetVoid(ctx->builder);
+        }
+    }
 
-            // Restore previous position
-            current_function = old_function;
-            if (old_block) {
-                LLVMPositionBuilderAtEnd(builder, old_block);
-            }
+    // Parameters and locals must not shadow globals for later statements,
+    // which may be generated after this function when streaming
+    while (ctx->value_map != outer_values) {
+        ValueMap *entry = ctx->value_map;
+        ctx->value_map = entry->next;
+        free(entry->name);
+        free(entry);
+    }
 
-            if (param_types) {
-                free(param_types);
-            }
-        }
-        current = current->next;
+    // Restore previous position
+    debug_end_function(ctx, outer_scope);
+    bounds_end_function(ctx, outer_ranges);
+    ctx->current_function = old_function;
+    ctx->profile_function = old_profile_function;
+    ctx->profile_site = old_profile_site;
+    if (old_block) {
+        LLVMPositionBuilderAtEnd(ctx->builder, old_block);
     }
 }
 
-void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
-    if (!cmd || !builder) return;
+static void generate_function_definition(CodegenContext *ctx, Command *current) {
+    generate_function_body(ctx, current, declare_function(ctx, current));
+}
 
-    switch (cmd->type) {
-        case CMD_FUNC_DEF:
-            // Function definitions are handled separately
-            break;
+// Generate cmd into a module of its own. Every function generated before it
+// is declared there, so calls resolve as they do in the whole module.
+static LLVMModuleRef generate_function_module(CodegenContext *ctx, Command *cmd) {
+    LLVMModuleRef whole_module = ctx->module;
+
+    LLVMModuleRef module = LLVMModuleCreateWithNameInContext(cmd->data.func_def.name, ctx->context);
+    for (LLVMValueRef function = LLVMGetFirstFunction(whole_module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (function == ctx->main_function) continue;
+
+        size_t length;
+        const char *name = LLVMGetValueName2(function, &length);
+        LLVMAddFunction(module, name, LLVMGlobalGetValueType(function));
+    }
+
+    ctx->module = module;
+    generate_function_definition(ctx, cmd);
+    ctx->module = whole_module;
+
+    return module;
+}
+
+// Reuse the IR of a top-level function from an earlier build when neither
+// its AST nor anything it can see changed; otherwise generate and cache it.
+// state hashes the prototypes and symbols left behind by earlier functions.
+static void generate_function_incrementally(CodegenContext *ctx, Command *cmd, uint64_t *state) {
+    FunctionCache *cache = ctx->function_cache;
+    const char *name = cmd->data.func_def.name;
+    SymbolTable *symbol_table = cmd->data.func_def.body->symbol_table;
+
+    uint64_t key = hash_command(*state, cmd);
+    LLVMModuleRef module = NULL;
+
+    CachedFunction *entry = function_cache_lookup(cache, name, key);
+    if (entry && LLVMParseBitcodeInContext2(ctx->context, entry->bitcode, &module) == 0) {
+        function_cache_replay_symbols(entry, symbol_table);
+        entry->used = 1;
+        cache->reused++;
+    } else {
+        Symbol *previous_symbols = symbol_table->head;
+        module = generate_function_module(ctx, cmd);
+        entry = function_cache_store(cache, name, key, LLVMWriteBitcodeToMemoryBuffer(module),
+                                     symbol_table, previous_symbols);
+        cache->generated++;
+    }
+
+    if (LLVMLinkModules2(ctx->module, module)) {
+        fprintf(stderr, "Error: Could not link the code of function '%s'\n", name);
+        abort_compilation();
+    }
+
+    *state = hash_function_signature(*state, cmd);
+    *state = function_cache_hash_symbols(*state, entry);
+}
+
+static void generate_import(CodegenContext *ctx, Command *cmd) {
+    import_module(ctx, cmd->data.import_cmd.path);
+
+    // Cached functions may call into the module, so its interface is part of their key
+    ctx->function_cache_state = fnv1a_update_string(ctx->function_cache_state, cmd->data.import_cmd.path);
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        char *type = LLVMPrintTypeToString(LLVMGlobalGetValueType(function));
+        ctx->function_cache_state = fnv1a_update_string(ctx->function_cache_state, type);
+        LLVMDisposeMessage(type);
+    }
+}
+
+static void generate_top_level_function(CodegenContext *ctx, Command *cmd) {
+    // Profiles number branches across the whole module, so they need every
+    // function, debug info belongs to the compile unit of the module and
+    // bounds checks report the line numbers the cache key leaves out
+    if (ctx->function_cache && !ctx->profile && !ctx->debug && !ctx->options.bounds_check) {
+        generate_function_incrementally(ctx, cmd, &ctx->function_cache_state);
+    } else {
+        generate_function_definition(ctx, cmd);
+    }
+}
+
+static void generate_functions_in_parallel(CodegenContext *ctx, CommandList *list);
+
+void generate_function_definitions(CodegenContext *ctx, CommandList *list) {
+    if (!list) return;
+
+    CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_FUNCTIONS);
+
+    // Only top-level definitions are cached; nested ones belong to their parent
+    int top_level = ctx->current_function == ctx->main_function;
+
+    // Cached functions and profile counters are built up one function at a time
+    if (top_level && ctx->options.codegen_threads > 1 && !ctx->function_cache && !ctx->profile) {
+        generate_functions_in_parallel(ctx, list);
+        time_report_leave(ctx->time_report, previous_phase);
+        return;
+    }
+
+    Command *current = list->head;
+    while (current != NULL) {
+        if (current->type == CMD_FUNC_DEF) {
+            if (top_level) {
+                generate_top_level_function(ctx, current);
+            } else {
+                generate_function_definition(ctx, current);
+            }
+        } else if (current->type == CMD_IMPORT && top_level) {
+            // Functions after the import can call into the module
+            generate_import(ctx, current);
+        }
+        current = current->next;
+    }
+
+    time_report_leave(ctx->time_report, previous_phase);
+}
+
+static int list_calls_undefined_function(CodegenContext *ctx, CommandList *list);
+
+static int expression_calls_undefined_function(CodegenContext *ctx, Expression *expr) {
+    if (!expr) return 0;
+
+    switch (expr->type) {
+        case EXPR_BINARY_OP:
+            return expression_calls_undefined_function(ctx, expr->data.binary_op.left) ||
+                   expression_calls_undefined_function(ctx, expr->data.binary_op.right);
+        case EXPR_UNARY_OP:
+            return expression_calls_undefined_function(ctx, expr->data.unary_op.operand);
+        case EXPR_ARRAY_ACCESS:
+            for (ExpressionList *index = expr->data.array_access.indices; index != NULL; index = index->next) {
+                if (expression_calls_undefined_function(ctx, index->expr)) return 1;
+            }
+            return 0;
+        case EXPR_FUNC_CALL:
+            if (!LLVMGetNamedFunction(ctx->module, expr->data.func_call.func_name)) return 1;
+            for (ExpressionList *arg = expr->data.func_call.args; arg != NULL; arg = arg->next) {
+                if (expression_calls_undefined_function(ctx, arg->expr)) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+// Whether generating cmd now would fail on a function that is yet to come
+static int command_calls_undefined_function(CodegenContext *ctx, Command *cmd) {
+    switch (cmd->type) {
+        case CMD_ASSIGN:
+            for (ExpressionList *index = cmd->data.assign.indices; index != NULL; index = index->next) {
+                if (expression_calls_undefined_function(ctx, index->expr)) return 1;
+            }
+            return expression_calls_undefined_function(ctx, cmd->data.assign.value);
+        case CMD_WRITE:
+            return expression_calls_undefined_function(ctx, cmd->data.write.expr);
+        case CMD_WHILE:
+            return expression_calls_undefined_function(ctx, cmd->data.while_cmd.condition) ||
+                   list_calls_undefined_function(ctx, cmd->data.while_cmd.while_block);
+        case CMD_DO_WHILE:
+            return expression_calls_undefined_function(ctx, cmd->data.do_while_cmd.condition) ||
+                   list_calls_undefined_function(ctx, cmd->data.do_while_cmd.do_while_block);
+        case CMD_REPEAT_UNTIL:
+            return list_calls_undefined_function(ctx, cmd->data.repeat_until_cmd.repeat_until_block);
+        case CMD_IF:
+            return expression_calls_undefined_function(ctx, cmd->data.if_cmd.condition) ||
+                   list_calls_undefined_function(ctx, cmd->data.if_cmd.then_block);
+        case CMD_IF_ELSE:
+            return expression_calls_undefined_function(ctx, cmd->data.if_else_cmd.condition) ||
+                   list_calls_undefined_function(ctx, cmd->data.if_else_cmd.then_block) ||
+                   list_calls_undefined_function(ctx, cmd->data.if_else_cmd.else_block);
+        case CMD_EXPRESSION:
+            return expression_calls_undefined_function(ctx, cmd->data.expression.expr);
+        case CMD_RETURN:
+            return expression_calls_undefined_function(ctx, cmd->data.return_cmd.return_value);
+        default:
+            return 0;
+    }
+}
+
+static int list_calls_undefined_function(CodegenContext *ctx, CommandList *list) {
+    if (!list) return 0;
+
+    for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+        if (command_calls_undefined_function(ctx, cmd)) return 1;
+    }
+    return 0;
+}
+
+// Generate waiting statements in order, up to the first that still waits
+// (or all of them at the end of input). Each is freed once generated.
+static void generate_waiting_commands(CodegenContext *ctx, int end_of_input) {
+    CommandList *waiting = ctx->waiting_commands;
+    if (!waiting) return;
+
+    while (waiting->head &&
+           (end_of_input || !command_calls_undefined_function(ctx, waiting->head))) {
+        generate_code_for_command(ctx, waiting->head, ctx->symbol_table);
+        free_command(remove_first_command(waiting));
+    }
+}
+
+void generate_streamed_commands(CodegenContext *ctx, CommandList *list) {
+    while (list->head) {
+        Command *cmd = list->head;
+
+        if (cmd->type == CMD_FUNC_DEF) {
+            // Functions come before every statement of main, as in batch
+            // generation, so they must not see the top-level variables
+            // streamed so far
+            CompilePhase previous_phase = time_report_enter(ctx->time_report, PHASE_FUNCTIONS);
+            ValueMap *top_level_values = ctx->value_map;
+            ctx->value_map = NULL;
+            ctx->hide_globals = 1;
+            generate_top_level_function(ctx, cmd);
+            ctx->hide_globals = 0;
+            ctx->value_map = top_level_values;
+            time_report_leave(ctx->time_report, previous_phase);
+
+            free_command(remove_first_command(list));
+            generate_waiting_commands(ctx, 0);
+        } else if (cmd->type == CMD_IMPORT) {
+            generate_import(ctx, cmd);
+            free_command(remove_first_command(list));
+            generate_waiting_commands(ctx, 0);
+        } else if ((!ctx->waiting_commands || !ctx->waiting_commands->head) &&
+                   !command_calls_undefined_function(ctx, cmd)) {
+            generate_code_for_command(ctx, cmd, list->symbol_table);
+            free_command(remove_first_command(list));
+        } else {
+            // Statements of main keep their order behind the first that waits
+            if (!ctx->waiting_commands) {
+                ctx->waiting_commands = create_command_list(ctx->symbol_table);
+            }
+            add_command(ctx->waiting_commands, remove_first_command(list));
+        }
+    }
+}
+
+void finish_streamed_commands(CodegenContext *ctx) {
+    generate_waiting_commands(ctx, 1);
+}
+
+// Parallel code generation (--codegen-threads). Every top-level function is
+// declared and its symbols inserted in program order first, which leaves
+// the shared symbol table as generating them one by one would and lets each
+// function be generated on its own. Workers then generate their share into
+// a module in an LLVMContext of their own and simplify it; their modules
+// are linked into the program in worker order.
+
+#define CODEGEN_WORKER_PASSES "function(sroa,early-cse,simplifycfg,instcombine)"
+
+typedef struct CodegenWorker {
+    CodegenContext *parent;
+    Command **functions;
+    int function_count;
+    int first;   // Generates functions first, first + stride, ...
+    int stride;
+    LLVMMemoryBufferRef interface;  // Bitcode declaring every function of the program so far
+    LLVMMemoryBufferRef result;     // Bitcode of the generated functions
+    int failed;
+    pthread_t thread;
+} CodegenWorker;
+
+static void insert_list_symbols(CommandList *list);
+
+static void insert_command_symbols(Command *cmd, SymbolTable *symbol_table) {
+    switch (cmd->type) {
+        case CMD_DECLARE_VAR:
+            insert_symbol(symbol_table, cmd->data.declare_var.name, cmd->data.declare_var.data_type,
+                          cmd->line_number, cmd->data.declare_var.array_dims);
+            break;
+        case CMD_WHILE:
+            insert_list_symbols(cmd->data.while_cmd.while_block);
+            break;
+        case CMD_DO_WHILE:
+            insert_list_symbols(cmd->data.do_while_cmd.do_while_block);
+            break;
+        case CMD_REPEAT_UNTIL:
+            insert_list_symbols(cmd->data.repeat_until_cmd.repeat_until_block);
+            break;
+        case CMD_IF:
+            insert_list_symbols(cmd->data.if_cmd.then_block);
+            break;
+        case CMD_IF_ELSE:
+            insert_list_symbols(cmd->data.if_else_cmd.then_block);
+            insert_list_symbols(cmd->data.if_else_cmd.else_block);
+            break;
+        default:
+            break;
+    }
+}
+
+static void insert_list_symbols(CommandList *list) {
+    if (!list) return;
+
+    for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+        insert_command_symbols(cmd, list->symbol_table);
+    }
+}
+
+// Insert the symbols generating the function cmd inserts, in the same order
+static void insert_function_symbols(Command *cmd) {
+    SymbolTable *symbol_table = cmd->data.func_def.body->symbol_table;
+    for (Parameter *param = cmd->data.func_def.params; param != NULL; param = param->next) {
+        insert_symbol(symbol_table, param->name, param->type, 0, param->array_dims);
+    }
+    insert_list_symbols(cmd->data.func_def.body);
+}
+
+static void *run_codegen_worker(void *arg) {
+    CodegenWorker *worker = (CodegenWorker *)arg;
+    CodegenContext *parent = worker->parent;
+
+    // Share 0 runs on the thread that started the others
+    jmp_buf *outer_target = get_compilation_abort_target();
+    LLVMContextRef context = LLVMContextCreate();
+    CodegenContext *volatile ctx = NULL;
+    jmp_buf abort_target;
+
+    if (setjmp(abort_target) == 0) {
+        set_compilation_abort_target(&abort_target);
+
+        ctx = create_codegen_context(parent->output_filename, context, parent->symbol_table,
+                                     parent->function_table, &parent->options);
+        ctx->symbols_declared = 1;
+
+        LLVMModuleRef interface = NULL;
+        if (LLVMParseBitcodeInContext2(context, worker->interface, &interface)) {
+            fprintf(stderr, "Error: Could not declare functions for a code generation thread\n");
+            abort_compilation();
+        }
+
+        // Linking would drop the declarations nothing refers to yet
+        for (LLVMValueRef function = LLVMGetFirstFunction(interface); function != NULL;
+             function = LLVMGetNextFunction(function)) {
+            size_t length;
+            const char *name = LLVMGetValueName2(function, &length);
+            if (!LLVMGetNamedFunction(ctx->module, name)) {
+                LLVMAddFunction(ctx->module, name, LLVMGlobalGetValueType(function));
+            }
+        }
+        LLVMDisposeModule(interface);
+
+        for (int i = worker->first; i < worker->function_count; i += worker->stride) {
+            Command *cmd = worker->functions[i];
+            generate_function_body(ctx, cmd, LLVMGetNamedFunction(ctx->module, cmd->data.func_def.name));
+        }
+
+        // The statements of main are generated into the program's module
+        LLVMDeleteFunction(ctx->main_function);
+        ctx->main_function = NULL;
+        finish_debug_info(ctx);
+
+        if (ctx->options.optimization_level > 0) {
+            LLVMPassBuilderOptionsRef pass_options = LLVMCreatePassBuilderOptions();
+            LLVMErrorRef error = LLVMRunPasses(ctx->module, CODEGEN_WORKER_PASSES, NULL, pass_options);
+            LLVMDisposePassBuilderOptions(pass_options);
+            check_llvm_error(error, "simplify functions");
+        }
+
+        worker->result = LLVMWriteBitcodeToMemoryBuffer(ctx->module);
+    } else {
+        worker->failed = 1;
+    }
+    set_compilation_abort_target(outer_target);
+
+    dispose_code_generation(ctx);
+    LLVMContextDispose(context);
+    return NULL;
+}
+
+// Generate the declared functions on up to codegen_threads threads and link them in
+static void generate_queued_functions(CodegenContext *ctx, Command **functions, int count) {
+    if (count == 0) return;
+
+    // Workers declare what calls can refer to from this, as types belong to a context
+    LLVMModuleRef interface = LLVMModuleCreateWithNameInContext("interface", ctx->context);
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (function == ctx->main_function) continue;
+
+        size_t length;
+        const char *name = LLVMGetValueName2(function, &length);
+        LLVMAddFunction(interface, name, LLVMGlobalGetValueType(function));
+    }
+    LLVMMemoryBufferRef interface_bitcode = LLVMWriteBitcodeToMemoryBuffer(interface);
+    LLVMDisposeModule(interface);
+
+    int thread_count = ctx->options.codegen_threads < count ? ctx->options.codegen_threads : count;
+    CodegenWorker *workers = (CodegenWorker *)calloc(thread_count, sizeof(CodegenWorker));
+    if (!workers) {
+        LLVMDisposeMemoryBuffer(interface_bitcode);
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, COMPILE_THREAD_STACK_SIZE);
+
+    // Round robin spreads long and short functions over the threads
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].parent = ctx;
+        workers[i].functions = functions;
+        workers[i].function_count = count;
+        workers[i].first = i;
+        workers[i].stride = thread_count;
+        workers[i].interface = interface_bitcode;
+    }
+
+    int started = 0;
+    for (int i = 1; i < thread_count; i++) {
+        if (pthread_create(&workers[i].thread, &attr, run_codegen_worker, &workers[i]) != 0) {
+            LOG_WARN("Warning: Could only start %d code generation threads\n", started);
+            break;
+        }
+        started++;
+    }
+
+    // This thread takes the shares of the threads that could not be started
+    run_codegen_worker(&workers[0]);
+    for (int i = started + 1; i < thread_count; i++) {
+        run_codegen_worker(&workers[i]);
+    }
+    for (int i = 1; i <= started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_attr_destroy(&attr);
+    LLVMDisposeMemoryBuffer(interface_bitcode);
+
+    int failed = 0;
+    for (int i = 0; i < thread_count; i++) {
+        failed |= workers[i].failed;
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        LLVMModuleRef module = NULL;
+        LLVMMemoryBufferRef result = workers[i].result;
+        workers[i].result = NULL;
+
+        if (!failed) {
+            if (LLVMParseBitcodeInContext2(ctx->context, result, &module) != 0) {
+                fprintf(stderr, "Error: Could not read the functions of code generation thread %d\n", i);
+                failed = 1;
+            } else if (LLVMLinkModules2(ctx->module, module) != 0) {
+                fprintf(stderr, "Error: Could not link the functions of code generation thread %d\n", i);
+                failed = 1;
+            }
+        }
+        if (result) LLVMDisposeMemoryBuffer(result);
+    }
+    free(workers);
+
+    // Each error was reported on the thread that found it
+    if (failed) abort_compilation();
+}
+
+static void generate_functions_in_parallel(CodegenContext *ctx, CommandList *list) {
+    Command **functions = NULL;
+    int count = 0;
+    int capacity = 0;
+
+    for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+        if (cmd->type == CMD_IMPORT) {
+            generate_import(ctx, cmd);
+            continue;
+        }
+        if (cmd->type != CMD_FUNC_DEF) continue;
+
+        // Calls can only refer to functions declared so far, as when generating in order
+        LLVMValueRef function = NULL;
+        if (!LLVMGetNamedFunction(ctx->module, cmd->data.func_def.name)) {
+            function = declare_function(ctx, cmd);
+            if (list_calls_undefined_function(ctx, cmd->data.func_def.body)) {
+                LLVMDeleteFunction(function);
+                function = NULL;
+            }
+        }
+
+        if (!function) {
+            // Generating it on its own reports the error, after those of the functions before it
+            generate_queued_functions(ctx, functions, count);
+            count = 0;
+            generate_function_definition(ctx, cmd);
+            continue;
+        }
+
+        insert_function_symbols(cmd);
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            functions = (Command **)realloc(functions, capacity * sizeof(Command *));
+            if (!functions) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                abort_compilation();
+            }
+        }
+        functions[count++] = cmd;
+    }
+
+    generate_queued_functions(ctx, functions, count);
+    free(functions);
+}
+
+void generate_code_for_command(CodegenContext *ctx, Command *cmd, SymbolTable *symbol_table) {
+    if (!cmd || !ctx->builder) return;
+
+    debug_set_line(ctx, cmd->line_number);
+    ctx->line = cmd->line_number;
+
+    switch (cmd->type) {
+        case CMD_FUNC_DEF:
+        case CMD_IMPORT:
+            // Function definitions and imports are handled separately
+            break;
 
         case CMD_RETURN: {
             if (cmd->data.return_cmd.return_value) {
-                LLVMValueRef return_val = generate_expression_code(cmd->data.return_cmd.return_value, symbol_table);
+                LLVMValueRef return_val = generate_expression_code(ctx, cmd->data.return_cmd.return_value, symbol_table);
                 if (return_val) {
-                    LLVMBuildRet(builder, return_val);
+                    LLVMBuildRet(ctx->builder, return_val);
                 }
             } else {
-                LLVMBuildRetVoid(builder);
+                LLVMBuildRetVoid(ctx->builder);
             }
             break;
         }
@@ -892,65 +2187,68 @@ void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
             DataType type = cmd->data.declare_var.data_type;
 
             if (cmd->data.declare_var.array_dims != NULL) {
-                insert_symbol(symbol_table, name, type, cmd->line_number, cmd->data.declare_var.array_dims);
+                declare_symbol(ctx, symbol_table, name, type, cmd->line_number, cmd->data.declare_var.array_dims);
                 Symbol *symbol = lookup_symbol(symbol_table, name);
-                LLVMTypeRef array_type = get_array_type(symbol);
+                LLVMTypeRef array_type = get_array_type(ctx, symbol);
 
-                if (current_function != main_function) {
-                    LLVMValueRef alloca = LLVMBuildAlloca(builder, array_type, name);
+                if (ctx->current_function != ctx->main_function) {
+                    LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, array_type, name);
                     LLVMSetAlignment(alloca, 4);
-                    add_to_value_map(name, alloca);
+                    add_to_value_map(ctx, name, alloca);
                 } else {
-                    LLVMValueRef global = LLVMAddGlobal(module, array_type, name);
+                    LLVMValueRef global = LLVMAddGlobal(ctx->module, array_type, name);
                     LLVMSetInitializer(global, LLVMConstNull(array_type));
                     LLVMSetLinkage(global, LLVMCommonLinkage);
                     LLVMSetAlignment(global, 4);
-                    add_to_value_map(name, global);
+                    add_to_value_map(ctx, name, global);
                 }
             } else if (type == TYPE_STRING) {
-                LLVMValueRef string_var = create_string_variable(name, 256);
-                insert_symbol(symbol_table, name, type, cmd->line_number, NULL);
-                add_to_value_map(name, string_var);
+                LLVMValueRef string_var = create_string_variable(ctx, name, 256);
+                declare_symbol(ctx, symbol_table, name, type, cmd->line_number, NULL);
+                add_to_value_map(ctx, name, string_var);
             } else {
-                LLVMTypeRef llvm_type = get_llvm_type(type);
+                LLVMTypeRef llvm_type = get_llvm_type(ctx, type);
 
-                if (current_function != main_function) {
-                    LLVMValueRef alloca = LLVMBuildAlloca(builder, llvm_type, name);
+                if (ctx->current_function != ctx->main_function) {
+                    LLVMValueRef alloca = LLVMBuildAlloca(ctx->builder, llvm_type, name);
                     LLVMSetAlignment(alloca, 4);
 
                     if (type == TYPE_FLOAT) {
-                        LLVMBuildStore(builder, LLVMConstReal(llvm_type, 0.0), alloca);
+                        LLVMBuildStore(ctx->builder, LLVMConstReal(llvm_type, 0.0), alloca);
                     } else {
-                        LLVMBuildStore(builder, LLVMConstInt(llvm_type, 0, 0), alloca);
+                        LLVMBuildStore(ctx->builder, LLVMConstInt(llvm_type, 0, 0), alloca);
                     }
 
-                    insert_symbol(symbol_table, name, type, cmd->line_number, NULL);
-                    add_to_value_map(name, alloca);
+                    declare_symbol(ctx, symbol_table, name, type, cmd->line_number, NULL);
+                    add_to_value_map(ctx, name, alloca);
                 } else {
-                    LLVMValueRef global = create_global_variable(name, type);
-                    insert_symbol(symbol_table, name, type, cmd->line_number, NULL);
-                    add_to_value_map(name, global);
+                    LLVMValueRef global = create_global_variable(ctx, name, type);
+                    declare_symbol(ctx, symbol_table, name, type, cmd->line_number, NULL);
+                    add_to_value_map(ctx, name, global);
                 }
             }
+            debug_declare_variable(ctx, name, type, cmd->data.declare_var.array_dims,
+                                   get_value(ctx, name), cmd->line_number);
+            bounds_assign(ctx, name, lookup_symbol(symbol_table, name), NULL);
             break;
         }
 
         case CMD_ASSIGN: {
             const char *name = cmd->data.assign.name;
-            LLVMValueRef var = get_value(name);
+            LLVMValueRef var = get_value(ctx, name);
             if (!var) {
                 fprintf(stderr, "Error: Variable '%s' not found for assignment\n", name);
-                exit(1);
+                abort_compilation();
                 break;
             }
 
-            LLVMValueRef value = generate_expression_code(cmd->data.assign.value, symbol_table);
+            LLVMValueRef value = generate_expression_code(ctx, cmd->data.assign.value, symbol_table);
             if (!value) break;
 
             Symbol *symbol = lookup_symbol(symbol_table, name);
             if (!symbol) {
                 fprintf(stderr, "Error: Variable '%s' not found in symbol table for assignment\n", name);
-                exit(1);
+                abort_compilation();
                 break;
             }
 
@@ -958,7 +2256,7 @@ void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
                 // Array element assignment
                 if (!symbol->is_array) {
                     fprintf(stderr, "Error: '%s' is not an array\n", name);
-                    exit(1);
+                    abort_compilation();
                     break;
                 }
 
@@ -970,58 +2268,57 @@ void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
                 }
 
                 LLVMValueRef *indices = (LLVMValueRef*)malloc((index_count + 1) * sizeof(LLVMValueRef));
-                indices[0] = LLVMConstInt(LLVMInt32Type(), 0, 0);
+                indices[0] = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0);
 
                 idx = cmd->data.assign.indices;
                 for (int i = 0; i < index_count; i++) {
-                    indices[i + 1] = generate_expression_code(idx->expr, symbol_table);
+                    indices[i + 1] = generate_expression_code(ctx, idx->expr, symbol_table);
+                    build_bounds_check(ctx, symbol, i, idx->expr, indices[i + 1]);
                     idx = idx->next;
                 }
 
-                LLVMTypeRef array_type = get_array_type(symbol);
-                LLVMValueRef gep = LLVMBuildGEP2(builder, array_type, var,
+                LLVMTypeRef array_type = get_array_type(ctx, symbol);
+                LLVMValueRef gep = LLVMBuildGEP2(ctx->builder, array_type, var,
                                                  indices, index_count + 1, "arrayidx");
 
                 // Handle type conversion if needed
-                DataType expr_type = get_expression_type(cmd->data.assign.value, symbol_table);
+                DataType expr_type = get_expression_type(ctx, cmd->data.assign.value, symbol_table);
                 if (symbol->type != expr_type) {
                     if (symbol->type == TYPE_FLOAT && expr_type == TYPE_INT) {
-                        value = LLVMBuildSIToFP(builder, value, LLVMFloatType(), "int2float");
+                        value = LLVMBuildSIToFP(ctx->builder, value, LLVMFloatTypeInContext(ctx->context), "int2float");
                     } else if (symbol->type == TYPE_INT && expr_type == TYPE_FLOAT) {
-                        value = LLVMBuildFPToSI(builder, value, LLVMInt32Type(), "float2int");
+                        value = LLVMBuildFPToSI(ctx->builder, value, LLVMInt32TypeInContext(ctx->context), "float2int");
                     }
                 }
 
-                LLVMBuildStore(builder, value, gep);
+                LLVMBuildStore(ctx->builder, value, gep);
                 free(indices);
             } else if (symbol->type == TYPE_STRING) {
-                LLVMValueRef value = generate_expression_code(cmd->data.assign.value, symbol_table);
+                LLVMValueRef value = generate_expression_code(ctx, cmd->data.assign.value, symbol_table);
                 if (!value) break;
 
-                LLVMValueRef strcpy_func = get_strcpy_function();
-                LLVMTypeRef strcpy_type = LLVMGlobalGetValueType(strcpy_func);
-
-                LLVMTypeRef string_type = LLVMArrayType(LLVMInt8Type(), 256);
+                LLVMTypeRef string_type = LLVMArrayType(LLVMInt8TypeInContext(ctx->context), 256);
                 LLVMValueRef indices[] = {
-                    LLVMConstInt(LLVMInt32Type(), 0, 0),
-                    LLVMConstInt(LLVMInt32Type(), 0, 0)
+                    LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0),
+                    LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0)
                 };
-                LLVMValueRef dest_ptr = LLVMBuildGEP2(builder, string_type, var, indices, 2, "dest_ptr");
+                LLVMValueRef dest_ptr = LLVMBuildGEP2(ctx->builder, string_type, var, indices, 2, "dest_ptr");
 
                 LLVMValueRef args[] = { dest_ptr, value };
-                LLVMBuildCall2(builder, strcpy_type, strcpy_func, args, 2, "strcpy_call");
+                build_runtime_call(ctx, RUNTIME_STRING_COPY, args);
             }
             else {
-                DataType expr_type = get_expression_type(cmd->data.assign.value, symbol_table);
+                DataType expr_type = get_expression_type(ctx, cmd->data.assign.value, symbol_table);
                 if (symbol->type != expr_type) {
                     if (symbol->type == TYPE_FLOAT && expr_type == TYPE_INT) {
-                        value = LLVMBuildSIToFP(builder, value, LLVMFloatType(), "int2float");
+                        value = LLVMBuildSIToFP(ctx->builder, value, LLVMFloatTypeInContext(ctx->context), "int2float");
                     } else if (symbol->type == TYPE_INT && expr_type == TYPE_FLOAT) {
-                        value = LLVMBuildFPToSI(builder, value, LLVMInt32Type(), "float2int");
+                        value = LLVMBuildFPToSI(ctx->builder, value, LLVMInt32TypeInContext(ctx->context), "float2int");
                     }
                 }
 
-                LLVMBuildStore(builder, value, var);
+                LLVMBuildStore(ctx->builder, value, var);
+                bounds_assign(ctx, name, symbol, cmd->data.assign.value);
             }
             break;
         }
@@ -1030,332 +2327,71 @@ void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
             const char *var_name = cmd->data.read.var_name;
             if (!var_name) {
                 fprintf(stderr, "Error: NULL variable name in READ command\n");
-                exit(1);
+                abort_compilation();
                 break;
             }
 
-            LLVMValueRef var = get_value(var_name);
+            LLVMValueRef var = get_value(ctx, var_name);
             if (!var) {
                 fprintf(stderr, "Error: Variable '%s' not found for READ command\n", var_name);
-                exit(1);
-                break;
-            }
-
-            LLVMValueRef printf_func = get_printf_function();
-            if (!printf_func) {
-                fprintf(stderr, "Error: Failed to get printf function\n");
-                exit(1);
+                abort_compilation();
                 break;
             }
 
-            LLVMTypeRef printf_func_type = LLVMTypeOf(printf_func);
-            if (!printf_func_type || LLVMGetTypeKind(printf_func_type) != LLVMPointerTypeKind) {
-                fprintf(stderr, "Error: Invalid printf function type\n");
-                exit(1);
-                break;
-            }
-
-            LLVMTypeRef printf_type = LLVMGetElementType(printf_func_type);
-            if (!printf_type || LLVMGetTypeKind(printf_type) != LLVMFunctionTypeKind) {
-                LLVMTypeRef param_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-                printf_type = LLVMFunctionType(LLVMInt32Type(), param_types, 1, 1);
-            }
-
             Symbol *symbol = lookup_symbol(symbol_table, var_name);
             if (!symbol) {
                 fprintf(stderr, "Error: Variable '%s' not found in symbol table\n", var_name);
-                exit(1);
-                break;
-            }
-
-            char prompt[100];
-            snprintf(prompt, sizeof(prompt), "Enter value for %s: ", var_name);
-            LLVMValueRef prompt_str = LLVMBuildGlobalStringPtr(builder, prompt, "prompt");
-            if (!prompt_str) {
-                fprintf(stderr, "Error: Failed to create prompt string\n");
-                exit(1);
-                break;
-            }
-
-            LLVMValueRef prompt_args[] = { prompt_str };
-            LLVMValueRef prompt_call = LLVMBuildCall2(builder, printf_type, printf_func, prompt_args, 1, "prompt_call");
-
-            if (!prompt_call) {
-                fprintf(stderr, "Error: Failed to build prompt printf call\n");
-                exit(1);
-            }
-
-            LLVMValueRef scanf_func = get_scanf_function();
-            if (!scanf_func) {
-                fprintf(stderr, "Error: Failed to get scanf function\n");
-                exit(1);
+                abort_compilation();
                 break;
             }
 
-            LLVMTypeRef scanf_func_type = LLVMTypeOf(scanf_func);
-            if (!scanf_func_type || LLVMGetTypeKind(scanf_func_type) != LLVMPointerTypeKind) {
-                fprintf(stderr, "Error: Invalid scanf function type\n");
-                exit(1);
-                break;
-            }
+            LLVMValueRef prompt_args[] = { LLVMBuildGlobalStringPtr(ctx->builder, var_name, "var_name") };
+            build_runtime_call(ctx, RUNTIME_PROMPT, prompt_args);
 
-            LLVMTypeRef scanf_type = LLVMGetElementType(scanf_func_type);
-            if (!scanf_type || LLVMGetTypeKind(scanf_type) != LLVMFunctionTypeKind) {
-                LLVMTypeRef param_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-                scanf_type = LLVMFunctionType(LLVMInt32Type(), param_types, 1, 1);
-            }
+            bounds_assign(ctx, var_name, symbol, NULL);
 
-            const char *format;
+            LLVMValueRef read_args[] = { var };
             switch (symbol->type) {
-                case TYPE_INT:
-                    format = "%d";
-                    break;
                 case TYPE_FLOAT:
-                    format = "%f";
+                    build_runtime_call(ctx, RUNTIME_READ_FLOAT, read_args);
                     break;
                 case TYPE_CHAR:
-                    format = " %c";
-                    break;
-                case TYPE_BOOL:
-                    format = "%9s";
+                    build_runtime_call(ctx, RUNTIME_READ_CHAR, read_args);
                     break;
                 case TYPE_STRING:
-                    format = "%255s";
-                    break;
-                default:
-                    format = "%d";
-                    break;
-            }
-
-            LLVMValueRef format_str = LLVMBuildGlobalStringPtr(builder, format, "scanf_format");
-            if (!format_str) {
-                fprintf(stderr, "Error: Failed to create scanf format string\n");
-                exit(1);
-                break;
-            }
-
-            if (symbol->type == TYPE_BOOL) {
-                LLVMValueRef temp_buf = LLVMBuildAlloca(builder, LLVMArrayType(LLVMInt8Type(), 10), "temp_buf");
-                if (!temp_buf) {
-                    fprintf(stderr, "Error: Failed to allocate temporary buffer\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef scanf_args[] = { format_str, temp_buf };
-                LLVMValueRef scanf_call = LLVMBuildCall2(builder, scanf_type, scanf_func, scanf_args, 2, "scanf_call");
-
-                if (!scanf_call) {
-                    fprintf(stderr, "Error: Failed to build scanf call\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef strcmp_func = LLVMGetNamedFunction(module, "strcmp");
-                if (!strcmp_func) {
-                    LLVMTypeRef str_ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
-                    LLVMTypeRef param_types[] = {str_ptr_type, str_ptr_type};
-                    LLVMTypeRef strcmp_type = LLVMFunctionType(LLVMInt32Type(), param_types, 2, 0);
-                    strcmp_func = LLVMAddFunction(module, "strcmp", strcmp_type);
-
-                    if (!strcmp_func) {
-                        fprintf(stderr, "Error: Failed to create strcmp function\n");
-                        exit(1);
-                        break;
-                    }
-                }
-
-                LLVMTypeRef strcmp_func_type = LLVMTypeOf(strcmp_func);
-                if (!strcmp_func_type || LLVMGetTypeKind(strcmp_func_type) != LLVMPointerTypeKind) {
-                    fprintf(stderr, "Error: Invalid strcmp function type\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMTypeRef strcmp_type = LLVMGetElementType(strcmp_func_type);
-                if (!strcmp_type || LLVMGetTypeKind(strcmp_type) != LLVMFunctionTypeKind) {
-                    fprintf(stderr, "Error: Failed to get valid strcmp function type\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef true_str = LLVMBuildGlobalStringPtr(builder, "true", "true_str");
-                if (!true_str) {
-                    fprintf(stderr, "Error: Failed to create 'true' string\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef one_str = LLVMBuildGlobalStringPtr(builder, "1", "one_str");
-                if (!one_str) {
-                    fprintf(stderr, "Error: Failed to create '1' string\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef cmp_args1[] = {temp_buf, true_str};
-                LLVMValueRef cmp1 = LLVMBuildCall2(builder, strcmp_type, strcmp_func, cmp_args1, 2, "cmp1");
-
-                if (!cmp1) {
-                    fprintf(stderr, "Error: Failed to build first strcmp call\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef is_true = LLVMBuildICmp(builder, LLVMIntEQ, cmp1,
-                                        LLVMConstInt(LLVMInt32Type(), 0, 0), "is_true");
-
-                if (!is_true) {
-                    fprintf(stderr, "Error: Failed to build first comparison\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef cmp_args2[] = {temp_buf, one_str};
-                LLVMValueRef cmp2 = LLVMBuildCall2(builder, strcmp_type, strcmp_func, cmp_args2, 2, "cmp2");
-
-                if (!cmp2) {
-                    fprintf(stderr, "Error: Failed to build second strcmp call\n");
-                    exit(1);
+                    build_runtime_call(ctx, RUNTIME_READ_STRING, read_args);
                     break;
-                }
-
-                LLVMValueRef is_one = LLVMBuildICmp(builder, LLVMIntEQ, cmp2,
-                                    LLVMConstInt(LLVMInt32Type(), 0, 0), "is_one");
-
-                if (!is_one) {
-                    fprintf(stderr, "Error: Failed to build second comparison\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef result = LLVMBuildOr(builder, is_true, is_one, "bool_result");
-
-                if (!result) {
-                    fprintf(stderr, "Error: Failed to build OR operation\n");
-                    exit(1);
+                case TYPE_BOOL: {
+                    LLVMValueRef word_is_true = build_runtime_call(ctx, RUNTIME_READ_BOOL, NULL);
+                    LLVMValueRef result = LLVMBuildICmp(ctx->builder, LLVMIntNE, word_is_true,
+                                                        LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0), "bool_result");
+                    LLVMBuildStore(ctx->builder, result, var);
                     break;
                 }
-
-                LLVMValueRef store_result = LLVMBuildStore(builder, result, var);
-
-                if (!store_result) {
-                    fprintf(stderr, "Error: Failed to store boolean result\n");
-                    exit(1);
+                default:
+                    build_runtime_call(ctx, RUNTIME_READ_INT, read_args);
                     break;
-                }
-            }
-            else {
-                if (LLVMIsAGlobalVariable(var)) {
-                    LLVMValueRef scanf_args[] = { format_str, var };
-                    LLVMValueRef scanf_call = LLVMBuildCall2(builder, scanf_type, scanf_func, scanf_args, 2, "scanf_call");
-
-                    if (!scanf_call) {
-                        fprintf(stderr, "Error: Failed to build scanf call for global variable\n");
-                        exit(1);
-                        break;
-                    }
-                }
-                else {
-                    LLVMValueRef scanf_args[] = { format_str, var };
-                    LLVMValueRef scanf_call = LLVMBuildCall2(builder, scanf_type, scanf_func, scanf_args, 2, "scanf_call");
-
-                    if (!scanf_call) {
-                        fprintf(stderr, "Error: Failed to build scanf call for local variable\n");
-                        exit(1);
-                        break;
-                    }
-                }
             }
             break;
         }
 
         case CMD_WRITE: {
-            LLVMValueRef printf_func = get_printf_function();
-            if (!printf_func) {
-                fprintf(stderr, "Error: Failed to get printf function\n");
-                exit(1);
-                break;
-            }
-
-            LLVMTypeRef func_type = LLVMTypeOf(printf_func);
-            if (!func_type || LLVMGetTypeKind(func_type) != LLVMPointerTypeKind) {
-                fprintf(stderr, "Error: Invalid printf function type\n");
-                exit(1);
-                break;
-            }
-
-            LLVMTypeRef printf_type = LLVMGetElementType(func_type);
-            if (!printf_type || LLVMGetTypeKind(printf_type) != LLVMFunctionTypeKind) {
-                LLVMTypeRef param_types[] = { LLVMPointerType(LLVMInt8Type(), 0) };
-                printf_type = LLVMFunctionType(LLVMInt32Type(), param_types, 1, 1);
-            }
-
             if (cmd->data.write.string_literal) {
-                char format[256];
-
-                if (cmd->data.write.newline) {
-                    snprintf(format, sizeof(format), "%s\n", cmd->data.write.string_literal);
-                } else {
-                    snprintf(format, sizeof(format), "%s", cmd->data.write.string_literal);
-                }
-
-                LLVMValueRef format_str = LLVMBuildGlobalStringPtr(builder, format, "str_literal");
-                if (!format_str) {
-                    fprintf(stderr, "Error: Failed to create string literal\n");
-                    exit(1);
-                    break;
-                }
-
-                LLVMValueRef args[] = { format_str };
-
-                LLVMValueRef call_result = LLVMBuildCall2(builder, printf_type, printf_func, args, 1, "printf_call");
-
-                if (!call_result) {
-                    fprintf(stderr, "Error: String literal printf call failed\n");
-                    exit(1);
-                }
+                LLVMValueRef args[] = { LLVMBuildGlobalStringPtr(ctx->builder, cmd->data.write.string_literal, "str_literal") };
+                build_runtime_call(ctx, RUNTIME_WRITE_STRING, args);
             }
             else if (cmd->data.write.expr) {
-                DataType expr_type = get_expression_type(cmd->data.write.expr, symbol_table);
-                printf("Expression type: %d\n", expr_type);
-                const char *format;
-                switch (expr_type) {
-                    case TYPE_INT:
-                        format = cmd->data.write.newline ? "%d\n" : "%d";
-                        break;
-                    case TYPE_FLOAT:
-                        format = cmd->data.write.newline ? "%f\n" : "%f";
-                        break;
-                    case TYPE_CHAR:
-                        format = cmd->data.write.newline ? "%c\n" : "%c";
-                        break;
-                    case TYPE_STRING:
-                        format = cmd->data.write.newline ? "%s\n" : "%s";
-                        break;
-                    case TYPE_BOOL:
-                        format = cmd->data.write.newline ? "%s\n" : "%s";
-                        break;
-                    default:
-                        format = cmd->data.write.newline ? "%d\n" : "%d";
-                        break;
-                }
-
-                LLVMValueRef format_str = LLVMBuildGlobalStringPtr(builder, format, "format");
-                if (!format_str) {
-                    fprintf(stderr, "Error: Failed to create format string\n");
-                    exit(1);
-                    break;
-                }
+                DataType expr_type = get_expression_type(ctx, cmd->data.write.expr, symbol_table);
+                LOG_DEBUG("Expression type: %d\n", expr_type);
 
                 LLVMValueRef value = NULL;
                 if (cmd->data.write.expr->type == EXPR_VAR) {
                     const char *var_name = cmd->data.write.expr->data.var_name;
 
-                    LLVMValueRef var_alloca = get_value(var_name);
+                    LLVMValueRef var_alloca = get_value(ctx, var_name);
                     if (!var_alloca) {
                         fprintf(stderr, "Error: Variable '%s' not found\n", var_name);
-                        exit(1);
+                        abort_compilation();
                         break;
                     }
 
@@ -1379,302 +2415,285 @@ void generate_code_for_command(Command *cmd, SymbolTable *symbol_table) {
 
                     if (!var_type) {
                         fprintf(stderr, "Warning: Using fallback type for variable '%s'\n", var_name);
-                        exit(1);
+                        abort_compilation();
                         switch (expr_type) {
-                            case TYPE_INT:   var_type = LLVMInt32Type(); break;
-                            case TYPE_FLOAT: var_type = LLVMFloatType(); break;
-                            case TYPE_CHAR:  var_type = LLVMInt8Type(); break;
-                            case TYPE_BOOL:  var_type = LLVMInt1Type(); break;
-                            default:         var_type = LLVMInt32Type(); break;
+                            case TYPE_INT:   var_type = LLVMInt32TypeInContext(ctx->context); break;
+                            case TYPE_FLOAT: var_type = LLVMFloatTypeInContext(ctx->context); break;
+                            case TYPE_CHAR:  var_type = LLVMInt8TypeInContext(ctx->context); break;
+                            case TYPE_BOOL:  var_type = LLVMInt1TypeInContext(ctx->context); break;
+                            default:         var_type = LLVMInt32TypeInContext(ctx->context); break;
                         }
                     }
 
                     if (expr_type == TYPE_STRING) {
-                        LLVMTypeRef string_type = LLVMArrayType(LLVMInt8Type(), 256);
+                        LLVMTypeRef string_type = LLVMArrayType(LLVMInt8TypeInContext(ctx->context), 256);
                         LLVMValueRef indices[] = {
-                            LLVMConstInt(LLVMInt32Type(), 0, 0),
-                            LLVMConstInt(LLVMInt32Type(), 0, 0)
+                            LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0),
+                            LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0)
                         };
-                        value = LLVMBuildGEP2(builder, string_type, var_alloca, indices, 2, "str_ptr");
+                        value = LLVMBuildGEP2(ctx->builder, string_type, var_alloca, indices, 2, "str_ptr");
                     } else {
-                        value = LLVMBuildLoad2(builder, var_type, var_alloca, "load_for_print");
+                        value = LLVMBuildLoad2(ctx->builder, var_type, var_alloca, "load_for_print");
                     }
                 }
                 else {
-                    value = generate_expression_code(cmd->data.write.expr, symbol_table);
+                    value = generate_expression_code(ctx, cmd->data.write.expr, symbol_table);
                 }
 
                 if (!value) {
                     fprintf(stderr, "Error: Failed to generate expression value\n");
-                    exit(1);
+                    abort_compilation();
                     break;
                 }
 
-                if (expr_type == TYPE_BOOL) {
-                    LLVMValueRef true_str = LLVMBuildGlobalStringPtr(builder, "true", "true_str");
-                    LLVMValueRef false_str = LLVMBuildGlobalStringPtr(builder, "false", "false_str");
+                if (expr_type == TYPE_BOOL &&
+                    (LLVMGetTypeKind(LLVMTypeOf(value)) != LLVMIntegerTypeKind ||
+                     LLVMGetIntTypeWidth(LLVMTypeOf(value)) != 1)) {
+                    value = LLVMBuildICmp(ctx->builder, LLVMIntNE, value,
+                        LLVMConstInt(LLVMTypeOf(value), 0, 0), "to_bool");
+                }
 
-                    if (!true_str || !false_str) {
-                        fprintf(stderr, "Error: Failed to create boolean strings\n");
-                        exit(1);
+                LLVMValueRef args[] = { value };
+                switch (expr_type) {
+                    case TYPE_FLOAT:
+                        build_runtime_call(ctx, RUNTIME_WRITE_FLOAT, args);
                         break;
-                    }
-
-                    if (LLVMGetTypeKind(LLVMTypeOf(value)) != LLVMIntegerTypeKind ||
-                        LLVMGetIntTypeWidth(LLVMTypeOf(value)) != 1) {
-                        value = LLVMBuildICmp(builder, LLVMIntNE, value,
-                            LLVMConstInt(LLVMTypeOf(value), 0, 0), "to_bool");
-                    }
-
-                    LLVMValueRef str_ptr = LLVMBuildSelect(builder, value, true_str, false_str, "bool_str");
-
-                    if (!str_ptr) {
-                        fprintf(stderr, "Error: Failed to build select for boolean\n");
-                        exit(1);
+                    case TYPE_CHAR:
+                        build_runtime_call(ctx, RUNTIME_WRITE_CHAR, args);
                         break;
-                    }
-
-                    LLVMValueRef args[] = { format_str, str_ptr };
-
-                    LLVMValueRef call_result = LLVMBuildCall2(builder, printf_type, printf_func, args, 2, "printf_call");
-
-                    if (!call_result) {
-                        fprintf(stderr, "Error: Boolean printf call failed\n");
-                        exit(1);
-                    }
-                }
-                else {
-                    LLVMTypeRef value_type = LLVMTypeOf(value);
-
-                    if (!value_type) {
-                        fprintf(stderr, "Error: Couldn't get type of value\n");
-                        exit(1);
+                    case TYPE_STRING:
+                        build_runtime_call(ctx, RUNTIME_WRITE_STRING, args);
+                        break;
+                    case TYPE_BOOL:
+                        build_runtime_call(ctx, RUNTIME_WRITE_BOOL, args);
+                        break;
+                    default:
+                        build_runtime_call(ctx, RUNTIME_WRITE_INT, args);
                         break;
-                    }
-
-                    if (LLVMGetTypeKind(value_type) == LLVMIntegerTypeKind) {
-                        if (LLVMGetIntTypeWidth(value_type) < 32) {
-                            value = LLVMBuildZExt(builder, value, LLVMInt32Type(), "int_ext");
-                        }
-                    }
-                    else if (LLVMGetTypeKind(value_type) == LLVMFloatTypeKind) {
-                        value = LLVMBuildFPExt(builder, value, LLVMDoubleType(), "float_to_double");
-                    }
-
-                    LLVMValueRef args[] = { format_str, value };
-
-                    LLVMValueRef call_result = LLVMBuildCall2(builder, printf_type, printf_func, args, 2, "printf_call");
-
-                    if (!call_result) {
-                        fprintf(stderr, "Error: Normal value printf call failed\n");
-                        exit(1);
-                    }
                 }
             }
-            else if (cmd->data.write.newline) {
-                LLVMValueRef newline_str = LLVMBuildGlobalStringPtr(builder, "\n", "newline");
-
-                if (!newline_str) {
-                    fprintf(stderr, "Error: Failed to create newline string\n");
-                    exit(1);
-                    break;
-                }
 
-                LLVMValueRef args[] = { newline_str };
-
-                LLVMValueRef call_result = LLVMBuildCall2(builder, printf_type, printf_func, args, 1, "printf_call");
-
-                if (!call_result) {
-                    fprintf(stderr, "Error: Newline printf call failed\n");
-                    exit(1);
-                }
+            if (cmd->data.write.newline) {
+                build_runtime_call(ctx, RUNTIME_WRITE_NEWLINE, NULL);
             }
             break;
         }
 
         case CMD_WHILE: {
-            if_counter++;
+            ctx->if_counter++;
             char cond_block_name[20];
-            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", if_counter);
-            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlock(current_function, cond_block_name);
+            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", ctx->if_counter);
+            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, cond_block_name);
 
             char while_block_name[20];
-            snprintf(while_block_name, sizeof(while_block_name), "while_%d", if_counter);
-            LLVMBasicBlockRef while_block = LLVMAppendBasicBlock(current_function, while_block_name);
+            snprintf(while_block_name, sizeof(while_block_name), "while_%d", ctx->if_counter);
+            LLVMBasicBlockRef while_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, while_block_name);
 
             char continue_block_name[20];
-            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", if_counter);
-            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlock(current_function, continue_block_name);
+            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", ctx->if_counter);
+            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, continue_block_name);
 
-            LLVMBuildBr(builder, cond_block);
+            LLVMBuildBr(ctx->builder, cond_block);
 
-            LLVMPositionBuilderAtEnd(builder, cond_block);
-            LLVMValueRef condition = generate_expression_code(cmd->data.while_cmd.condition, symbol_table);
+            IndexRange *before_loop = bounds_enter_loop(ctx, cmd);
+            LLVMPositionBuilderAtEnd(ctx->builder, cond_block);
+            LLVMValueRef condition = generate_expression_code(ctx, cmd->data.while_cmd.condition, symbol_table);
             if (!condition) break;
-            LLVMBuildCondBr(builder, condition, while_block, continue_block);
-
-            LLVMPositionBuilderAtEnd(builder, while_block);
-            generate_code_for_command_list(cmd->data.while_cmd.while_block);
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, cond_block);
+            build_profiled_cond_br(ctx, condition, while_block, continue_block);
+
+            int float_operations = ctx->float_operations;
+            int loops_built = ctx->loops_built;
+            LLVMPositionBuilderAtEnd(ctx->builder, while_block);
+            bounds_begin_loop_body(ctx, cmd, symbol_table);
+            generate_code_for_command_list(ctx, cmd->data.while_cmd.while_block);
+            LLVMValueRef back_edge = NULL;
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                back_edge = LLVMBuildBr(ctx->builder, cond_block);
             }
+            hint_float_loop(ctx, back_edge, float_operations, loops_built);
+            bounds_leave(ctx, cmd, before_loop);
 
-            LLVMPositionBuilderAtEnd(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, continue_block);
             break;
         }
 
         case CMD_DO_WHILE: {
-            if_counter++;
+            ctx->if_counter++;
             char do_while_block_name[20];
-            snprintf(do_while_block_name, sizeof(do_while_block_name), "do_while_%d", if_counter);
-            LLVMBasicBlockRef do_while_block = LLVMAppendBasicBlock(current_function, do_while_block_name);
+            snprintf(do_while_block_name, sizeof(do_while_block_name), "do_while_%d", ctx->if_counter);
+            LLVMBasicBlockRef do_while_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, do_while_block_name);
 
             char cond_block_name[20];
-            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", if_counter);
-            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlock(current_function, cond_block_name);
+            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", ctx->if_counter);
+            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, cond_block_name);
 
             char continue_block_name[20];
-            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", if_counter);
-            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlock(current_function, continue_block_name);
-
-            LLVMBuildBr(builder, do_while_block);
-
-            LLVMPositionBuilderAtEnd(builder, do_while_block);
-            generate_code_for_command_list(cmd->data.do_while_cmd.do_while_block);
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, cond_block);
+            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", ctx->if_counter);
+            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, continue_block_name);
+
+            LLVMBuildBr(ctx->builder, do_while_block);
+
+            int float_operations = ctx->float_operations;
+            int loops_built = ctx->loops_built;
+            IndexRange *before_loop = bounds_enter_loop(ctx, cmd);
+            LLVMPositionBuilderAtEnd(ctx->builder, do_while_block);
+            generate_code_for_command_list(ctx, cmd->data.do_while_cmd.do_while_block);
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                LLVMBuildBr(ctx->builder, cond_block);
             }
 
-            LLVMPositionBuilderAtEnd(builder, cond_block);
-            LLVMValueRef condition = generate_expression_code(cmd->data.do_while_cmd.condition, symbol_table);
+            LLVMPositionBuilderAtEnd(ctx->builder, cond_block);
+            LLVMValueRef condition = generate_expression_code(ctx, cmd->data.do_while_cmd.condition, symbol_table);
             if (!condition) break;
-            LLVMBuildCondBr(builder, condition, do_while_block, continue_block);
+            LLVMValueRef back_edge = build_profiled_cond_br(ctx, condition, do_while_block, continue_block);
+            hint_float_loop(ctx, back_edge, float_operations, loops_built);
+            bounds_leave(ctx, cmd, before_loop);
 
-            LLVMPositionBuilderAtEnd(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, continue_block);
             break;
         }
 
         case CMD_REPEAT_UNTIL: {
-            if_counter++;
+            ctx->if_counter++;
             char repeat_block_name[20];
-            snprintf(repeat_block_name, sizeof(repeat_block_name), "repeat_%d", if_counter);
-            LLVMBasicBlockRef repeat_block = LLVMAppendBasicBlock(current_function, repeat_block_name);
+            snprintf(repeat_block_name, sizeof(repeat_block_name), "repeat_%d", ctx->if_counter);
+            LLVMBasicBlockRef repeat_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, repeat_block_name);
 
             char cond_block_name[20];
-            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", if_counter);
-            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlock(current_function, cond_block_name);
+            snprintf(cond_block_name, sizeof(cond_block_name), "cond_%d", ctx->if_counter);
+            LLVMBasicBlockRef cond_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, cond_block_name);
 
             char continue_block_name[20];
-            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", if_counter);
-            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlock(current_function, continue_block_name);
+            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", ctx->if_counter);
+            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, continue_block_name);
 
-            LLVMValueRef counter = LLVMBuildAlloca(builder, LLVMInt32Type(), "repeat_counter");
-            LLVMBuildStore(builder, LLVMConstInt(LLVMInt32Type(), 0, 0), counter);
+            LLVMValueRef counter = LLVMBuildAlloca(ctx->builder, LLVMInt32TypeInContext(ctx->context), "repeat_counter");
+            LLVMBuildStore(ctx->builder, LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 0, 0), counter);
 
-            LLVMBuildBr(builder, repeat_block);
+            LLVMBuildBr(ctx->builder, repeat_block);
 
-            LLVMPositionBuilderAtEnd(builder, repeat_block);
-            generate_code_for_command_list(cmd->data.repeat_until_cmd.repeat_until_block);
+            int float_operations = ctx->float_operations;
+            int loops_built = ctx->loops_built;
+            IndexRange *before_loop = bounds_enter_loop(ctx, cmd);
+            LLVMPositionBuilderAtEnd(ctx->builder, repeat_block);
+            generate_code_for_command_list(ctx, cmd->data.repeat_until_cmd.repeat_until_block);
 
-            LLVMValueRef current_count = LLVMBuildLoad2(builder, LLVMInt32Type(), counter, "current_count");
-            LLVMValueRef incremented = LLVMBuildAdd(builder, current_count,
-            LLVMConstInt(LLVMInt32Type(), 1, 0), "incremented");
-            LLVMBuildStore(builder, incremented, counter);
+            LLVMValueRef current_count = LLVMBuildLoad2(ctx->builder, LLVMInt32TypeInContext(ctx->context), counter, "current_count");
+            LLVMValueRef incremented = LLVMBuildAdd(ctx->builder, current_count,
+            LLVMConstInt(LLVMInt32TypeInContext(ctx->context), 1, 0), "incremented");
+            LLVMBuildStore(ctx->builder, incremented, counter);
 
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, cond_block);
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                LLVMBuildBr(ctx->builder, cond_block);
             }
 
-            LLVMPositionBuilderAtEnd(builder, cond_block);
-            LLVMValueRef final_count = LLVMBuildLoad2(builder, LLVMInt32Type(), counter, "final_count");
-            LLVMValueRef times_value = LLVMConstInt(LLVMInt32Type(), cmd->data.repeat_until_cmd.times, 0);
+            LLVMPositionBuilderAtEnd(ctx->builder, cond_block);
+            LLVMValueRef final_count = LLVMBuildLoad2(ctx->builder, LLVMInt32TypeInContext(ctx->context), counter, "final_count");
+            LLVMValueRef times_value = LLVMConstInt(LLVMInt32TypeInContext(ctx->context), cmd->data.repeat_until_cmd.times, 0);
 
-            LLVMValueRef condition = LLVMBuildICmp(builder, LLVMIntSLT, final_count, times_value, "repeat_cond");
-            LLVMBuildCondBr(builder, condition, repeat_block, continue_block);
+            LLVMValueRef condition = LLVMBuildICmp(ctx->builder, LLVMIntSLT, final_count, times_value, "repeat_cond");
+            LLVMValueRef back_edge = build_profiled_cond_br(ctx, condition, repeat_block, continue_block);
+            hint_float_loop(ctx, back_edge, float_operations, loops_built);
+            bounds_leave(ctx, cmd, before_loop);
 
-            LLVMPositionBuilderAtEnd(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, continue_block);
             break;
         }
 
         case CMD_IF: {
-            if_counter++;
-            LLVMValueRef condition = generate_expression_code(cmd->data.if_cmd.condition, symbol_table);
+            ctx->if_counter++;
+            LLVMValueRef condition = generate_expression_code(ctx, cmd->data.if_cmd.condition, symbol_table);
             if (!condition) break;
 
             char then_block_name[20];
-            snprintf(then_block_name, sizeof(then_block_name), "then_%d", if_counter);
-            LLVMBasicBlockRef then_block = LLVMAppendBasicBlock(current_function, then_block_name);
+            snprintf(then_block_name, sizeof(then_block_name), "then_%d", ctx->if_counter);
+            LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, then_block_name);
 
             char continue_block_name[20];
-            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", if_counter);
-            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlock(current_function, continue_block_name);
+            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", ctx->if_counter);
+            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, continue_block_name);
 
-            LLVMBuildCondBr(builder, condition, then_block, continue_block);
+            build_profiled_cond_br(ctx, condition, then_block, continue_block);
 
-            LLVMPositionBuilderAtEnd(builder, then_block);
-            generate_code_for_command_list(cmd->data.if_cmd.then_block);
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, then_block);
+            IndexRange *before_if = bounds_enter_if(ctx, cmd->data.if_cmd.condition, symbol_table);
+            generate_code_for_command_list(ctx, cmd->data.if_cmd.then_block);
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                LLVMBuildBr(ctx->builder, continue_block);
             }
+            bounds_leave(ctx, cmd, before_if);
 
-            LLVMPositionBuilderAtEnd(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, continue_block);
             break;
         }
 
         case CMD_IF_ELSE: {
-            if_counter++;
-            LLVMValueRef condition = generate_expression_code(cmd->data.if_else_cmd.condition, symbol_table);
+            ctx->if_counter++;
+            LLVMValueRef condition = generate_expression_code(ctx, cmd->data.if_else_cmd.condition, symbol_table);
             if (!condition) break;
 
             char then_block_name[20];
-            snprintf(then_block_name, sizeof(then_block_name), "then_%d", if_counter);
+            snprintf(then_block_name, sizeof(then_block_name), "then_%d", ctx->if_counter);
             char else_block_name[20];
-            snprintf(else_block_name, sizeof(else_block_name), "else_%d", if_counter);
+            snprintf(else_block_name, sizeof(else_block_name), "else_%d", ctx->if_counter);
             char continue_block_name[20];
-            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", if_counter);
+            snprintf(continue_block_name, sizeof(continue_block_name), "continue_%d", ctx->if_counter);
 
-            LLVMBasicBlockRef then_block = LLVMAppendBasicBlock(current_function, then_block_name);
-            LLVMBasicBlockRef else_block = LLVMAppendBasicBlock(current_function, else_block_name);
-            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlock(current_function, continue_block_name);
+            LLVMBasicBlockRef then_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, then_block_name);
+            LLVMBasicBlockRef else_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, else_block_name);
+            LLVMBasicBlockRef continue_block = LLVMAppendBasicBlockInContext(ctx->context, ctx->current_function, continue_block_name);
 
-            LLVMBuildCondBr(builder, condition, then_block, else_block);
+            build_profiled_cond_br(ctx, condition, then_block, else_block);
 
-            LLVMPositionBuilderAtEnd(builder, then_block);
-            generate_code_for_command_list(cmd->data.if_else_cmd.then_block);
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, then_block);
+            IndexRange *before_if = bounds_enter_if(ctx, cmd->data.if_else_cmd.condition, symbol_table);
+            generate_code_for_command_list(ctx, cmd->data.if_else_cmd.then_block);
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                LLVMBuildBr(ctx->builder, continue_block);
             }
 
-            LLVMPositionBuilderAtEnd(builder, else_block);
-            generate_code_for_command_list(cmd->data.if_else_cmd.else_block);
-            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(builder))) {
-                LLVMBuildBr(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, else_block);
+            bounds_enter_else(ctx, cmd->data.if_else_cmd.condition, symbol_table, before_if);
+            generate_code_for_command_list(ctx, cmd->data.if_else_cmd.else_block);
+            if (!LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(ctx->builder))) {
+                LLVMBuildBr(ctx->builder, continue_block);
             }
+            bounds_leave(ctx, cmd, before_if);
 
-            LLVMPositionBuilderAtEnd(builder, continue_block);
+            LLVMPositionBuilderAtEnd(ctx->builder, continue_block);
             break;
         }
 
         case CMD_EXPRESSION: {
-            LLVMValueRef result = generate_expression_code(cmd->data.expression.expr, symbol_table);
+            LLVMValueRef result = generate_expression_code(ctx, cmd->data.expression.expr, symbol_table);
             break;
         }
     }
 }
 
-void generate_code_for_command_list(CommandList *list) {
-    if (!list || !builder) return;
+void generate_code_for_command_list(CodegenContext *ctx, CommandList *list) {
+    if (!list || !ctx->builder) return;
 
     SymbolTable *symbol_table = list->symbol_table;
 
+    // The first list generated is the program itself, whose statements form main
+    if (ctx->profile && !ctx->main_profiled) {
+        ctx->main_profiled = 1;
+        uint64_t hash = FNV_OFFSET_BASIS;
+        for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+            if (cmd->type != CMD_FUNC_DEF) hash = hash_command(hash, cmd);
+        }
+        begin_profiled_function(ctx, ctx->main_function, "main", hash);
+    }
+
     // First pass: Generate function definitions
-    generate_function_definitions(list);
+    generate_function_definitions(ctx, list);
 
     // Second pass: Generate other commands
     Command *current = list->head;
     while (current != NULL) {
         if (current->type != CMD_FUNC_DEF) {  // Skip function definitions as they're already handled
-            generate_code_for_command(current, symbol_table);
+            generate_code_for_command(ctx, current, symbol_table);
         }
         current = current->next;
     }
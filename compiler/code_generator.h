@@ -3,45 +3,198 @@
 
 #include "command.h"
 #include "symbol_table.h"
+#include "time_report.h"
+#include "function_cache.h"
+#include "profile.h"
 #include <llvm-c/Core.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/Orc.h>
+#include <llvm-c/LLJIT.h>
 
-// Initialize code generation, opening output file and storing symbol table
-void init_code_generation(const char *output_filename, SymbolTable *symbol_table, FunctionTable *function_table);
+// What finalize_code_generation writes to the output file
+typedef enum {
+    OUTPUT_NONE,
+    OUTPUT_BITCODE,
+    OUTPUT_OBJECT,
+    OUTPUT_EXECUTABLE
+} OutputKind;
 
-// Finalize code generation, closing output file
-void finalize_code_generation();
+// How --remarks reports optimization remarks, see remarks.h
+typedef enum {
+    REMARKS_NONE,
+    REMARKS_TEXT,  // Printed to stderr
+    REMARKS_YAML,  // Written to remarks_filename
+    REMARKS_JSON
+} RemarksFormat;
+
+typedef struct CodegenOptions {
+    OutputKind output_kind;
+    int optimization_level;          // 0-3, pipeline run before the module is emitted
+    const char *ir_output_filename;  // Stream the final textual IR here (NULL disables)
+    const char *instrument_filename;   // Count branches; the program writes its profile here
+    const char *profile_use_filename;  // Attach branch weights and entry counts from this profile
+    int codegen_threads;               // Generate top-level functions on this many threads (0 or 1: sequentially)
+    const char *target_triple;    // Target of the generated code (NULL: this machine)
+    const char *target_cpu;       // CPU to optimize for, "native" for the host (NULL: generic, host when JITing)
+    const char *target_features;  // Such as "+avx2,-avx512f" (NULL: those of the CPU)
+    int debug_info;                // Emit DWARF line tables, functions and variables (-g)
+    const char *source_filename;   // The .ptl file, named in the debug info
+    RemarksFormat remarks;          // Report what the optimizer did to each line
+    const char *remarks_filename;   // Where YAML and JSON remarks are written
+    int float_math;                 // FLOAT_* relaxations of IEEE float arithmetic (0: strict)
+    int bounds_check;               // Stop the program at an array index out of bounds
+} CodegenOptions;
+
+// Relaxations of float arithmetic, in CodegenOptions.float_math
+#define FLOAT_CONTRACT 0x1  // Fuse a * b + c into a multiply-add rounded once (--fp-contract)
+#define FLOAT_REASSOC  0x2  // Reorder float operations, so sums over arrays vectorize (--reassoc)
+#define FLOAT_FINITE   0x4  // Assume no NaNs, infinities or signed zeros
+#define FLOAT_FAST_MATH (FLOAT_CONTRACT | FLOAT_REASSOC | FLOAT_FINITE)  // --fast-math
+
+// Set to use the CPU the compiler runs on, in target_cpu
+#define TARGET_CPU_NATIVE "native"
+
+// Maps variable names to their alloca or global
+typedef struct ValueMap {
+    char *name;
+    LLVMValueRef value;
+    struct ValueMap *next;
+} ValueMap;
+
+// All code generation state of a single compilation
+typedef struct CodegenContext {
+    CodegenOptions options;
+    char *output_filename;
+
+    LLVMOrcThreadSafeContextRef ts_context;  // NULL when a JitSession owns the context
+    LLVMContextRef context;
+    LLVMModuleRef module;
+    LLVMBuilderRef builder;
+
+    SymbolTable *symbol_table;
+    FunctionTable *function_table;
+    ValueMap *value_map;
+
+    LLVMValueRef main_function;
+    LLVMBasicBlockRef entry_block;
+    LLVMValueRef current_function;
+    int if_counter;
+
+    TimeReport *time_report;  // Per-phase timers, NULL when not reporting
+    FunctionCache *function_cache;  // Reuse unchanged functions of earlier builds, NULL disables
+    uint64_t function_cache_state;  // Hash of the prototypes and symbols of the functions so far
+
+    CommandList *waiting_commands;  // Streamed statements that call a function not defined yet
+    int hide_globals;               // Streaming a function, which must not see the globals before it
+    struct ImportedModule *imports;  // Modules linked into this one before optimization, see import.h
+    int symbols_declared;            // The symbol table is shared by threads and only read
+
+    struct DebugInfo *debug;             // Debug info being built, NULL without -g or --remarks, see debug_info.h
+    Profile *profile;                    // Counters being inserted or the profile being used
+    ProfileFunction *profile_function;   // Record of the function being generated
+    int profile_site;                    // Number of its next conditional branch
+    int main_profiled;
+
+    int float_operations;  // Float arithmetic built so far, to find the loops that do some
+    int loops_built;
+
+    struct IndexRange *index_ranges;  // Known ranges of int variables, see bounds_check.h
+    int line;                         // Line of the statement being generated
+} CodegenContext;
+
+// Writes the counters of an --instrument build, see profile.h
+#define PROFILE_DUMP_FUNCTION "__ptl_profile_dump"
+
+// Register the native target with LLVM; safe to call from any thread
+void initialize_native_target();
+
+// Initialize code generation, creating the module and storing symbol table
+CodegenContext *init_code_generation(const char *output_filename, SymbolTable *symbol_table,
+                                     FunctionTable *function_table, const CodegenOptions *options);
+
+// Finalize code generation, writing the output file
+void finalize_code_generation(CodegenContext *ctx);
+
+// Finalize code generation and run main in-process through an ORC LLJIT
+// instead of writing bitcode. Returns the exit code of the program.
+int run_code_generation(CodegenContext *ctx);
+
+// Release the module, builder and LLVM context of a compilation
+void dispose_code_generation(CodegenContext *ctx);
+
+// A global or function defined by an earlier entry of a JitSession
+typedef struct JitDefinition {
+    char *name;
+    LLVMTypeRef type;  // Value type, in the session's context
+    int is_function;
+    struct JitDefinition *next;
+} JitDefinition;
+
+// One LLJIT and LLVM context shared by every entry of a REPL session, so
+// globals and functions persist from one entry to the next
+typedef struct JitSession {
+    LLVMOrcLLJITRef jit;
+    LLVMOrcThreadSafeContextRef ts_context;
+    JitDefinition *definitions;
+    int entry_count;
+} JitSession;
+
+JitSession *create_jit_session();
+void dispose_jit_session(JitSession *session);
+
+// Whether an earlier entry already defined a global or function called name
+int jit_session_defines(JitSession *session, const char *name);
+
+// Start generating the next entry into a fresh module of the session.
+// Everything earlier entries defined is declared in it.
+CodegenContext *begin_jit_entry(JitSession *session, SymbolTable *symbol_table,
+                                FunctionTable *function_table, const CodegenOptions *options);
+
+// Add the entry's module to the JIT and run its top-level statements.
+// Returns what they returned (0 unless they reached a return).
+int run_jit_entry(JitSession *session, CodegenContext *ctx);
 
 // Generate code for a command list
-void generate_code_for_command_list(CommandList *list);
+void generate_code_for_command_list(CodegenContext *ctx, CommandList *list);
+
+// Streaming code generation: generate the top-level commands of list as
+// soon as the parser has reduced them and remove them from it, so their AST
+// can be freed while the rest of the file is parsed. Statements that call a
+// function defined further down wait in ctx until it has been generated,
+// which keeps the order of batch generation. Not for profiled builds,
+// whose hash of main covers every top-level statement.
+void generate_streamed_commands(CodegenContext *ctx, CommandList *list);
+
+// End of input: generate the statements still waiting for a function
+void finish_streamed_commands(CodegenContext *ctx);
 
 // Generate code for a single command
-void generate_code_for_command(Command *cmd, SymbolTable *symbol_table);
+void generate_code_for_command(CodegenContext *ctx, Command *cmd, SymbolTable *symbol_table);
 
 // Generate code for an expression
-LLVMValueRef generate_expression_code(Expression *expr, SymbolTable *symbol_table);
+LLVMValueRef generate_expression_code(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table);
 
 // Generate code for a float expression
-LLVMValueRef generate_float_expression_code(Expression *expr, SymbolTable *symbol_table);
+LLVMValueRef generate_float_expression_code(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table);
 
 // Get the data type of an expression
-DataType get_expression_type(Expression *expr, SymbolTable *symbol_table);
+DataType get_expression_type(CodegenContext *ctx, Expression *expr, SymbolTable *symbol_table);
 
 // Get the format specifier for a given data type
 const char* get_format_for_type(DataType type);
 
 // Function-related code generation
-void generate_function_definitions(CommandList *list);
-LLVMValueRef generate_function_call(const char *func_name, ExpressionList *args, SymbolTable *symbol_table);
+void generate_function_definitions(CodegenContext *ctx, CommandList *list);
+LLVMValueRef generate_function_call(CodegenContext *ctx, const char *func_name, ExpressionList *args, SymbolTable *symbol_table);
 
 // Type conversion functions
 DataType llvm_type_to_data_type(LLVMTypeRef llvm_type);
-LLVMTypeRef get_current_function_return_type();
+LLVMTypeRef get_current_function_return_type(CodegenContext *ctx);
 
 // Array support functions
-LLVMTypeRef get_array_type_from_symbol(Symbol *symbol);
-LLVMValueRef generate_array_access(const char *array_name, ExpressionList *indices, SymbolTable *symbol_table);
-void generate_array_assignment(const char *array_name, ExpressionList *indices, LLVMValueRef value, SymbolTable *symbol_table);
+LLVMTypeRef get_array_type_from_symbol(CodegenContext *ctx, Symbol *symbol);
+LLVMValueRef generate_array_access(CodegenContext *ctx, const char *array_name, ExpressionList *indices, SymbolTable *symbol_table);
+void generate_array_assignment(CodegenContext *ctx, const char *array_name, ExpressionList *indices, LLVMValueRef value, SymbolTable *symbol_table);
 
 // Helper function to check if an operator is a comparison
 int isComparisonOp(int operator);
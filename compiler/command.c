@@ -4,6 +4,27 @@
 #include <stdarg.h>
 
 #include "command.h"
+#include "hash.h"
+#include "mem_report.h"
+#include "log.h"
+
+static __thread jmp_buf *compilation_abort_target = NULL;
+
+void set_compilation_abort_target(jmp_buf *target) {
+    compilation_abort_target = target;
+}
+
+jmp_buf *get_compilation_abort_target(void) {
+    return compilation_abort_target;
+}
+
+void abort_compilation(void) {
+    if (compilation_abort_target) {
+        longjmp(*compilation_abort_target, 1);
+    }
+
+    exit(1);
+}
 
 void panic(const char *format, ...) {
     va_list args;
@@ -19,12 +40,12 @@ void panic(const char *format, ...) {
 
     va_end(args);
 
-    exit(1);
+    abort_compilation();
 }
 
 // Function table management
 FunctionTable *create_function_table() {
-    FunctionTable *table = (FunctionTable*) malloc(sizeof(FunctionTable));
+    FunctionTable *table = (FunctionTable*) tracked_malloc(ALLOC_OTHER, sizeof(FunctionTable));
     if (table == NULL) {
         panic("Error: Memory allocation failed for function table\n");
     }
@@ -35,12 +56,12 @@ FunctionTable *create_function_table() {
 
 void insert_function(FunctionTable *table, const char *name, Parameter *params,
                     DataType return_type, CommandList *body) {
-    Function *func = (Function*) malloc(sizeof(Function));
+    Function *func = (Function*) tracked_malloc(ALLOC_OTHER, sizeof(Function));
     if (func == NULL) {
         panic("Error: Memory allocation failed for function\n");
     }
 
-    func->name = strdup(name);
+    func->name = tracked_strdup(name);
     func->params = params;
     func->return_type = return_type;
     func->body = body;
@@ -123,7 +144,7 @@ void free_parameter(Parameter *param) {
 
 // Expression list management
 ExpressionList *create_expression_list() {
-    ExpressionList *list = (ExpressionList*) malloc(sizeof(ExpressionList));
+    ExpressionList *list = (ExpressionList*) tracked_malloc(ALLOC_EXPRESSION_LIST, sizeof(ExpressionList));
     if (list == NULL) {
         panic("Error: Memory allocation failed for expression list\n");
     }
@@ -133,7 +154,7 @@ ExpressionList *create_expression_list() {
 }
 
 void add_expression_to_list(ExpressionList **head, Expression *expr) {
-    ExpressionList *new_node = (ExpressionList*) malloc(sizeof(ExpressionList));
+    ExpressionList *new_node = (ExpressionList*) tracked_malloc(ALLOC_EXPRESSION_LIST, sizeof(ExpressionList));
     if (new_node == NULL) {
         panic("Error: Memory allocation failed for expression list node\n");
     }
@@ -165,7 +186,7 @@ void free_expression_list(ExpressionList *list) {
 }
 
 CommandList* create_command_list(SymbolTable *symbol_table) {
-    CommandList *list = (CommandList*) malloc(sizeof(CommandList));
+    CommandList *list = (CommandList*) tracked_malloc(ALLOC_COMMAND_LIST, sizeof(CommandList));
     if (list == NULL) {
         panic("Error: Memory allocation failed for command list\n");
     }
@@ -194,20 +215,34 @@ void add_command(CommandList *list, Command *cmd) {
     list->size++;
 }
 
+Command *remove_first_command(CommandList *list) {
+    if (list == NULL || list->head == NULL) return NULL;
+
+    Command *cmd = list->head;
+    list->head = cmd->next;
+    if (list->head == NULL) {
+        list->tail = NULL;
+    }
+    list->size--;
+
+    cmd->next = NULL;
+    return cmd;
+}
+
 CommandList* create_sub_command_list(CommandList *parent) {
     CommandList *sub_list = create_command_list(parent->symbol_table);
     return sub_list;
 }
 
 Command* create_assign_command(char *name, ExpressionList *indices, Expression *value, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
 
     cmd->type = CMD_ASSIGN;
     cmd->line_number = line;
-    cmd->data.assign.name = strdup(name);
+    cmd->data.assign.name = tracked_strdup(name);
     cmd->data.assign.indices = indices;
     cmd->data.assign.value = value;
     cmd->next = NULL;
@@ -216,21 +251,21 @@ Command* create_assign_command(char *name, ExpressionList *indices, Expression *
 }
 
 Command* create_read_command(char *var_name, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
 
     cmd->type = CMD_READ;
     cmd->line_number = line;
-    cmd->data.read.var_name = strdup(var_name);
+    cmd->data.read.var_name = tracked_strdup(var_name);
     cmd->next = NULL;
 
     return cmd;
 }
 
 Command* create_write_command(Expression *expr, char *string_literal, int line, int newline) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -238,7 +273,7 @@ Command* create_write_command(Expression *expr, char *string_literal, int line,
     cmd->type = CMD_WRITE;
     cmd->line_number = line;
     cmd->data.write.expr = expr;
-    cmd->data.write.string_literal = string_literal ? strdup(string_literal) : NULL;
+    cmd->data.write.string_literal = string_literal ? tracked_strdup(string_literal) : NULL;
     cmd->data.write.newline = newline;
     cmd->next = NULL;
 
@@ -246,7 +281,7 @@ Command* create_write_command(Expression *expr, char *string_literal, int line,
 }
 
 Command* create_while_command(Expression *condition, CommandList *while_block, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -261,7 +296,7 @@ Command* create_while_command(Expression *condition, CommandList *while_block, i
 }
 
 Command* create_do_while_command(Expression *condition, CommandList *do_while_block, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -276,7 +311,7 @@ Command* create_do_while_command(Expression *condition, CommandList *do_while_bl
 }
 
 Command* create_repeat_until_command(int times, CommandList *repeat_until_block, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -291,7 +326,7 @@ Command* create_repeat_until_command(int times, CommandList *repeat_until_block,
 }
 
 Command* create_if_command(Expression *condition, CommandList *then_block, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -306,7 +341,7 @@ Command* create_if_command(Expression *condition, CommandList *then_block, int l
 }
 
 Command* create_if_else_command(Expression *condition, CommandList *then_block, CommandList *else_block, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -322,7 +357,7 @@ Command* create_if_else_command(Expression *condition, CommandList *then_block,
 }
 
 Command* create_expression_command(Expression *expr, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -336,14 +371,14 @@ Command* create_expression_command(Expression *expr, int line) {
 }
 
 Command* create_func_def_command(char *name, Parameter *params, DataType return_type, CommandList *body, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
 
     cmd->type = CMD_FUNC_DEF;
     cmd->line_number = line;
-    cmd->data.func_def.name = strdup(name);
+    cmd->data.func_def.name = tracked_strdup(name);
     cmd->data.func_def.params = params;
     cmd->data.func_def.return_type = return_type;
     cmd->data.func_def.body = body;
@@ -353,7 +388,7 @@ Command* create_func_def_command(char *name, Parameter *params, DataType return_
 }
 
 Command* create_return_command(Expression *return_value, int line) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
@@ -366,21 +401,35 @@ Command* create_return_command(Expression *return_value, int line) {
     return cmd;
 }
 
+Command* create_import_command(const char *path, int line) {
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
+    if (cmd == NULL) {
+        panic("Error: Memory allocation failed for command\n");
+    }
+
+    cmd->type = CMD_IMPORT;
+    cmd->line_number = line;
+    cmd->data.import_cmd.path = tracked_strdup(path);
+    cmd->next = NULL;
+
+    return cmd;
+}
+
 Expression* create_var_expression(char *name) {
-    printf("Creating variable expression for: %s\n", name);
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    LOG_DEBUG("Creating variable expression for: %s\n", name);
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
 
     expr->type = EXPR_VAR;
-    expr->data.var_name = strdup(name);
+    expr->data.var_name = tracked_strdup(name);
 
     return expr;
 }
 
 Expression* create_int_literal_expression(int value) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -392,7 +441,7 @@ Expression* create_int_literal_expression(int value) {
 }
 
 Expression* create_float_literal_expression(float value) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -404,7 +453,7 @@ Expression* create_float_literal_expression(float value) {
 }
 
 Expression* create_char_literal_expression(char value) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -416,21 +465,21 @@ Expression* create_char_literal_expression(char value) {
 }
 
 Expression* create_string_literal_expression(char* value) {
-    printf("Creating string literal expression for: %s\n", value);
+    LOG_DEBUG("Creating string literal expression for: %s\n", value);
 
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
 
     expr->type = EXPR_STRING_LITERAL;
-    expr->data.string_value = strdup(value);
+    expr->data.string_value = tracked_strdup(value);
 
     return expr;
 }
 
 Expression* create_bool_literal_expression(int value) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -442,7 +491,7 @@ Expression* create_bool_literal_expression(int value) {
 }
 
 Expression* create_binary_op_expression(Expression *left, int operator, Expression *right) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -456,7 +505,7 @@ Expression* create_binary_op_expression(Expression *left, int operator, Expressi
 }
 
 Expression* create_unary_op_expression(int operator, Expression *operand) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
@@ -469,13 +518,13 @@ Expression* create_unary_op_expression(int operator, Expression *operand) {
 }
 
 Expression* create_func_call_expression(char *func_name, ExpressionList *args) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
 
     expr->type = EXPR_FUNC_CALL;
-    expr->data.func_call.func_name = strdup(func_name);
+    expr->data.func_call.func_name = tracked_strdup(func_name);
     expr->data.func_call.args = args;
 
     return expr;
@@ -562,6 +611,9 @@ void free_command(Command *cmd) {
             if (cmd->data.return_cmd.return_value)
                 free_expression(cmd->data.return_cmd.return_value);
             break;
+        case CMD_IMPORT:
+            free(cmd->data.import_cmd.path);
+            break;
     }
 
     free(cmd);
@@ -720,6 +772,9 @@ void print_command(Command *cmd, int indent) {
                 print_expression(cmd->data.return_cmd.return_value, indent + 2);
             }
             break;
+        case CMD_IMPORT:
+            printf("Import: %s\n", cmd->data.import_cmd.path);
+            break;
     }
 }
 
@@ -745,6 +800,133 @@ void print_command_list(CommandList *list) {
     printf("========================\n");
 }
 
+/* Structural hashing, for caching code generated from a subtree */
+static uint64_t hash_expression(uint64_t hash, const Expression *expr);
+
+static uint64_t hash_expression_list(uint64_t hash, const ExpressionList *list) {
+    int count = 0;
+    for (; list != NULL; list = list->next, count++) {
+        hash = hash_expression(hash, list->expr);
+    }
+    return fnv1a_update_int(hash, count);
+}
+
+static uint64_t hash_array_dimensions(uint64_t hash, const ArrayDimension *dims) {
+    int count = 0;
+    for (; dims != NULL; dims = dims->next, count++) {
+        hash = fnv1a_update_int(hash, dims->size);
+    }
+    return fnv1a_update_int(hash, count);
+}
+
+static uint64_t hash_expression(uint64_t hash, const Expression *expr) {
+    if (expr == NULL) return fnv1a_update_int(hash, -1);
+
+    hash = fnv1a_update_int(hash, expr->type);
+    switch (expr->type) {
+        case EXPR_VAR:
+            return fnv1a_update_string(hash, expr->data.var_name);
+        case EXPR_INT_LITERAL:
+            return fnv1a_update_int(hash, expr->data.int_value);
+        case EXPR_FLOAT_LITERAL:
+            return fnv1a_update(hash, &expr->data.float_value, sizeof(float));
+        case EXPR_CHAR_LITERAL:
+            return fnv1a_update_int(hash, expr->data.char_value);
+        case EXPR_STRING_LITERAL:
+            return fnv1a_update_string(hash, expr->data.string_value);
+        case EXPR_BOOL_LITERAL:
+            return fnv1a_update_int(hash, expr->data.bool_value);
+        case EXPR_BINARY_OP:
+            hash = fnv1a_update_int(hash, expr->data.binary_op.operator);
+            hash = hash_expression(hash, expr->data.binary_op.left);
+            return hash_expression(hash, expr->data.binary_op.right);
+        case EXPR_UNARY_OP:
+            hash = fnv1a_update_int(hash, expr->data.unary_op.operator);
+            return hash_expression(hash, expr->data.unary_op.operand);
+        case EXPR_FUNC_CALL:
+            hash = fnv1a_update_string(hash, expr->data.func_call.func_name);
+            return hash_expression_list(hash, expr->data.func_call.args);
+        case EXPR_ARRAY_ACCESS:
+            hash = fnv1a_update_string(hash, expr->data.array_access.array_name);
+            return hash_expression_list(hash, expr->data.array_access.indices);
+    }
+    return hash;
+}
+
+static uint64_t hash_command_list(uint64_t hash, const CommandList *list) {
+    if (list == NULL) return fnv1a_update_int(hash, -1);
+
+    int count = 0;
+    for (const Command *cmd = list->head; cmd != NULL; cmd = cmd->next, count++) {
+        hash = hash_command(hash, cmd);
+    }
+    return fnv1a_update_int(hash, count);
+}
+
+uint64_t hash_function_signature(uint64_t hash, const Command *cmd) {
+    hash = fnv1a_update_string(hash, cmd->data.func_def.name);
+    hash = fnv1a_update_int(hash, cmd->data.func_def.return_type);
+
+    int count = 0;
+    for (const Parameter *param = cmd->data.func_def.params; param != NULL; param = param->next, count++) {
+        hash = fnv1a_update_string(hash, param->name);
+        hash = fnv1a_update_int(hash, param->type);
+        hash = fnv1a_update_int(hash, param->is_reference);
+        hash = hash_array_dimensions(hash, param->array_dims);
+    }
+    return fnv1a_update_int(hash, count);
+}
+
+uint64_t hash_command(uint64_t hash, const Command *cmd) {
+    // Line numbers are left out: moving code around does not change its IR
+    hash = fnv1a_update_int(hash, cmd->type);
+
+    switch (cmd->type) {
+        case CMD_DECLARE_VAR:
+            hash = fnv1a_update_string(hash, cmd->data.declare_var.name);
+            hash = fnv1a_update_int(hash, cmd->data.declare_var.data_type);
+            return hash_array_dimensions(hash, cmd->data.declare_var.array_dims);
+        case CMD_ASSIGN:
+            hash = fnv1a_update_string(hash, cmd->data.assign.name);
+            hash = fnv1a_update_int(hash, cmd->data.assign.indices != NULL);
+            hash = hash_expression_list(hash, cmd->data.assign.indices);
+            return hash_expression(hash, cmd->data.assign.value);
+        case CMD_READ:
+            return fnv1a_update_string(hash, cmd->data.read.var_name);
+        case CMD_WRITE:
+            hash = hash_expression(hash, cmd->data.write.expr);
+            hash = fnv1a_update_int(hash, cmd->data.write.string_literal != NULL);
+            hash = fnv1a_update_string(hash, cmd->data.write.string_literal);
+            return fnv1a_update_int(hash, cmd->data.write.newline);
+        case CMD_WHILE:
+            hash = hash_expression(hash, cmd->data.while_cmd.condition);
+            return hash_command_list(hash, cmd->data.while_cmd.while_block);
+        case CMD_DO_WHILE:
+            hash = hash_expression(hash, cmd->data.do_while_cmd.condition);
+            return hash_command_list(hash, cmd->data.do_while_cmd.do_while_block);
+        case CMD_REPEAT_UNTIL:
+            hash = fnv1a_update_int(hash, cmd->data.repeat_until_cmd.times);
+            return hash_command_list(hash, cmd->data.repeat_until_cmd.repeat_until_block);
+        case CMD_IF:
+            hash = hash_expression(hash, cmd->data.if_cmd.condition);
+            return hash_command_list(hash, cmd->data.if_cmd.then_block);
+        case CMD_IF_ELSE:
+            hash = hash_expression(hash, cmd->data.if_else_cmd.condition);
+            hash = hash_command_list(hash, cmd->data.if_else_cmd.then_block);
+            return hash_command_list(hash, cmd->data.if_else_cmd.else_block);
+        case CMD_EXPRESSION:
+            return hash_expression(hash, cmd->data.expression.expr);
+        case CMD_FUNC_DEF:
+            hash = hash_function_signature(hash, cmd);
+            return hash_command_list(hash, cmd->data.func_def.body);
+        case CMD_RETURN:
+            return hash_expression(hash, cmd->data.return_cmd.return_value);
+        case CMD_IMPORT:
+            return fnv1a_update_string(hash, cmd->data.import_cmd.path);
+    }
+    return hash;
+}
+
 /* Expression evaluation */
 int evaluate_expression(Expression *expr, SymbolTable *symbol_table) {
     if (expr == NULL) return 0;
@@ -1110,11 +1292,14 @@ void execute_command(Command *cmd, SymbolTable *symbol_table) {
                 printf("Return value: %d\n", value);
             }
             break;
+
+        case CMD_IMPORT:
+            break;
     }
 }
 
 ArrayDimension *create_array_dimension(int size, ArrayDimension *next) {
-    ArrayDimension *dim = (ArrayDimension*) malloc(sizeof(ArrayDimension));
+    ArrayDimension *dim = (ArrayDimension*) tracked_malloc(ALLOC_OTHER, sizeof(ArrayDimension));
     if (dim == NULL) {
         panic("Error: Memory allocation failed for array dimension\n");
     }
@@ -1133,12 +1318,12 @@ void free_array_dimension(ArrayDimension *dim) {
 
 // Parameter management with array support
 Parameter *create_parameter(char *name, DataType type, int is_reference, ArrayDimension *dims) {
-    Parameter *param = (Parameter*) malloc(sizeof(Parameter));
+    Parameter *param = (Parameter*) tracked_malloc(ALLOC_OTHER, sizeof(Parameter));
     if (param == NULL) {
         panic("Error: Memory allocation failed for parameter\n");
     }
 
-    param->name = strdup(name);
+    param->name = tracked_strdup(name);
     param->type = type;
     param->is_reference = is_reference;
     param->array_dims = dims;
@@ -1149,13 +1334,13 @@ Parameter *create_parameter(char *name, DataType type, int is_reference, ArrayDi
 
 // Expression creation for array access
 Expression* create_array_access_expression(char *array_name, ExpressionList *indices) {
-    Expression *expr = (Expression*) malloc(sizeof(Expression));
+    Expression *expr = (Expression*) tracked_malloc(ALLOC_EXPRESSION, sizeof(Expression));
     if (expr == NULL) {
         panic("Error: Memory allocation failed for expression\n");
     }
 
     expr->type = EXPR_ARRAY_ACCESS;
-    expr->data.array_access.array_name = strdup(array_name);
+    expr->data.array_access.array_name = tracked_strdup(array_name);
     expr->data.array_access.indices = indices;
 
     return expr;
@@ -1163,14 +1348,14 @@ Expression* create_array_access_expression(char *array_name, ExpressionList *ind
 
 // Updated command creation functions
 Command* create_declare_var_command(char *name, DataType type, int line, ArrayDimension *dims) {
-    Command *cmd = (Command*) malloc(sizeof(Command));
+    Command *cmd = (Command*) tracked_malloc(ALLOC_COMMAND, sizeof(Command));
     if (cmd == NULL) {
         panic("Error: Memory allocation failed for command\n");
     }
 
     cmd->type = CMD_DECLARE_VAR;
     cmd->line_number = line;
-    cmd->data.declare_var.name = strdup(name);
+    cmd->data.declare_var.name = tracked_strdup(name);
     cmd->data.declare_var.data_type = type;
     cmd->data.declare_var.array_dims = dims;
     cmd->next = NULL;
@@ -1189,7 +1374,7 @@ void execute_command_list(CommandList *list) {
 }
 
 BlockStack *create_block_stack() {
-    BlockStack *stack = (BlockStack *)malloc(sizeof(BlockStack));
+    BlockStack *stack = (BlockStack *)tracked_malloc(ALLOC_OTHER, sizeof(BlockStack));
     if (stack == NULL) {
         panic("Memory allocation error\n");
     }
@@ -1198,7 +1383,7 @@ BlockStack *create_block_stack() {
 }
 
 void push_block(BlockStack *stack, CommandList *block) {
-    BlockStackNode *node = (BlockStackNode *)malloc(sizeof(BlockStackNode));
+    BlockStackNode *node = (BlockStackNode *)tracked_malloc(ALLOC_OTHER, sizeof(BlockStackNode));
     if (node == NULL) {
         panic("Memory allocation error\n");
     }
@@ -1230,7 +1415,7 @@ void free_block_stack(BlockStack *stack) {
 }
 
 ConditionStack *create_condition_stack() {
-    ConditionStack *stack = (ConditionStack *)malloc(sizeof(ConditionStack));
+    ConditionStack *stack = (ConditionStack *)tracked_malloc(ALLOC_OTHER, sizeof(ConditionStack));
     if (stack == NULL) {
         panic("Memory allocation error\n");
     }
@@ -1239,7 +1424,7 @@ ConditionStack *create_condition_stack() {
 }
 
 void push_condition(ConditionStack *stack, Expression *condition) {
-    ConditionStackNode *node = (ConditionStackNode *)malloc(sizeof(ConditionStackNode));
+    ConditionStackNode *node = (ConditionStackNode *)tracked_malloc(ALLOC_OTHER, sizeof(ConditionStackNode));
     if (node == NULL) {
         panic("Memory allocation error\n");
     }
@@ -1,6 +1,8 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include <setjmp.h>
+#include <stdint.h>
 #include "symbol_table.h"
 #include "inter.tab.h"
 
@@ -25,7 +27,8 @@ typedef enum {
     CMD_IF_ELSE,
     CMD_EXPRESSION,
     CMD_FUNC_DEF,
-    CMD_RETURN
+    CMD_RETURN,
+    CMD_IMPORT
 } CommandType;
 
 typedef struct Parameter {
@@ -153,6 +156,10 @@ typedef struct Command {
         struct {
             Expression *return_value;
         } return_cmd;
+
+        struct {
+            char *path;  // Canonical path of the imported .ptl file
+        } import_cmd;
     } data;
 
     struct Command *next;
@@ -198,6 +205,12 @@ typedef struct FunctionTable {
 
 void panic(const char *format, ...);
 
+// Errors abort the compilation running on the calling thread by jumping to
+// its target; without a target the process exits as before.
+void set_compilation_abort_target(jmp_buf *target);
+jmp_buf *get_compilation_abort_target(void);
+void abort_compilation(void);
+
 BlockStack *create_block_stack();
 void push_block(BlockStack *stack, CommandList *block);
 CommandList *pop_block(BlockStack *stack);
@@ -225,10 +238,16 @@ ExpressionList *create_expression_list();
 void add_expression_to_list(ExpressionList **head, Expression *expr);
 
 CommandList* create_command_list(SymbolTable *symbol_table);
+void free_command(Command *cmd);
 void free_command_list(CommandList *list);
 void print_command_list(CommandList *list);
 void print_command_list_indented(CommandList *list, int indent);
 
+// Fold the structure of a command (or just a function's name, return type
+// and parameters) into an FNV-1a hash. Line numbers are not included.
+uint64_t hash_command(uint64_t hash, const Command *cmd);
+uint64_t hash_function_signature(uint64_t hash, const Command *cmd);
+
 Command* create_declare_var_command(char *name, DataType type, int line, ArrayDimension *dims);
 Command* create_assign_command(char *name, ExpressionList *indices, Expression *value, int line);
 Command* create_read_command(char *var_name, int line);
@@ -241,6 +260,7 @@ Command* create_if_else_command(Expression *condition, CommandList *then_block,
 Command* create_expression_command(Expression *expr, int line);
 Command* create_func_def_command(char *name, Parameter *params, DataType return_type, CommandList *body, int line);
 Command* create_return_command(Expression *return_value, int line);
+Command* create_import_command(const char *path, int line);
 
 Expression* create_var_expression(char *name);
 Expression* create_int_literal_expression(int value);
@@ -254,6 +274,8 @@ Expression* create_func_call_expression(char *func_name, ExpressionList *args);
 Expression* create_array_access_expression(char *array_name, ExpressionList *indices);
 
 void add_command(CommandList *list, Command *cmd);
+// Unlink and return the first command of list, or NULL if it is empty
+Command *remove_first_command(CommandList *list);
 CommandList* create_sub_command_list(CommandList *parent);
 
 void execute_command_list(CommandList *list);
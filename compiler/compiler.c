@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "compiler.h"
+#include "cache.h"
+#include "pipeline.h"
+#include "import.h"
+#include "log.h"
+
+// Smaller files are read faster through stdio than mapped
+#define SOURCE_MAP_THRESHOLD (16 * 1024)
+
+// flex ends a buffer it scans in place with two of these
+#define SCANNER_SENTINEL_SIZE 2
+
+// The text of a source file, for the scanner. Regular files are mapped and
+// scanned in place, without copying them through stdio buffers; pipes,
+// terminals and small files are read through file.
+typedef struct SourceInput {
+    FILE *file;
+    char *map;         // The file followed by the sentinels, NULL when not mapped
+    size_t map_size;   // Length of the mapping
+    size_t text_size;  // Length of the file
+} SourceInput;
+
+// Open filename, "-" for stdin; returns 0 when it cannot be opened
+static int open_source_input(SourceInput *input, const char *filename) {
+    memset(input, 0, sizeof(SourceInput));
+    int from_stdin = strcmp(filename, "-") == 0;
+    input->file = from_stdin ? stdin : fopen(filename, "r");
+    if (!input->file) return 0;
+
+    struct stat info;
+    if (from_stdin || fstat(fileno(input->file), &info) != 0 || !S_ISREG(info.st_mode) ||
+        info.st_size < SOURCE_MAP_THRESHOLD) {
+        return 1;
+    }
+
+    size_t text_size = (size_t)info.st_size;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_size = (text_size + SCANNER_SENTINEL_SIZE + page_size - 1) / page_size * page_size;
+
+    // The sentinels may not fit in the last page of the file, so reserve
+    // zeroed pages for all of it and map the file over their start. The
+    // rest of the file's last page reads as zeros too. Private pages let
+    // the scanner write the terminators of its tokens into the text.
+    char *map = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) return 1;
+    if (mmap(map, text_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fileno(input->file), 0) == MAP_FAILED) {
+        munmap(map, map_size);
+        return 1;
+    }
+
+    input->map = map;
+    input->map_size = map_size;
+    input->text_size = text_size;
+    return 1;
+}
+
+static void set_scanner_input(SourceInput *input, yyscan_t scanner) {
+    if (input->map && yy_scan_buffer(input->map, input->text_size + SCANNER_SENTINEL_SIZE, scanner)) {
+        return;
+    }
+    yyset_in(input->file, scanner);
+}
+
+// After yylex_destroy, which leaves a buffer it did not allocate alone
+static void close_source_input(SourceInput *input) {
+    if (input->map) munmap(input->map, input->map_size);
+    if (input->file != stdin) fclose(input->file);
+}
+
+static void init_parser_state(ParserState *state, const char *input_filename) {
+    memset(state, 0, sizeof(ParserState));
+
+    state->input_filename = input_filename;
+    state->line_number = 1;
+    state->symbol_table = create_symbol_table();
+    state->function_table = create_function_table();
+    state->cmd_list = create_command_list(state->symbol_table);
+    state->block_stack = create_block_stack();
+    state->condition_stack = create_condition_stack();
+}
+
+static void free_parser_state(ParserState *state) {
+    free_symbol_table(state->symbol_table);
+    free_function_table(state->function_table);
+    free_command_list(state->cmd_list);
+    free_block_stack(state->block_stack);
+    free_condition_stack(state->condition_stack);
+}
+
+int compile_file(CompileJob *job) {
+    // The memory report needs the running phase even without --time-report
+    TimeReport *times = (job->report_times || job->report_memory) ? &job->times : NULL;
+    time_report_begin(times);
+
+    MemReport *memory = job->report_memory ? &job->memory : NULL;
+    if (memory) {
+        memset(memory, 0, sizeof(MemReport));
+        memory->phases = times;
+    }
+    set_mem_report(memory);
+
+    CompilePhase previous_phase = time_report_enter(times, PHASE_CACHE);
+    char cache_key[CACHE_KEY_SIZE];
+    int cacheable = job->use_cache && cache_job_key(job, cache_key);
+
+    // Unchanged sources skip lexing, parsing and code generation entirely
+    if (cacheable && cache_fetch(cache_key, job->output_filename)) {
+        LOG_INFO("Reused cached output for %s\n", job->input_filename);
+        time_report_end(times);
+        set_mem_report(NULL);
+        job->exit_code = 0;
+        return job->exit_code;
+    }
+    time_report_leave(times, previous_phase);
+
+    SourceInput input;
+    if (!open_source_input(&input, job->input_filename)) {
+        fprintf(stderr, "Error: Could not open input file '%s'\n", job->input_filename);
+        time_report_end(times);
+        set_mem_report(NULL);
+        job->exit_code = 1;
+        return job->exit_code;
+    }
+
+    ParserState state;
+    init_parser_state(&state, job->input_filename);
+    state.time_report = times;
+    job->options.source_filename = job->input_filename;
+
+    yyscan_t scanner;
+    yylex_init_extra(&state, &scanner);
+    set_scanner_input(&input, scanner);
+
+    CodegenContext *volatile ctx = NULL;
+    Pipeline *volatile pipeline = NULL;
+    jmp_buf abort_target;
+
+    if (setjmp(abort_target) != 0) {
+        // An error inside the parser or code generator gave up on this file
+        set_compilation_abort_target(NULL);
+        LOG_ERROR("Compilation of '%s' aborted.\n", job->input_filename);
+
+        finish_pipeline(pipeline, 1);
+        dispose_code_generation(ctx);
+        yylex_destroy(scanner);
+        close_source_input(&input);
+        free_parser_state(&state);
+
+        time_report_end(times);
+        set_mem_report(NULL);
+        job->exit_code = 1;
+        return job->exit_code;
+    }
+    set_compilation_abort_target(&abort_target);
+
+    // Printing the AST needs all of it, the profile hash of main covers
+    // every top-level statement and parallel code generation splits all
+    // functions at once; otherwise generate each declaration as soon as it
+    // is parsed and free it, so memory does not grow with the file
+    int streaming = !(job->emit_flags & EMIT_AST) && job->options.codegen_threads <= 1 &&
+                    !job->options.instrument_filename && !job->options.profile_use_filename;
+
+    if (streaming) {
+        ctx = init_code_generation(job->output_filename, state.symbol_table,
+                                   state.function_table, &job->options);
+        ctx->time_report = times;
+        ctx->function_cache = job->function_cache;
+        state.codegen = ctx;
+        if (job->function_cache) function_cache_begin_build(job->function_cache);
+    }
+
+    if (job->pipeline) {
+        pipeline = start_pipeline(&state, scanner);
+        if (!pipeline) {
+            LOG_WARN("Warning: Could not start pipeline threads, compiling %s on one thread\n",
+                     job->input_filename);
+        }
+        state.pipeline = pipeline;
+    }
+
+    // Grammar actions build the AST and symbol tables, so this covers semantic work
+    previous_phase = time_report_enter(times, PHASE_PARSE);
+    int parse_result = yyparse(&state, scanner);
+    if (pipeline) {
+        // Waiting for the last declarations counts as code generation
+        time_report_enter(times, PHASE_CODEGEN);
+        int codegen_failed = finish_pipeline(pipeline, parse_result != 0);
+        pipeline = NULL;
+        state.pipeline = NULL;
+
+        // The error has been reported on the code generation thread
+        if (codegen_failed) abort_compilation();
+    }
+    time_report_leave(times, previous_phase);
+    mem_report_sample_rss(memory, RSS_AFTER_PARSE);
+    int exit_code = parse_result;
+
+    if (parse_result == 0) {
+        if (job->run_mode) {
+            LOG_INFO("Parsing successful. Running %s\n", job->input_filename);
+        } else {
+            LOG_INFO("Parsing successful. Generating code to %s\n", job->output_filename);
+        }
+
+        if (job->emit_flags & EMIT_AST) {
+            print_command_list(state.cmd_list);
+        }
+
+        previous_phase = time_report_enter(times, PHASE_CODEGEN);
+        if (streaming) {
+            finish_streamed_commands(ctx);
+        } else {
+            ctx = init_code_generation(job->output_filename, state.symbol_table,
+                                       state.function_table, &job->options);
+            ctx->time_report = times;
+            ctx->function_cache = job->function_cache;
+
+            // Generate code for the entire command list
+            if (job->function_cache) function_cache_begin_build(job->function_cache);
+            generate_code_for_command_list(ctx, state.cmd_list);
+        }
+        if (job->function_cache) function_cache_end_build(job->function_cache);
+        time_report_leave(times, previous_phase);
+        mem_report_sample_rss(memory, RSS_AFTER_CODEGEN);
+
+        // Symbols are inserted while generating code, so report them afterwards
+        if (job->emit_flags & EMIT_SYMBOLS) {
+            print_symbol_table(state.symbol_table);
+            print_function_table(state.function_table);
+        }
+
+        LOG_INFO("Generating code for main function\n");
+
+        // Closing main counts as codegen; optimization and output time
+        // are charged to their own phases
+        previous_phase = time_report_enter(times, PHASE_CODEGEN);
+        if (job->run_mode) {
+            // Execute main in-process instead of writing bitcode
+            fflush(stdout);
+            exit_code = run_code_generation(ctx);
+        } else {
+            // Finalize code generation
+            finalize_code_generation(ctx);
+
+            LOG_INFO("Code generation complete.\n");
+
+            if (cacheable) {
+                time_report_enter(times, PHASE_CACHE);
+                cache_store(cache_key, job->output_filename);
+            }
+        }
+        time_report_leave(times, previous_phase);
+        mem_report_sample_rss(memory, RSS_AFTER_OUTPUT);
+    } else {
+        LOG_ERROR("Parsing failed.\n");
+    }
+
+    set_compilation_abort_target(NULL);
+
+    dispose_code_generation(ctx);
+    yylex_destroy(scanner);
+    close_source_input(&input);
+    free_parser_state(&state);
+
+    time_report_end(times);
+    set_mem_report(NULL);
+    job->exit_code = exit_code;
+    return job->exit_code;
+}
+
+LLVMMemoryBufferRef compile_module(const char *path, int bounds_check) {
+    SourceInput input;
+    if (!open_source_input(&input, path)) {
+        fprintf(stderr, "Error: Could not open module '%s'\n", path);
+        return NULL;
+    }
+
+    ParserState state;
+    init_parser_state(&state, path);
+
+    yyscan_t scanner;
+    yylex_init_extra(&state, &scanner);
+    set_scanner_input(&input, scanner);
+
+    // Modules hold unoptimized code; the program is optimized once linked
+    CodegenOptions options;
+    memset(&options, 0, sizeof(options));
+    options.output_kind = OUTPUT_NONE;
+    options.bounds_check = bounds_check;
+
+    // Compiled in the middle of the importer, whose abort target is restored afterwards
+    jmp_buf *outer_target = get_compilation_abort_target();
+    CodegenContext *volatile ctx = NULL;
+    LLVMMemoryBufferRef volatile bitcode = NULL;
+    jmp_buf abort_target;
+
+    if (setjmp(abort_target) == 0) {
+        set_compilation_abort_target(&abort_target);
+
+        if (yyparse(&state, scanner) == 0) {
+            for (Command *cmd = state.cmd_list->head; cmd != NULL; cmd = cmd->next) {
+                if (cmd->type != CMD_FUNC_DEF && cmd->type != CMD_IMPORT) {
+                    fprintf(stderr, "Error: Imported module '%s' can only contain functions and imports, found a statement at line %d\n",
+                            path, cmd->line_number);
+                    abort_compilation();
+                }
+            }
+
+            ctx = init_code_generation(path, state.symbol_table, state.function_table, &options);
+            generate_code_for_command_list(ctx, state.cmd_list);
+            bitcode = write_module_bitcode(ctx);
+        }
+    }
+    set_compilation_abort_target(outer_target);
+
+    if (!bitcode) {
+        fprintf(stderr, "Error: Could not compile module '%s'\n", path);
+    }
+
+    dispose_code_generation(ctx);
+    yylex_destroy(scanner);
+    close_source_input(&input);
+    free_parser_state(&state);
+    return bitcode;
+}
+
+typedef struct CompileQueue {
+    CompileJob *jobs;
+    int job_count;
+    int next_job;
+    pthread_mutex_t lock;
+} CompileQueue;
+
+static void *compile_worker(void *arg) {
+    CompileQueue *queue = (CompileQueue *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->next_job++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->job_count) break;
+
+        compile_file(&queue->jobs[index]);
+    }
+
+    return NULL;
+}
+
+void compile_files_parallel(CompileJob *jobs, int job_count, int thread_count) {
+    if (thread_count > job_count) thread_count = job_count;
+
+    if (thread_count <= 1) {
+        for (int i = 0; i < job_count; i++) {
+            compile_file(&jobs[i]);
+        }
+        return;
+    }
+
+    // Register targets before any worker might race to do it
+    initialize_native_target();
+
+    CompileQueue queue;
+    queue.jobs = jobs;
+    queue.job_count = job_count;
+    queue.next_job = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, COMPILE_THREAD_STACK_SIZE);
+
+    pthread_t *threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    if (!threads) {
+        panic("Error: Memory allocation failed for compile threads\n");
+    }
+
+    int started = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&threads[i], &attr, compile_worker, &queue) != 0) {
+            LOG_WARN("Warning: Could only start %d compile threads\n", started);
+            break;
+        }
+        started++;
+    }
+
+    // Fall back to compiling on this thread if no worker could be started
+    if (started == 0) {
+        compile_worker(&queue);
+    }
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_attr_destroy(&attr);
+    pthread_mutex_destroy(&queue.lock);
+}
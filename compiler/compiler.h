@@ -0,0 +1,86 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "symbol_table.h"
+#include "command.h"
+#include "code_generator.h"
+#include "mem_report.h"
+
+// Worker threads get a generous stack: parser actions keep large buffers
+// on the stack and code generation recurses over nested expressions.
+#define COMPILE_THREAD_STACK_SIZE (16 * 1024 * 1024)
+
+// Diagnostic outputs selectable with --emit
+#define EMIT_AST     (1 << 0)
+#define EMIT_SYMBOLS (1 << 1)
+#define EMIT_IR      (1 << 2)
+
+// Parse-time state of one compilation, shared by the parser and the scanner
+typedef struct ParserState {
+    const char *input_filename;
+    int line_number;
+
+    SymbolTable *symbol_table;
+    FunctionTable *function_table;
+    CommandList *cmd_list;
+    CommandList *current_block;
+    BlockStack *block_stack;
+    ConditionStack *condition_stack;
+    Expression *current_condition;
+
+    TimeReport *time_report;
+
+    // When set, each top-level declaration is generated into this context
+    // and freed as soon as it is reduced instead of staying in cmd_list
+    CodegenContext *codegen;
+
+    // Tokens come from a lexer thread and declarations go to a code
+    // generation thread (--pipeline), NULL runs everything in yyparse
+    struct Pipeline *pipeline;
+
+    // Set by the scanner once it has returned the end of input. With
+    // allow_incomplete_input a syntax error there only sets
+    // incomplete_input, so the REPL can read another line.
+    int at_end_of_input;
+    int allow_incomplete_input;
+    int incomplete_input;
+} ParserState;
+
+// Reentrant scanner interface generated by flex
+int yylex_init_extra(struct ParserState *state, yyscan_t *scanner);
+void yyset_in(FILE *input, yyscan_t scanner);
+struct yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+
+// One input file to compile and what to produce from it
+typedef struct CompileJob {
+    const char *input_filename;
+    char output_filename[1024];
+    char ir_filename[1024];
+    char remarks_filename[1024];
+    int emit_flags;
+    int run_mode;
+    int use_cache;  // Reuse and store outputs in the compilation cache
+    int pipeline;   // Lex, parse and generate code on separate threads
+    int report_times;
+    int report_memory;
+    CodegenOptions options;
+    FunctionCache *function_cache;  // Function IR kept from earlier builds (--watch), or NULL
+    int exit_code;
+    TimeReport times;
+    MemReport memory;
+} CompileJob;
+
+// Lex, parse and generate code for a single file. Errors only abort this
+// compilation. Returns (and stores in job->exit_code) the process exit code.
+int compile_file(CompileJob *job);
+
+// Parse and generate code for a module to be imported (see import.h) on
+// the calling thread with the importer's bounds_check setting. Returns its
+// bitcode, or NULL after reporting errors.
+LLVMMemoryBufferRef compile_module(const char *path, int bounds_check);
+
+// Compile every job on a pool of thread_count worker threads
+void compile_files_parallel(CompileJob *jobs, int job_count, int thread_count);
+
+#endif
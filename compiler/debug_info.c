@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "debug_info.h"
+#include "compiler.h"
+#include "cache.h"
+
+// DWARF base type encodings
+#define DW_ATE_BOOLEAN       0x02
+#define DW_ATE_FLOAT         0x04
+#define DW_ATE_SIGNED        0x05
+#define DW_ATE_UNSIGNED_CHAR 0x08
+
+#define DWARF_VERSION 4
+
+static const char *const type_names[TYPE_UNKNOWN] = { "int", "float", "char", "string", "bool" };
+
+static void add_module_flag(CodegenContext *ctx, const char *name, unsigned value) {
+    LLVMMetadataRef metadata = LLVMValueAsMetadata(LLVMConstInt(LLVMInt32TypeInContext(ctx->context), value, 0));
+    LLVMAddModuleFlag(ctx->module, LLVMModuleFlagBehaviorWarning, name, strlen(name), metadata);
+}
+
+DebugInfo *create_debug_info(CodegenContext *ctx, const char *source_filename) {
+    DebugInfo *debug = (DebugInfo *)calloc(1, sizeof(DebugInfo));
+    if (!debug) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    // Without -g the lines are only kept for --remarks
+    debug->lines_only = !ctx->options.debug_info;
+
+    if (!source_filename || strcmp(source_filename, "-") == 0) {
+        source_filename = "<stdin>";
+    }
+
+    // Relative paths are resolved against the directory the compiler ran in
+    char directory[PATH_MAX];
+    if (!getcwd(directory, sizeof(directory))) {
+        directory[0] = '\0';
+    }
+
+    debug->builder = LLVMCreateDIBuilder(ctx->module);
+    debug->file = LLVMDIBuilderCreateFile(debug->builder, source_filename, strlen(source_filename),
+                                          directory, strlen(directory));
+
+    const char *producer = "ptl compiler " COMPILER_VERSION;
+    debug->compile_unit = LLVMDIBuilderCreateCompileUnit(
+        debug->builder, LLVMDWARFSourceLanguageC, debug->file, producer, strlen(producer),
+        ctx->options.optimization_level > 0, "", 0, 0, "", 0,
+        debug->lines_only ? LLVMDWARFEmissionNone : LLVMDWARFEmissionFull,
+        0, 0, 0, "", 0, "", 0);
+
+    static const unsigned sizes[TYPE_UNKNOWN] = { 32, 32, 8, 8, 8 };
+    static const unsigned encodings[TYPE_UNKNOWN] = {
+        DW_ATE_SIGNED, DW_ATE_FLOAT, DW_ATE_UNSIGNED_CHAR, DW_ATE_UNSIGNED_CHAR, DW_ATE_BOOLEAN
+    };
+    for (int type = 0; type < TYPE_UNKNOWN; type++) {
+        debug->types[type] = LLVMDIBuilderCreateBasicType(debug->builder, type_names[type], strlen(type_names[type]),
+                                                          sizes[type], encodings[type], LLVMDIFlagZero);
+    }
+
+    // Strings are char arrays of 256 bytes, so the element type is char
+    LLVMMetadataRef subrange = LLVMDIBuilderGetOrCreateSubrange(debug->builder, 0, 256);
+    debug->types[TYPE_STRING] = LLVMDIBuilderCreateArrayType(debug->builder, 256 * 8, 8,
+                                                             debug->types[TYPE_CHAR], &subrange, 1);
+
+    add_module_flag(ctx, "Dwarf Version", DWARF_VERSION);
+    add_module_flag(ctx, "Debug Info Version", LLVMDebugMetadataVersion());
+
+    return debug;
+}
+
+static LLVMMetadataRef get_array_debug_type(DebugInfo *debug, DataType type, ArrayDimension *dims) {
+    LLVMMetadataRef element_type = debug->types[type];
+    if (!dims) return element_type;
+
+    int count = 0;
+    uint64_t size_in_bits = type == TYPE_INT || type == TYPE_FLOAT ? 32 : 8;
+    for (ArrayDimension *d = dims; d != NULL; d = d->next) {
+        count++;
+        size_in_bits *= (uint64_t)d->size;
+    }
+
+    LLVMMetadataRef *subranges = (LLVMMetadataRef *)malloc(count * sizeof(LLVMMetadataRef));
+    int i = 0;
+    for (ArrayDimension *d = dims; d != NULL; d = d->next) {
+        subranges[i++] = LLVMDIBuilderGetOrCreateSubrange(debug->builder, 0, d->size);
+    }
+
+    uint32_t align = type == TYPE_INT || type == TYPE_FLOAT ? 32 : 8;
+    LLVMMetadataRef array_type = LLVMDIBuilderCreateArrayType(debug->builder, size_in_bits, align,
+                                                              element_type, subranges, count);
+    free(subranges);
+    return array_type;
+}
+
+static LLVMMetadataRef get_pointer_debug_type(DebugInfo *debug, LLVMMetadataRef pointee) {
+    return LLVMDIBuilderCreatePointerType(debug->builder, pointee, 8 * sizeof(void *), 0, 0, NULL, 0);
+}
+
+// Type of a parameter as the function receives it
+static LLVMMetadataRef get_parameter_debug_type(DebugInfo *debug, Parameter *param) {
+    if (param->array_dims) {
+        return get_pointer_debug_type(debug, get_array_debug_type(debug, param->type, param->array_dims));
+    }
+
+    // String values are passed as a pointer to their characters
+    LLVMMetadataRef type = param->type == TYPE_STRING ? get_pointer_debug_type(debug, debug->types[TYPE_CHAR])
+                                                      : debug->types[param->type];
+    return param->is_reference ? get_pointer_debug_type(debug, type) : type;
+}
+
+LLVMMetadataRef debug_begin_function(CodegenContext *ctx, LLVMValueRef function, Command *definition) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug) return NULL;
+
+    // main holds the top-level statements, which start at the top of the file
+    int line = definition ? definition->line_number : 1;
+    int param_count = 0;
+    if (definition) {
+        for (Parameter *param = definition->data.func_def.params; param != NULL; param = param->next) {
+            param_count++;
+        }
+    }
+
+    LLVMMetadataRef *signature = (LLVMMetadataRef *)malloc((param_count + 1) * sizeof(LLVMMetadataRef));
+    signature[0] = definition ? (definition->data.func_def.return_type == TYPE_UNKNOWN
+                                     ? NULL : debug->types[definition->data.func_def.return_type])
+                              : debug->types[TYPE_INT];
+    if (definition) {
+        int i = 1;
+        for (Parameter *param = definition->data.func_def.params; param != NULL; param = param->next) {
+            signature[i++] = get_parameter_debug_type(debug, param);
+        }
+    }
+    LLVMMetadataRef function_type = LLVMDIBuilderCreateSubroutineType(debug->builder, debug->file, signature,
+                                                                      param_count + 1, LLVMDIFlagZero);
+    free(signature);
+
+    size_t length;
+    const char *name = LLVMGetValueName2(function, &length);
+    LLVMMetadataRef subprogram = LLVMDIBuilderCreateFunction(
+        debug->builder, debug->file, name, length, name, length, debug->file, line, function_type,
+        LLVMGetLinkage(function) == LLVMInternalLinkage, 1, line, LLVMDIFlagPrototyped,
+        ctx->options.optimization_level > 0);
+    LLVMSetSubprogram(function, subprogram);
+
+    LLVMMetadataRef outer_scope = debug->scope;
+    debug->scope = subprogram;
+    debug_set_line(ctx, line);
+    return outer_scope;
+}
+
+void debug_end_function(CodegenContext *ctx, LLVMMetadataRef outer_scope) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug) return;
+
+    // The statement that follows in the outer function sets its own line
+    debug->scope = outer_scope;
+    LLVMSetCurrentDebugLocation2(ctx->builder, NULL);
+}
+
+void debug_set_line(CodegenContext *ctx, int line) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug || !debug->scope) return;
+
+    LLVMMetadataRef location = LLVMDIBuilderCreateDebugLocation(ctx->context, line, 0, debug->scope, NULL);
+    LLVMSetCurrentDebugLocation2(ctx->builder, location);
+}
+
+static void insert_declare(CodegenContext *ctx, LLVMValueRef storage, LLVMMetadataRef variable, int line) {
+    DebugInfo *debug = ctx->debug;
+    LLVMMetadataRef location = LLVMDIBuilderCreateDebugLocation(ctx->context, line, 0, debug->scope, NULL);
+    LLVMDIBuilderInsertDeclareAtEnd(debug->builder, storage, variable,
+                                    LLVMDIBuilderCreateExpression(debug->builder, NULL, 0),
+                                    location, LLVMGetInsertBlock(ctx->builder));
+}
+
+void debug_declare_variable(CodegenContext *ctx, const char *name, DataType type,
+                            ArrayDimension *dims, LLVMValueRef storage, int line) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug || debug->lines_only || !storage || type == TYPE_UNKNOWN) return;
+
+    LLVMMetadataRef variable_type = get_array_debug_type(debug, type, dims);
+
+    if (LLVMIsAGlobalVariable(storage)) {
+        LLVMMetadataRef variable = LLVMDIBuilderCreateGlobalVariableExpression(
+            debug->builder, debug->compile_unit, name, strlen(name), name, strlen(name), debug->file, line,
+            variable_type, 0, LLVMDIBuilderCreateExpression(debug->builder, NULL, 0), NULL, 0);
+        LLVMGlobalSetMetadata(storage, LLVMGetMDKindIDInContext(ctx->context, "dbg", 3), variable);
+    } else if (debug->scope) {
+        LLVMMetadataRef variable = LLVMDIBuilderCreateAutoVariable(
+            debug->builder, debug->scope, name, strlen(name), debug->file, line, variable_type, 0,
+            LLVMDIFlagZero, 0);
+        insert_declare(ctx, storage, variable, line);
+    }
+}
+
+void debug_declare_parameter(CodegenContext *ctx, Parameter *param, int arg_number, LLVMValueRef value, int line) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug || debug->lines_only || !debug->scope || param->type == TYPE_UNKNOWN) return;
+
+    LLVMMetadataRef variable = LLVMDIBuilderCreateParameterVariable(
+        debug->builder, debug->scope, param->name, strlen(param->name), arg_number, debug->file, line,
+        get_parameter_debug_type(debug, param), 0, LLVMDIFlagZero);
+
+    if (LLVMIsAAllocaInst(value)) {
+        insert_declare(ctx, value, variable, line);
+    } else {
+        LLVMMetadataRef location = LLVMDIBuilderCreateDebugLocation(ctx->context, line, 0, debug->scope, NULL);
+        LLVMDIBuilderInsertDbgValueAtEnd(debug->builder, value, variable,
+                                         LLVMDIBuilderCreateExpression(debug->builder, NULL, 0),
+                                         location, LLVMGetInsertBlock(ctx->builder));
+    }
+}
+
+void finish_debug_info(CodegenContext *ctx) {
+    DebugInfo *debug = ctx->debug;
+    if (!debug || debug->finished) return;
+
+    LLVMDIBuilderFinalize(debug->builder);
+    debug->finished = 1;
+}
+
+void free_debug_info(DebugInfo *debug) {
+    if (!debug) return;
+
+    // A build that gave up may not have finished its debug info
+    if (!debug->finished) LLVMDIBuilderFinalize(debug->builder);
+    LLVMDisposeDIBuilder(debug->builder);
+    free(debug);
+}
@@ -0,0 +1,49 @@
+#ifndef DEBUG_INFO_H
+#define DEBUG_INFO_H
+
+#include <llvm-c/DebugInfo.h>
+
+#include "code_generator.h"
+
+// DWARF debug info of a -g build: a compile unit for the .ptl file, a
+// subprogram for main and each function, the line of each statement and
+// the variables and parameters, so debuggers and profilers map machine
+// code back to source lines. Every function below does nothing when
+// ctx->debug is NULL.
+
+typedef struct DebugInfo {
+    LLVMDIBuilderRef builder;
+    LLVMMetadataRef file;
+    LLVMMetadataRef compile_unit;
+    LLVMMetadataRef scope;                 // Subprogram of the function being generated
+    LLVMMetadataRef types[TYPE_UNKNOWN];   // Basic type of each DataType
+    int lines_only;  // Only statement lines, which --remarks needs; nothing is emitted
+    int finished;
+} DebugInfo;
+
+// Set up debug info for ctx->module; source_filename is the .ptl file
+DebugInfo *create_debug_info(CodegenContext *ctx, const char *source_filename);
+
+// Attach a subprogram to function and make it the scope of what follows.
+// Returns the previous scope, for debug_end_function.
+LLVMMetadataRef debug_begin_function(CodegenContext *ctx, LLVMValueRef function, Command *definition);
+void debug_end_function(CodegenContext *ctx, LLVMMetadataRef outer_scope);
+
+// Attribute the instructions built from now on to line
+void debug_set_line(CodegenContext *ctx, int line);
+
+// Describe a variable stored in storage, an alloca or a global
+void debug_declare_variable(CodegenContext *ctx, const char *name, DataType type,
+                            ArrayDimension *dims, LLVMValueRef storage, int line);
+
+// Describe parameter arg_number (from 1) of the current function. value is
+// its alloca, or the pointer itself for references and arrays.
+void debug_declare_parameter(CodegenContext *ctx, Parameter *param, int arg_number, LLVMValueRef value, int line);
+
+// Resolve the debug info of ctx->module; needed before it is verified,
+// optimized or written
+void finish_debug_info(CodegenContext *ctx);
+
+void free_debug_info(DebugInfo *debug);
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "function_cache.h"
+#include "command.h"
+#include "hash.h"
+
+static void free_cached_function(CachedFunction *entry) {
+    for (int i = 0; i < entry->symbol_count; i++) {
+        free(entry->symbols[i].name);
+        free(entry->symbols[i].dimensions);
+    }
+    free(entry->symbols);
+    if (entry->bitcode) LLVMDisposeMemoryBuffer(entry->bitcode);
+    free(entry->name);
+    free(entry);
+}
+
+void function_cache_begin_build(FunctionCache *cache) {
+    cache->generated = 0;
+    cache->reused = 0;
+    for (CachedFunction *entry = cache->head; entry != NULL; entry = entry->next) {
+        entry->used = 0;
+    }
+}
+
+void function_cache_end_build(FunctionCache *cache) {
+    CachedFunction **link = &cache->head;
+    while (*link != NULL) {
+        CachedFunction *entry = *link;
+        if (entry->used) {
+            link = &entry->next;
+        } else {
+            *link = entry->next;
+            free_cached_function(entry);
+        }
+    }
+}
+
+void free_function_cache(FunctionCache *cache) {
+    CachedFunction *entry = cache->head;
+    while (entry != NULL) {
+        CachedFunction *next = entry->next;
+        free_cached_function(entry);
+        entry = next;
+    }
+    cache->head = NULL;
+}
+
+CachedFunction *function_cache_lookup(FunctionCache *cache, const char *name, uint64_t key) {
+    for (CachedFunction *entry = cache->head; entry != NULL; entry = entry->next) {
+        if (entry->key == key && strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+CachedFunction *function_cache_store(FunctionCache *cache, const char *name, uint64_t key,
+                                     LLVMMemoryBufferRef bitcode, SymbolTable *table,
+                                     Symbol *previous_head) {
+    // An edited function makes its previous version useless
+    CachedFunction **link = &cache->head;
+    while (*link != NULL) {
+        CachedFunction *entry = *link;
+        if (strcmp(entry->name, name) == 0) {
+            *link = entry->next;
+            free_cached_function(entry);
+        } else {
+            link = &entry->next;
+        }
+    }
+
+    CachedFunction *entry = (CachedFunction *)calloc(1, sizeof(CachedFunction));
+    if (!entry) {
+        fprintf(stderr, "Error: Memory allocation failed for function cache\n");
+        abort_compilation();
+    }
+    entry->name = strdup(name);
+    entry->key = key;
+    entry->bitcode = bitcode;
+    entry->used = 1;
+
+    // New symbols are at the head of the table, newest first
+    for (Symbol *symbol = table->head; symbol != previous_head; symbol = symbol->next) {
+        entry->symbol_count++;
+    }
+    entry->symbols = (CachedSymbol *)calloc(entry->symbol_count ? entry->symbol_count : 1, sizeof(CachedSymbol));
+
+    int index = entry->symbol_count;
+    for (Symbol *symbol = table->head; symbol != previous_head; symbol = symbol->next) {
+        CachedSymbol *cached = &entry->symbols[--index];
+        cached->name = strdup(symbol->name);
+        cached->type = symbol->type;
+        cached->line = symbol->line_defined;
+        if (symbol->is_array) {
+            cached->dimension_count = symbol->num_dimensions;
+            cached->dimensions = (int *)malloc(symbol->num_dimensions * sizeof(int));
+            memcpy(cached->dimensions, symbol->array_dimensions, symbol->num_dimensions * sizeof(int));
+        }
+    }
+
+    entry->next = cache->head;
+    cache->head = entry;
+    return entry;
+}
+
+void function_cache_replay_symbols(const CachedFunction *entry, SymbolTable *table) {
+    for (int i = 0; i < entry->symbol_count; i++) {
+        const CachedSymbol *cached = &entry->symbols[i];
+
+        ArrayDimension *dims = NULL;
+        for (int j = cached->dimension_count - 1; j >= 0; j--) {
+            dims = create_array_dimension(cached->dimensions[j], dims);
+        }
+
+        insert_symbol(table, cached->name, cached->type, cached->line, dims);
+        free_array_dimension(dims);
+    }
+}
+
+uint64_t function_cache_hash_symbols(uint64_t hash, const CachedFunction *entry) {
+    for (int i = 0; i < entry->symbol_count; i++) {
+        const CachedSymbol *cached = &entry->symbols[i];
+        hash = fnv1a_update_string(hash, cached->name);
+        hash = fnv1a_update_int(hash, cached->type);
+        hash = fnv1a_update(hash, cached->dimensions, cached->dimension_count * sizeof(int));
+        hash = fnv1a_update_int(hash, cached->dimension_count);
+    }
+    return fnv1a_update_int(hash, entry->symbol_count);
+}
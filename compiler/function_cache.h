@@ -0,0 +1,61 @@
+#ifndef FUNCTION_CACHE_H
+#define FUNCTION_CACHE_H
+
+#include <stdint.h>
+#include <llvm-c/Core.h>
+#include "symbol_table.h"
+
+// A symbol that generating a function inserted into the shared symbol
+// table. Reusing the function inserts it again, so later code sees the
+// same table.
+typedef struct CachedSymbol {
+    char *name;
+    DataType type;
+    int line;
+    int *dimensions;
+    int dimension_count;
+} CachedSymbol;
+
+// Unoptimized IR of one top-level function definition, as bitcode so it
+// outlives the LLVM context of the build that generated it
+typedef struct CachedFunction {
+    char *name;
+    uint64_t key;  // Hash of the definition and of everything visible to it
+    LLVMMemoryBufferRef bitcode;
+    CachedSymbol *symbols;
+    int symbol_count;
+    int used;      // Needed by the current build
+    struct CachedFunction *next;
+} CachedFunction;
+
+// Function IR kept between the builds of --watch
+typedef struct FunctionCache {
+    CachedFunction *head;
+    int generated;  // Functions the last build generated from scratch
+    int reused;     // Functions the last build took from the cache
+} FunctionCache;
+
+// Reset the counters and usage marks before generating code
+void function_cache_begin_build(FunctionCache *cache);
+
+// Drop the entries the finished build did not use
+void function_cache_end_build(FunctionCache *cache);
+
+void free_function_cache(FunctionCache *cache);
+
+CachedFunction *function_cache_lookup(FunctionCache *cache, const char *name, uint64_t key);
+
+// Store the bitcode of a freshly generated function, taking ownership of
+// it, along with the symbols inserted into table since previous_head.
+// Replaces any older entry with the same name.
+CachedFunction *function_cache_store(FunctionCache *cache, const char *name, uint64_t key,
+                                     LLVMMemoryBufferRef bitcode, SymbolTable *table,
+                                     Symbol *previous_head);
+
+// Insert the symbols recorded for entry, in their original order
+void function_cache_replay_symbols(const CachedFunction *entry, SymbolTable *table);
+
+// Fold the recorded symbols of entry into hash
+uint64_t function_cache_hash_symbols(uint64_t hash, const CachedFunction *entry);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit FNV-1a, used for cache keys. Start from FNV_OFFSET_BASIS and feed
+// every field that can change the result.
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+static inline uint64_t fnv1a_update(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Strings are hashed with their terminator so adjacent fields cannot run together
+static inline uint64_t fnv1a_update_string(uint64_t hash, const char *text) {
+    if (!text) text = "";
+    return fnv1a_update(hash, text, strlen(text) + 1);
+}
+
+static inline uint64_t fnv1a_update_int(uint64_t hash, int value) {
+    return fnv1a_update(hash, &value, sizeof(value));
+}
+
+#endif
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/Linker.h>
+
+#include "import.h"
+#include "compiler.h"
+#include "cache.h"
+#include "hash.h"
+
+// Modules being compiled on this thread, innermost first, to catch cycles
+typedef struct ImportFrame {
+    const char *path;
+    struct ImportFrame *outer;
+} ImportFrame;
+
+static __thread ImportFrame *compiling_modules = NULL;
+
+int resolve_import_path(const char *importer, const char *path, char resolved[PATH_MAX]) {
+    char candidate[2 * PATH_MAX];
+    const char *slash = strrchr(importer, '/');
+
+    if (path[0] == '/' || slash == NULL) {
+        snprintf(candidate, sizeof(candidate), "%s", path);
+    } else {
+        snprintf(candidate, sizeof(candidate), "%.*s%s", (int)(slash - importer) + 1, importer, path);
+    }
+
+    return realpath(candidate, resolved) != NULL;
+}
+
+static char *read_file(const char *filename, size_t *length) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *text = (char *)malloc(capacity);
+    size_t count;
+    while (text && (count = fread(text + size, 1, capacity - size, file)) > 0) {
+        size += count;
+        if (size == capacity) {
+            capacity *= 2;
+            text = (char *)realloc(text, capacity);
+        }
+    }
+    fclose(file);
+
+    *length = size;
+    return text;
+}
+
+// Find the next `import "path";` in source text from *position on. Skips
+// string and character literals the way the scanner does, so only real
+// import declarations are found.
+static int next_import(const char *text, size_t length, size_t *position, char *path, size_t path_size) {
+    size_t i = *position;
+
+    while (i < length) {
+        char c = text[i];
+
+        if (c == '"') {
+            const char *end = memchr(text + i + 1, '"', length - i - 1);
+            i = end ? (size_t)(end - text) + 1 : length;
+        } else if (c == '\'' && i + 2 < length && text[i + 2] == '\'') {
+            i += 3;
+        } else if (isalpha((unsigned char)c) || c == '_') {
+            size_t start = i;
+            while (i < length && (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '-')) i++;
+            if (i - start != 6 || strncmp(text + start, "import", 6) != 0) continue;
+
+            while (i < length && isspace((unsigned char)text[i])) i++;
+            if (i >= length || text[i] != '"') continue;
+
+            const char *end = memchr(text + i + 1, '"', length - i - 1);
+            if (!end) break;
+
+            size_t path_length = (size_t)(end - text) - i - 1;
+            if (path_length >= path_size) path_length = path_size - 1;
+            memcpy(path, text + i + 1, path_length);
+            path[path_length] = '\0';
+
+            *position = (size_t)(end - text) + 1;
+            return 1;
+        } else {
+            i++;
+        }
+    }
+
+    *position = length;
+    return 0;
+}
+
+typedef struct PathList {
+    char **paths;
+    int count;
+    int capacity;
+} PathList;
+
+// Returns 0 if path is already in list
+static int add_path(PathList *list, const char *path) {
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->paths[i], path) == 0) return 0;
+    }
+
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 8;
+        list->paths = (char **)realloc(list->paths, list->capacity * sizeof(char *));
+    }
+    list->paths[list->count++] = strdup(path);
+    return 1;
+}
+
+static int hash_closure(uint64_t *hash, const char *filename, PathList *visited) {
+    size_t length;
+    char *text = read_file(filename, &length);
+    if (!text) return 0;
+
+    *hash = fnv1a_update(*hash, text, length);
+    *hash = fnv1a_update_int(*hash, (int)length);
+
+    size_t position = 0;
+    char path[PATH_MAX];
+    char resolved[PATH_MAX];
+    while (next_import(text, length, &position, path, sizeof(path))) {
+        // Missing modules are reported by the parser
+        if (!resolve_import_path(filename, path, resolved)) continue;
+
+        *hash = fnv1a_update_string(*hash, resolved);
+        if (add_path(visited, resolved)) {
+            hash_closure(hash, resolved, visited);
+        }
+    }
+
+    free(text);
+    return 1;
+}
+
+int hash_import_closure(uint64_t *hash, const char *filename) {
+    PathList visited = { NULL, 0, 0 };
+    int ok = hash_closure(hash, filename, &visited);
+
+    for (int i = 0; i < visited.count; i++) {
+        free(visited.paths[i]);
+    }
+    free(visited.paths);
+    return ok;
+}
+
+// Cached bitcode of the module, or compile it on this thread
+static LLVMMemoryBufferRef load_module_bitcode(const char *path, int bounds_check) {
+    for (ImportFrame *frame = compiling_modules; frame != NULL; frame = frame->outer) {
+        if (strcmp(frame->path, path) == 0) {
+            fprintf(stderr, "Error: Import cycle through module '%s'\n", path);
+            return NULL;
+        }
+    }
+
+    char key[CACHE_KEY_SIZE];
+    int cacheable = cache_module_key(path, bounds_check, key);
+    if (cacheable) {
+        size_t size;
+        char *data = cache_fetch_data(key, &size);
+        if (data) {
+            LLVMMemoryBufferRef bitcode = LLVMCreateMemoryBufferWithMemoryRangeCopy(data, size, path);
+            free(data);
+            return bitcode;
+        }
+    }
+
+    ImportFrame frame = { path, compiling_modules };
+    compiling_modules = &frame;
+    LLVMMemoryBufferRef bitcode = compile_module(path, bounds_check);
+    compiling_modules = frame.outer;
+
+    if (bitcode && cacheable) {
+        cache_store_data(key, LLVMGetBufferStart(bitcode), LLVMGetBufferSize(bitcode));
+    }
+    return bitcode;
+}
+
+static ImportedModule *find_import(CodegenContext *ctx, const char *path) {
+    for (ImportedModule *import = ctx->imports; import != NULL; import = import->next) {
+        if (strcmp(import->path, path) == 0) return import;
+    }
+    return NULL;
+}
+
+static void declare_module_functions(CodegenContext *ctx, ImportedModule *import) {
+    for (LLVMValueRef function = LLVMGetFirstFunction(import->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
+
+        size_t length;
+        const char *name = LLVMGetValueName2(function, &length);
+        if (LLVMGetNamedFunction(ctx->module, name)) {
+            fprintf(stderr, "Error: Function '%s' imported from '%s' is already defined\n", name, import->path);
+            abort_compilation();
+        }
+        LLVMAddFunction(ctx->module, name, LLVMGlobalGetValueType(function));
+    }
+    import->declared = 1;
+}
+
+static void add_import(CodegenContext *ctx, const char *path, int declare) {
+    ImportedModule *import = find_import(ctx, path);
+
+    if (!import) {
+        LLVMMemoryBufferRef bitcode = load_module_bitcode(path, ctx->options.bounds_check);
+        if (!bitcode) {
+            fprintf(stderr, "Error: Could not import module '%s'\n", path);
+            abort_compilation();
+        }
+
+        LLVMModuleRef module = NULL;
+        int failed = LLVMParseBitcodeInContext2(ctx->context, bitcode, &module);
+        LLVMDisposeMemoryBuffer(bitcode);
+        if (failed) {
+            fprintf(stderr, "Error: Could not read the code of module '%s'\n", path);
+            abort_compilation();
+        }
+
+        import = (ImportedModule *)calloc(1, sizeof(ImportedModule));
+        if (!import) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            abort_compilation();
+        }
+        import->path = strdup(path);
+        import->module = module;
+
+        // Link modules in the order they were first needed
+        ImportedModule **link = &ctx->imports;
+        while (*link != NULL) link = &(*link)->next;
+        *link = import;
+
+        // The module calls into the modules it imported, so the program needs them as well
+        unsigned count = LLVMGetNamedMetadataNumOperands(module, IMPORTS_METADATA);
+        if (count > 0) {
+            LLVMValueRef *nodes = (LLVMValueRef *)malloc(count * sizeof(LLVMValueRef));
+            LLVMGetNamedMetadataOperands(module, IMPORTS_METADATA, nodes);
+
+            for (unsigned i = 0; i < count; i++) {
+                LLVMValueRef operand;
+                LLVMGetMDNodeOperands(nodes[i], &operand);
+
+                unsigned length;
+                const char *needed = LLVMGetMDString(operand, &length);
+                char needed_path[PATH_MAX];
+                snprintf(needed_path, sizeof(needed_path), "%.*s", (int)length, needed);
+                add_import(ctx, needed_path, 0);
+            }
+            free(nodes);
+        }
+    }
+
+    if (declare && !import->declared) {
+        declare_module_functions(ctx, import);
+    }
+}
+
+void import_module(CodegenContext *ctx, const char *path) {
+    add_import(ctx, path, 1);
+}
+
+void link_imported_modules(CodegenContext *ctx) {
+    for (ImportedModule *import = ctx->imports; import != NULL; import = import->next) {
+        if (!import->module) continue;
+
+        // Linking consumes the module
+        LLVMModuleRef module = import->module;
+        import->module = NULL;
+        if (LLVMLinkModules2(ctx->module, module)) {
+            fprintf(stderr, "Error: Could not link module '%s'\n", import->path);
+            abort_compilation();
+        }
+    }
+}
+
+LLVMMemoryBufferRef write_module_bitcode(CodegenContext *ctx) {
+    LLVMDeleteFunction(ctx->main_function);
+    ctx->main_function = NULL;
+
+    for (ImportedModule *import = ctx->imports; import != NULL; import = import->next) {
+        LLVMValueRef path = LLVMMDStringInContext(ctx->context, import->path, strlen(import->path));
+        LLVMAddNamedMetadataOperand(ctx->module, IMPORTS_METADATA, LLVMMDNodeInContext(ctx->context, &path, 1));
+    }
+
+    return LLVMWriteBitcodeToMemoryBuffer(ctx->module);
+}
+
+void free_imported_modules(ImportedModule *imports) {
+    while (imports != NULL) {
+        ImportedModule *next = imports->next;
+        if (imports->module) LLVMDisposeModule(imports->module);
+        free(imports->path);
+        free(imports);
+        imports = next;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "code_generator.h"
+
+// import "geometry.ptl"; makes the functions of another .ptl file callable.
+// Each imported module is compiled on its own into bitcode that holds its
+// functions and the list of modules it needs in turn, and that bitcode is
+// kept in the compilation cache. The importer declares the functions of the
+// module; every module of the program is linked into it once, before the
+// optimization pipeline runs. Imported modules hold only functions and
+// imports, and their functions are not visible to modules importing them.
+
+#define IMPORTS_METADATA "ptl.imports"  // Named metadata listing the modules a module needs
+
+typedef struct ImportedModule {
+    char *path;            // Canonical path of the .ptl file
+    LLVMModuleRef module;  // Its code, until linked into the program
+    int declared;          // Its functions are declared in the importer
+    struct ImportedModule *next;
+} ImportedModule;
+
+// Resolve path relative to the directory of importer into a canonical path.
+// Returns 0 if there is no such file.
+int resolve_import_path(const char *importer, const char *path, char resolved[PATH_MAX]);
+
+// Fold the source of filename and of every module it imports, directly or
+// not, into hash. Returns 0 if filename cannot be read.
+int hash_import_closure(uint64_t *hash, const char *filename);
+
+// Load the module at path (compiling it unless cached), declare its
+// functions in ctx and queue it and the modules it needs for linking
+void import_module(CodegenContext *ctx, const char *path);
+
+// Link the queued modules into ctx->module
+void link_imported_modules(CodegenContext *ctx);
+
+// Turn the code generated for an imported module into its bitcode: drop
+// main and record the modules it needs
+LLVMMemoryBufferRef write_module_bitcode(CodegenContext *ctx);
+
+void free_imported_modules(ImportedModule *imports);
+
+#endif
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "cache.h"
+#include "server.h"
+#include "watch.h"
+#include "repl.h"
+#include "protocol.h"
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--run] [--pipeline] [--codegen-threads=<n>] [--emit=bc|obj|exe,ast,symbols,ir] [-O0|-O1|-O2|-O3] [-g] [--bounds-check] "
+                    "<input_filename> [output_filename]\n", program);
+    fprintf(stderr, "       %s -j <threads> [options] <input_filename>...\n", program);
+    fprintf(stderr, "       %s --watch [options] <input_filename> [output_filename]\n", program);
+    fprintf(stderr, "       %s --repl [-O0|-O1|-O2|-O3]\n", program);
+    fprintf(stderr, "       %s --serve [socket_path]\n", program);
+    fprintf(stderr, "Report options: [--time-report[=json]] [--mem-report] [--remarks[=yaml|json]]\n");
+    fprintf(stderr, "Profile options: [--instrument[=<profile>]] [--profile-use=<profile>]\n");
+    fprintf(stderr, "Float options: [--fast-math] [--fp-contract] [--reassoc]\n");
+    fprintf(stderr, "Target options: [--mtriple=<triple>] [--mcpu=<cpu>|--march=native] [--mattr=<+feature,-feature,...>]\n");
+    fprintf(stderr, "Cache options: [--no-cache] [--cache-dir=<dir>] [--cache-size=<MB>] [--cache-stats]\n");
+}
+
+// Parse a comma separated --emit list such as "exe,ir,ast"
+static int parse_emit_list(const char *list, OutputKind *output_kind, int *emit_flags) {
+    char *copy = strdup(list);
+    char *save = NULL;
+    int found_output = 0;
+
+    for (char *kind = strtok_r(copy, ",", &save); kind != NULL; kind = strtok_r(NULL, ",", &save)) {
+        if (strcmp(kind, "bc") == 0) {
+            *output_kind = OUTPUT_BITCODE;
+            found_output = 1;
+        } else if (strcmp(kind, "obj") == 0) {
+            *output_kind = OUTPUT_OBJECT;
+            found_output = 1;
+        } else if (strcmp(kind, "exe") == 0) {
+            *output_kind = OUTPUT_EXECUTABLE;
+            found_output = 1;
+        } else if (strcmp(kind, "ast") == 0) {
+            *emit_flags |= EMIT_AST;
+        } else if (strcmp(kind, "symbols") == 0) {
+            *emit_flags |= EMIT_SYMBOLS;
+        } else if (strcmp(kind, "ir") == 0) {
+            *emit_flags |= EMIT_IR;
+        } else {
+            fprintf(stderr, "Error: Unknown output kind '%s'\n", kind);
+            free(copy);
+            return 0;
+        }
+    }
+
+    // Asking only for diagnostics skips writing the binary output
+    if (!found_output && *output_kind == OUTPUT_BITCODE) {
+        *output_kind = OUTPUT_NONE;
+    }
+
+    free(copy);
+    return 1;
+}
+
+// Copy path into dest with its extension replaced by ext
+static void replace_extension(char *dest, size_t size, const char *path, const char *ext) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t prefix_len = (dot && (!slash || dot > slash)) ? (size_t)(dot - path) : strlen(path);
+
+    snprintf(dest, size, "%.*s%s", (int)prefix_len, path, ext);
+}
+
+// Fill in output names for a job whose input and options are already set
+static void name_job_outputs(CompileJob *job, const char *explicit_output) {
+    size_t size = sizeof(job->output_filename);
+    // Source read from stdin is named like cc names it: a.bc, a.o, a
+    const char *input = strcmp(job->input_filename, "-") == 0 ? "a" : job->input_filename;
+
+    if (explicit_output) {
+        snprintf(job->output_filename, size, "%s", explicit_output);
+    } else if (job->options.output_kind == OUTPUT_OBJECT) {
+        replace_extension(job->output_filename, size, input, ".o");
+    } else if (job->options.output_kind == OUTPUT_EXECUTABLE) {
+        replace_extension(job->output_filename, size, input, "");
+        if (strcmp(job->output_filename, input) == 0 && input == job->input_filename) {
+            strncat(job->output_filename, ".out", size - strlen(job->output_filename) - 1);
+        }
+    } else {
+        replace_extension(job->output_filename, size, input, ".bc");
+    }
+
+    if (job->emit_flags & EMIT_IR) {
+        replace_extension(job->ir_filename, sizeof(job->ir_filename), job->output_filename, ".ll");
+        job->options.ir_output_filename = job->ir_filename;
+    }
+
+    if (job->options.remarks == REMARKS_YAML || job->options.remarks == REMARKS_JSON) {
+        replace_extension(job->remarks_filename, sizeof(job->remarks_filename), job->output_filename,
+                          job->options.remarks == REMARKS_YAML ? ".remarks.yaml" : ".remarks.json");
+        job->options.remarks_filename = job->remarks_filename;
+    }
+}
+
+static int run_compiler(int argc, char *argv[]) {
+    CompileJob defaults;
+    memset(&defaults, 0, sizeof(defaults));
+    defaults.options.output_kind = OUTPUT_BITCODE;
+    defaults.use_cache = 1;
+
+    const char *cache_dir = NULL;
+    long cache_size = 0;
+    int show_cache_stats = 0;
+    int time_report_json = 0;
+    int watch = 0;
+    int repl = 0;
+
+    char **inputs = (char **)malloc(argc * sizeof(char *));
+    int input_count = 0;
+    int thread_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--run") == 0) {
+            defaults.run_mode = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            defaults.pipeline = 1;
+        } else if (strncmp(argv[i], "--codegen-threads=", 18) == 0) {
+            defaults.options.codegen_threads = atoi(argv[i] + 18);
+            if (defaults.options.codegen_threads <= 0) {
+                fprintf(stderr, "Error: Invalid thread count '%s'\n", argv[i] + 18);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--repl") == 0) {
+            repl = 1;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (!parse_emit_list(argv[i] + 7, &defaults.options.output_kind, &defaults.emit_flags)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--time-report") == 0) {
+            defaults.report_times = 1;
+        } else if (strcmp(argv[i], "--time-report=json") == 0) {
+            defaults.report_times = 1;
+            time_report_json = 1;
+        } else if (strcmp(argv[i], "--instrument") == 0) {
+            defaults.options.instrument_filename = PROFILE_DEFAULT_FILENAME;
+        } else if (strncmp(argv[i], "--instrument=", 13) == 0) {
+            defaults.options.instrument_filename = argv[i] + 13;
+        } else if (strncmp(argv[i], "--profile-use=", 14) == 0) {
+            defaults.options.profile_use_filename = argv[i] + 14;
+        } else if (strncmp(argv[i], "--mtriple=", 10) == 0) {
+            defaults.options.target_triple = argv[i] + 10;
+        } else if (strncmp(argv[i], "--mcpu=", 7) == 0) {
+            defaults.options.target_cpu = argv[i] + 7;
+        } else if (strncmp(argv[i], "--march=", 8) == 0) {
+            // As with clang on x86, the architecture names a CPU
+            defaults.options.target_cpu = argv[i] + 8;
+        } else if (strncmp(argv[i], "--mattr=", 8) == 0) {
+            defaults.options.target_features = argv[i] + 8;
+        } else if (strcmp(argv[i], "--mem-report") == 0) {
+            defaults.report_memory = 1;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            defaults.use_cache = 0;
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            cache_size = atol(argv[i] + 13) * 1024 * 1024;
+            if (cache_size <= 0) {
+                fprintf(stderr, "Error: Invalid cache size '%s'\n", argv[i] + 13);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            show_cache_stats = 1;
+        } else if (strcmp(argv[i], "--fast-math") == 0) {
+            defaults.options.float_math |= FLOAT_FAST_MATH;
+        } else if (strcmp(argv[i], "--fp-contract") == 0) {
+            defaults.options.float_math |= FLOAT_CONTRACT;
+        } else if (strcmp(argv[i], "--reassoc") == 0) {
+            defaults.options.float_math |= FLOAT_REASSOC;
+        } else if (strcmp(argv[i], "--remarks") == 0) {
+            defaults.options.remarks = REMARKS_TEXT;
+        } else if (strcmp(argv[i], "--remarks=yaml") == 0) {
+            defaults.options.remarks = REMARKS_YAML;
+        } else if (strcmp(argv[i], "--remarks=json") == 0) {
+            defaults.options.remarks = REMARKS_JSON;
+        } else if (strcmp(argv[i], "-g") == 0) {
+            defaults.options.debug_info = 1;
+        } else if (strcmp(argv[i], "--bounds-check") == 0) {
+            defaults.options.bounds_check = 1;
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            const char *count = argv[i][2] != '\0' ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            thread_count = atoi(count);
+            if (thread_count <= 0) {
+                fprintf(stderr, "Error: Invalid thread count '%s'\n", count);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "-O", 2) == 0) {
+            const char *level = argv[i] + 2;
+            if (level[0] == '\0') {
+                defaults.options.optimization_level = 2;
+            } else if (level[0] >= '0' && level[0] <= '3' && level[1] == '\0') {
+                defaults.options.optimization_level = level[0] - '0';
+            } else {
+                fprintf(stderr, "Error: Invalid optimization level '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            inputs[input_count++] = argv[i];
+        }
+    }
+
+    if (defaults.options.instrument_filename && defaults.options.profile_use_filename) {
+        fprintf(stderr, "Error: --instrument and --profile-use cannot be combined\n");
+        return 1;
+    }
+
+    // JIT code runs on this machine
+    if ((repl || defaults.run_mode) && defaults.options.target_triple) {
+        fprintf(stderr, "Error: --mtriple cannot be used with --run or --repl\n");
+        return 1;
+    }
+
+    if (repl) {
+        if (defaults.options.instrument_filename || defaults.options.profile_use_filename) {
+            fprintf(stderr, "Error: --repl does not support profiles\n");
+            return 1;
+        }
+        if (input_count > 0) {
+            fprintf(stderr, "Error: --repl reads its input from stdin\n");
+            return 1;
+        }
+        return run_repl(&defaults.options);
+    }
+
+    if (input_count == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Without -j the second positional argument keeps naming the output file
+    const char *explicit_output = NULL;
+    if (thread_count == 0) {
+        if (input_count > 2) {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n", inputs[2]);
+            return 1;
+        }
+        if (input_count == 2) {
+            explicit_output = inputs[1];
+        }
+        input_count = 1;
+    }
+
+    if (defaults.run_mode && input_count > 1) {
+        fprintf(stderr, "Error: --run takes a single input file\n");
+        return 1;
+    }
+
+    if (watch && (input_count > 1 || strcmp(inputs[0], "-") == 0)) {
+        fprintf(stderr, "Error: --watch takes a single input file\n");
+        return 1;
+    }
+
+    // Watch builds reuse functions in memory; the output cache would skip that
+    if (watch) {
+        defaults.use_cache = 0;
+    }
+
+    if (defaults.use_cache) {
+        cache_configure(cache_dir, cache_size);
+    }
+
+    CompileJob *jobs = (CompileJob *)malloc(input_count * sizeof(CompileJob));
+    for (int i = 0; i < input_count; i++) {
+        jobs[i] = defaults;
+        jobs[i].input_filename = inputs[i];
+        name_job_outputs(&jobs[i], explicit_output);
+    }
+
+    if (watch) {
+        return watch_and_compile(&jobs[0]);
+    }
+
+    compile_files_parallel(jobs, input_count, thread_count);
+
+    if (defaults.report_times) {
+        if (time_report_json) {
+            fprintf(stderr, "{\"files\": [");
+            for (int i = 0; i < input_count; i++) {
+                if (i > 0) fprintf(stderr, ", ");
+                print_time_report_json(stderr, jobs[i].input_filename, &jobs[i].times);
+            }
+            fprintf(stderr, "]}\n");
+        } else {
+            for (int i = 0; i < input_count; i++) {
+                print_time_report(stderr, jobs[i].input_filename, &jobs[i].times);
+            }
+        }
+    }
+
+    if (defaults.report_memory) {
+        for (int i = 0; i < input_count; i++) {
+            print_mem_report(stderr, jobs[i].input_filename, &jobs[i].memory);
+        }
+    }
+
+    if (show_cache_stats) {
+        print_cache_stats(stderr);
+    }
+
+    int exit_code = 0;
+    for (int i = 0; i < input_count; i++) {
+        if (jobs[i].exit_code != 0) {
+            // A single compilation reports the program's own exit code
+            exit_code = input_count == 1 ? jobs[i].exit_code : 1;
+        }
+    }
+
+    free(jobs);
+    free(inputs);
+
+    return exit_code;
+}
+
+int main(int argc, char *argv[]) {
+    // Resident mode: each request runs run_compiler in a child forked from this process
+    if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+        char socket_path[1024];
+        if (argc > 3) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (argc == 3) {
+            snprintf(socket_path, sizeof(socket_path), "%s", argv[2]);
+        } else {
+            default_server_socket_path(socket_path, sizeof(socket_path));
+        }
+        return serve_compile_requests(socket_path, run_compiler);
+    }
+
+    return run_compiler(argc, argv);
+}
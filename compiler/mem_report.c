@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "mem_report.h"
+
+static const char *kind_names[ALLOC_KIND_COUNT] = {
+    "Expression",
+    "Command",
+    "ExpressionList",
+    "CommandList",
+    "Symbol",
+    "ValueMap",
+    "string",
+    "other",
+};
+
+static const char *checkpoint_names[RSS_CHECKPOINT_COUNT] = {
+    "after parse",
+    "after codegen",
+    "after output",
+};
+
+static __thread MemReport *current_mem_report;
+
+void set_mem_report(MemReport *report) {
+    current_mem_report = report;
+}
+
+static void record_allocation(AllocKind kind, size_t size) {
+    MemReport *report = current_mem_report;
+    CompilePhase phase = report->phases ? report->phases->current : PHASE_OTHER;
+
+    report->kind_count[kind]++;
+    report->kind_bytes[kind] += size;
+    report->phase_count[phase]++;
+    report->phase_bytes[phase] += size;
+}
+
+void *tracked_malloc(AllocKind kind, size_t size) {
+    void *memory = malloc(size);
+    if (memory && current_mem_report) {
+        record_allocation(kind, size);
+    }
+    return memory;
+}
+
+void *tracked_calloc(AllocKind kind, size_t count, size_t size) {
+    void *memory = calloc(count, size);
+    if (memory && current_mem_report) {
+        record_allocation(kind, count * size);
+    }
+    return memory;
+}
+
+char *tracked_strdup(const char *text) {
+    char *copy = strdup(text);
+    if (copy && current_mem_report) {
+        record_allocation(ALLOC_STRING, strlen(text) + 1);
+    }
+    return copy;
+}
+
+void mem_report_sample_rss(MemReport *report, RssCheckpoint checkpoint) {
+    if (!report) return;
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        report->peak_rss_kb[checkpoint] = usage.ru_maxrss;
+    }
+}
+
+void print_mem_report(FILE *out, const char *filename, const MemReport *report) {
+    long total_count = 0;
+    long total_bytes = 0;
+    for (int i = 0; i < ALLOC_KIND_COUNT; i++) {
+        total_count += report->kind_count[i];
+        total_bytes += report->kind_bytes[i];
+    }
+
+    fprintf(out, "Memory report for %s\n", filename);
+    fprintf(out, "  %-16s %10s %12s %10s\n", "node kind", "allocs", "bytes", "avg");
+    for (int i = 0; i < ALLOC_KIND_COUNT; i++) {
+        if (report->kind_count[i] == 0) continue;
+
+        fprintf(out, "  %-16s %10ld %12ld %10.1f\n", kind_names[i], report->kind_count[i],
+                report->kind_bytes[i], (double)report->kind_bytes[i] / report->kind_count[i]);
+    }
+    fprintf(out, "  %-16s %10ld %12ld\n", "total", total_count, total_bytes);
+
+    fprintf(out, "  %-16s %10s %12s\n", "phase", "allocs", "bytes");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (report->phase_count[i] == 0) continue;
+
+        fprintf(out, "  %-16s %10ld %12ld\n", phase_name(i), report->phase_count[i], report->phase_bytes[i]);
+    }
+
+    // LLVM allocates through its own allocators, so its share only shows up here
+    for (int i = 0; i < RSS_CHECKPOINT_COUNT; i++) {
+        if (report->peak_rss_kb[i] == 0) continue;
+
+        fprintf(out, "  peak RSS %-13s %10ld KB\n", checkpoint_names[i], report->peak_rss_kb[i]);
+    }
+}
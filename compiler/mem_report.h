@@ -0,0 +1,52 @@
+#ifndef MEM_REPORT_H
+#define MEM_REPORT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "time_report.h"
+
+// What a compiler allocation is for
+typedef enum {
+    ALLOC_EXPRESSION,
+    ALLOC_COMMAND,
+    ALLOC_EXPRESSION_LIST,
+    ALLOC_COMMAND_LIST,
+    ALLOC_SYMBOL,
+    ALLOC_VALUE_MAP,
+    ALLOC_STRING,
+    ALLOC_OTHER,
+    ALLOC_KIND_COUNT
+} AllocKind;
+
+// Points at which the peak resident set size is sampled
+typedef enum {
+    RSS_AFTER_PARSE,
+    RSS_AFTER_CODEGEN,
+    RSS_AFTER_OUTPUT,
+    RSS_CHECKPOINT_COUNT
+} RssCheckpoint;
+
+typedef struct MemReport {
+    long kind_count[ALLOC_KIND_COUNT];
+    long kind_bytes[ALLOC_KIND_COUNT];
+    long phase_count[PHASE_COUNT];
+    long phase_bytes[PHASE_COUNT];
+    long peak_rss_kb[RSS_CHECKPOINT_COUNT];
+
+    const TimeReport *phases;  // Supplies the running phase of each allocation
+} MemReport;
+
+// Attribute the calling thread's allocations to report (NULL stops tracking)
+void set_mem_report(MemReport *report);
+
+// malloc/calloc/strdup that also record the allocation in the thread's report
+void *tracked_malloc(AllocKind kind, size_t size);
+void *tracked_calloc(AllocKind kind, size_t count, size_t size);
+char *tracked_strdup(const char *text);
+
+// Record the process peak RSS. With -j every worker shares one process.
+void mem_report_sample_rss(MemReport *report, RssCheckpoint checkpoint);
+
+void print_mem_report(FILE *out, const char *filename, const MemReport *report);
+
+#endif
@@ -1,25 +1,32 @@
+%code requires {
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+struct ParserState;
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "symbol_table.h"
 #include "command.h"
-#include "code_generator.h"
-
-extern int line_number;
-extern FILE *yyin;
+#include "compiler.h"
+#include "pipeline.h"
+#include "import.h"
+%}
 
-SymbolTable *symbol_table;
-FunctionTable *function_table;
-CommandList *cmd_list;
-CommandList *current_block;
-BlockStack *block_stack;
-ConditionStack *condition_stack;
-Expression *current_condition;
+%code {
+int yylex(YYSTYPE *yylval_param, struct ParserState *state, yyscan_t scanner);
+int yyerror(ParserState *state, yyscan_t scanner, const char *s);
+static void stream_declarations(ParserState *state);
+}
 
-int yylex(void);
-int yyerror(char *s);
-%}
+%define api.pure full
+%parse-param {struct ParserState *state} {yyscan_t scanner}
+%lex-param {struct ParserState *state} {yyscan_t scanner}
 
 %union {
     char *sval;
@@ -43,7 +50,7 @@ int yyerror(char *s);
 %token INT FLOAT CHAR STRING BOOL TRUE FALSE DO WHILE REPEAT UNTIL IF THEN ELSE END
 %token WRITE READ EQUAL ASSIGNMENT LT GT GE LE NEQUAL PLUS MINUS TIMES DIVIDE
 %token LPAREN RPAREN SEMICOLON LB RB AND OR NOT
-%token FUNC RETURN ARROW COMMA AMPERSAND LBRACKET RBRACKET
+%token FUNC RETURN ARROW COMMA AMPERSAND LBRACKET RBRACKET IMPORT
 
 %type <expr> exp exp_logic and_exp not_exp rel_exp exp_simple term factor
 %type <ival> comp_op sum
@@ -55,43 +62,59 @@ int yyerror(char *s);
 
 %%
 
-program : { current_block = cmd_list; } declarations
+program : { state->current_block = state->cmd_list; } declarations
         ;
 
 declarations : declaration
              | declarations declaration
              ;
 
-declaration : func_decl
-            | block_item
+declaration : func_decl   { stream_declarations(state); }
+            | import_decl { stream_declarations(state); }
+            | block_item  { stream_declarations(state); }
+            ;
+
+import_decl : IMPORT STRING SEMICOLON
+            {
+                char path[PATH_MAX];
+                if (!resolve_import_path(state->input_filename, $2, path)) {
+                    fprintf(stderr, "Error: Cannot find module '%s' at line %d\n", $2, state->line_number);
+                    free($2);
+                    abort_compilation();
+                }
+                add_command(state->current_block, create_import_command(path, state->line_number));
+                free($2);
+            }
             ;
 
 func_decl : FUNC ID LPAREN parameter_list RPAREN ARROW type
           {
-              push_block(block_stack, current_block);
-              current_block = create_sub_command_list(cmd_list);
+              push_block(state->block_stack, state->current_block);
+              state->current_block = create_sub_command_list(state->cmd_list);
+              $<ival>$ = state->line_number;  // The header line, for debug info
           }
           block END
           {
-              CommandList *func_body = current_block;
-              current_block = pop_block(block_stack);
+              CommandList *func_body = state->current_block;
+              state->current_block = pop_block(state->block_stack);
 
-              Command *func_cmd = create_func_def_command($2, $4, $7, func_body, line_number);
-              add_command(current_block, func_cmd);
+              Command *func_cmd = create_func_def_command($2, $4, $7, func_body, $<ival>8);
+              add_command(state->current_block, func_cmd);
               free($2);
           }
         | FUNC ID LPAREN RPAREN ARROW type
           {
-              push_block(block_stack, current_block);
-              current_block = create_sub_command_list(cmd_list);
+              push_block(state->block_stack, state->current_block);
+              state->current_block = create_sub_command_list(state->cmd_list);
+              $<ival>$ = state->line_number;
           }
           block END
           {
-              CommandList *func_body = current_block;
-              current_block = pop_block(block_stack);
+              CommandList *func_body = state->current_block;
+              state->current_block = pop_block(state->block_stack);
 
-              Command *func_cmd = create_func_def_command($2, NULL, $6, func_body, line_number);
-              add_command(current_block, func_cmd);
+              Command *func_cmd = create_func_def_command($2, NULL, $6, func_body, $<ival>7);
+              add_command(state->current_block, func_cmd);
               free($2);
           }
         ;
@@ -99,15 +122,15 @@ func_decl : FUNC ID LPAREN parameter_list RPAREN ARROW type
 func_call_stmt : ID LPAREN argument_list RPAREN SEMICOLON
                {
                    Expression *call_expr = create_func_call_expression($1, $3);
-                   Command *cmd = create_expression_command(call_expr, line_number);
-                   add_command(current_block, cmd);
+                   Command *cmd = create_expression_command(call_expr, state->line_number);
+                   add_command(state->current_block, cmd);
                    free($1);
                }
                | ID LPAREN RPAREN SEMICOLON
                {
                    Expression *call_expr = create_func_call_expression($1, NULL);
-                   Command *cmd = create_expression_command(call_expr, line_number);
-                   add_command(current_block, cmd);
+                   Command *cmd = create_expression_command(call_expr, state->line_number);
+                   add_command(state->current_block, cmd);
                    free($1);
                }
                ;
@@ -181,158 +204,158 @@ block_item : cond_decl
 
 return_stmt : RETURN exp SEMICOLON
             {
-                Command *cmd = create_return_command($2, line_number);
-                add_command(current_block, cmd);
+                Command *cmd = create_return_command($2, state->line_number);
+                add_command(state->current_block, cmd);
             }
             | RETURN SEMICOLON
             {
-                Command *cmd = create_return_command(NULL, line_number);
-                add_command(current_block, cmd);
+                Command *cmd = create_return_command(NULL, state->line_number);
+                add_command(state->current_block, cmd);
             }
             ;
 
 while_decl  : WHILE exp
             {
-                push_condition(condition_stack, $2);
-                push_block(block_stack, current_block);
-                current_block = create_sub_command_list(cmd_list);
+                push_condition(state->condition_stack, $2);
+                push_block(state->block_stack, state->current_block);
+                state->current_block = create_sub_command_list(state->cmd_list);
             }
             block END
             {
-                current_condition = pop_condition(condition_stack);
-                Command *while_cmd = create_while_command(current_condition, current_block, line_number);
+                state->current_condition = pop_condition(state->condition_stack);
+                Command *while_cmd = create_while_command(state->current_condition, state->current_block, state->line_number);
 
-                current_block = pop_block(block_stack);
-                add_command(current_block, while_cmd);
+                state->current_block = pop_block(state->block_stack);
+                add_command(state->current_block, while_cmd);
             }
 
 do_while_decl : DO
                 {
-                    push_block(block_stack, current_block);
-                    current_block = create_sub_command_list(cmd_list);
+                    push_block(state->block_stack, state->current_block);
+                    state->current_block = create_sub_command_list(state->cmd_list);
                 }
                 block WHILE exp END
                 {
-                    current_condition = $5;
-                    Command *do_while_cmd = create_do_while_command(current_condition, current_block, line_number);
+                    state->current_condition = $5;
+                    Command *do_while_cmd = create_do_while_command(state->current_condition, state->current_block, state->line_number);
 
-                    current_block = pop_block(block_stack);
-                    add_command(current_block, do_while_cmd);
+                    state->current_block = pop_block(state->block_stack);
+                    add_command(state->current_block, do_while_cmd);
                 }
 
 repeat_until_decl: REPEAT
                 {
-                    push_block(block_stack, current_block);
-                    current_block = create_sub_command_list(cmd_list);
+                    push_block(state->block_stack, state->current_block);
+                    state->current_block = create_sub_command_list(state->cmd_list);
                 }
             block UNTIL NUMBER END
                 {
                     int times = $5;
-                    Command *repeat_until_cmd = create_repeat_until_command(times, current_block, line_number);
+                    Command *repeat_until_cmd = create_repeat_until_command(times, state->current_block, state->line_number);
 
-                    current_block = pop_block(block_stack);
-                    add_command(current_block, repeat_until_cmd);
+                    state->current_block = pop_block(state->block_stack);
+                    add_command(state->current_block, repeat_until_cmd);
                 }
 
 if_part     : IF exp THEN
             {
-                push_block(block_stack, current_block);
-                push_condition(condition_stack, $2);
+                push_block(state->block_stack, state->current_block);
+                push_condition(state->condition_stack, $2);
 
-                $$ = create_sub_command_list(cmd_list);
-                current_block = $$;
+                $$ = create_sub_command_list(state->cmd_list);
+                state->current_block = $$;
             }
             ;
 
 cond_decl   : if_part block END
             {
-                current_condition = pop_condition(condition_stack);
-                Command *if_cmd = create_if_command(current_condition, $1, line_number);
+                state->current_condition = pop_condition(state->condition_stack);
+                Command *if_cmd = create_if_command(state->current_condition, $1, state->line_number);
 
-                current_block = pop_block(block_stack);
-                add_command(current_block, if_cmd);
+                state->current_block = pop_block(state->block_stack);
+                add_command(state->current_block, if_cmd);
             }
             | if_part block ELSE
             {
-                current_block = pop_block(block_stack);
-                push_block(block_stack, current_block);
-                current_block = create_sub_command_list(cmd_list);
+                state->current_block = pop_block(state->block_stack);
+                push_block(state->block_stack, state->current_block);
+                state->current_block = create_sub_command_list(state->cmd_list);
             }
             block END
             {
-                current_condition = pop_condition(condition_stack);
-                Command *if_else_cmd = create_if_else_command(current_condition, $1, current_block, line_number);
+                state->current_condition = pop_condition(state->condition_stack);
+                Command *if_else_cmd = create_if_else_command(state->current_condition, $1, state->current_block, state->line_number);
 
-                current_block = pop_block(block_stack);
-                add_command(current_block, if_else_cmd);
+                state->current_block = pop_block(state->block_stack);
+                add_command(state->current_block, if_else_cmd);
             }
             ;
 
 var_decl : INT ID SEMICOLON
          {
-            Command *cmd = create_declare_var_command($2, TYPE_INT, line_number, NULL);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_INT, state->line_number, NULL);
+            add_command(state->current_block, cmd);
             free($2);
          }
        | INT ID array_dimensions SEMICOLON
          {
-            Command *cmd = create_declare_var_command($2, TYPE_INT, line_number, $3);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_INT, state->line_number, $3);
+            add_command(state->current_block, cmd);
             free($2);
          }
        | FLOAT ID SEMICOLON
          {
-            Command *cmd = create_declare_var_command($2, TYPE_FLOAT, line_number, NULL);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_FLOAT, state->line_number, NULL);
+            add_command(state->current_block, cmd);
             free($2);
          }
        | FLOAT ID array_dimensions SEMICOLON
          {
-            Command *cmd = create_declare_var_command($2, TYPE_FLOAT, line_number, $3);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_FLOAT, state->line_number, $3);
+            add_command(state->current_block, cmd);
             free($2);
          }
        | CHAR ID SEMICOLON
          {
-           Command *cmd = create_declare_var_command($2, TYPE_CHAR, line_number, NULL);
-           add_command(current_block, cmd);
+           Command *cmd = create_declare_var_command($2, TYPE_CHAR, state->line_number, NULL);
+           add_command(state->current_block, cmd);
            free($2);
          }
        | CHAR ID array_dimensions SEMICOLON
          {
-           Command *cmd = create_declare_var_command($2, TYPE_CHAR, line_number, $3);
-           add_command(current_block, cmd);
+           Command *cmd = create_declare_var_command($2, TYPE_CHAR, state->line_number, $3);
+           add_command(state->current_block, cmd);
            free($2);
          }
         | STRING_TYPE ID SEMICOLON {
-            Command *cmd = create_declare_var_command($2, TYPE_STRING, line_number, NULL);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_STRING, state->line_number, NULL);
+            add_command(state->current_block, cmd);
             free($2);
         }
         | BOOL ID SEMICOLON
         {
-            Command *cmd = create_declare_var_command($2, TYPE_BOOL, line_number, NULL);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_BOOL, state->line_number, NULL);
+            add_command(state->current_block, cmd);
             free($2);
         }
         | BOOL ID array_dimensions SEMICOLON
         {
-            Command *cmd = create_declare_var_command($2, TYPE_BOOL, line_number, $3);
-            add_command(current_block, cmd);
+            Command *cmd = create_declare_var_command($2, TYPE_BOOL, state->line_number, $3);
+            add_command(state->current_block, cmd);
             free($2);
         }
        ;
 
 atrib_decl : ID ASSIGNMENT exp SEMICOLON
            {
-               Command *cmd = create_assign_command($1, NULL, $3, line_number);
-               add_command(current_block, cmd);
+               Command *cmd = create_assign_command($1, NULL, $3, state->line_number);
+               add_command(state->current_block, cmd);
                free($1);
            }
            | ID array_index ASSIGNMENT exp SEMICOLON
            {
-               Command *cmd = create_assign_command($1, $2, $4, line_number);
-               add_command(current_block, cmd);
+               Command *cmd = create_assign_command($1, $2, $4, state->line_number);
+               add_command(state->current_block, cmd);
                free($1);
            }
            ;
@@ -357,8 +380,8 @@ array_index : LBRACKET exp RBRACKET
 
 read_decl : READ LPAREN ID RPAREN SEMICOLON
           {
-              Command *cmd = create_read_command($3, line_number);
-              add_command(current_block, cmd);
+              Command *cmd = create_read_command($3, state->line_number);
+              add_command(state->current_block, cmd);
               free($3);
           }
           ;
@@ -366,80 +389,80 @@ read_decl : READ LPAREN ID RPAREN SEMICOLON
 write_decl : WRITE LPAREN ID RPAREN SEMICOLON
            {
                Expression *expr = create_var_expression($3);
-               Command *cmd = create_write_command(expr, NULL, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(expr, NULL, state->line_number, 0);
+               add_command(state->current_block, cmd);
                free($3);
            }
            | WRITE LPAREN STRING RPAREN SEMICOLON
            {
-               Command *cmd = create_write_command(NULL, $3, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, $3, state->line_number, 0);
+               add_command(state->current_block, cmd);
                free($3);
            }
            | WRITE LPAREN CHAR_LITERAL RPAREN SEMICOLON
            {
                char str[2] = {$3, '\0'};
-               Command *cmd = create_write_command(NULL, str, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 0);
+               add_command(state->current_block, cmd);
            }
            | WRITE LPAREN NUMBER RPAREN SEMICOLON
            {
                char str[1000000];
                sprintf(str, "%d", $3);
-               Command *cmd = create_write_command(NULL, str, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 0);
+               add_command(state->current_block, cmd);
            }
            | WRITE LPAREN FLOAT_NUMBER RPAREN SEMICOLON
            {
                char str[1000000];
                sprintf(str, "%f", $3);
-               Command *cmd = create_write_command(NULL, str, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 0);
+               add_command(state->current_block, cmd);
            }
            | WRITE LPAREN exp RPAREN SEMICOLON
            {
-               Command *cmd = create_write_command($3, NULL, line_number, 0);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command($3, NULL, state->line_number, 0);
+               add_command(state->current_block, cmd);
            }
            ;
 
 writeln_decl : WRITELN LPAREN ID RPAREN SEMICOLON
            {
                Expression *expr = create_var_expression($3);
-               Command *cmd = create_write_command(expr, NULL, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(expr, NULL, state->line_number, 1);
+               add_command(state->current_block, cmd);
                free($3);
            }
            | WRITELN LPAREN STRING RPAREN SEMICOLON
            {
-               Command *cmd = create_write_command(NULL, $3, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, $3, state->line_number, 1);
+               add_command(state->current_block, cmd);
                free($3);
            }
            | WRITELN LPAREN CHAR_LITERAL RPAREN SEMICOLON
            {
                char str[2] = {$3, '\0'};
-               Command *cmd = create_write_command(NULL, str, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 1);
+               add_command(state->current_block, cmd);
            }
            | WRITELN LPAREN NUMBER RPAREN SEMICOLON
            {
                char str[1000000];
                sprintf(str, "%d", $3);
-               Command *cmd = create_write_command(NULL, str, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 1);
+               add_command(state->current_block, cmd);
            }
            | WRITELN LPAREN FLOAT_NUMBER RPAREN SEMICOLON
            {
                char str[1000000];
                sprintf(str, "%f", $3);
-               Command *cmd = create_write_command(NULL, str, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command(NULL, str, state->line_number, 1);
+               add_command(state->current_block, cmd);
            }
            | WRITELN LPAREN exp RPAREN SEMICOLON
            {
-               Command *cmd = create_write_command($3, NULL, line_number, 1);
-               add_command(current_block, cmd);
+               Command *cmd = create_write_command($3, NULL, state->line_number, 1);
+               add_command(state->current_block, cmd);
            }
            ;
 
@@ -589,84 +612,36 @@ argument_list : exp
 
 %%
 
-extern char *yytext;
+char *yyget_text(yyscan_t scanner);
 
-int yyerror(s)
-char *s;
+// Generate and free the declaration just reduced when compiling in
+// streaming mode, so the AST never holds more than one of them
+static void stream_declarations(ParserState *state)
 {
-  fprintf(stderr, "%s: Error found in:  '%s' - line %d\n", s, yytext, line_number);
-  return 0;
-}
+  if (!state->codegen) return;
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <input_filename> [output_filename]\n", argv[0]);
-        return 1;
-    }
-
-    char *input_filename = argv[1];
-    char output_filename[1024];
-
-    // Determine output filename
-    if (argc > 2) {
-        strncpy(output_filename, argv[2], sizeof(output_filename) - 1);
-        output_filename[sizeof(output_filename) - 1] = '\0';
-    } else {
-        // Default output filename is input filename with .c extension
-        char *dot = strrchr(input_filename, '.');
-        if (dot) {
-            size_t prefix_len = dot - input_filename;
-            strncpy(output_filename, input_filename, prefix_len);
-            output_filename[prefix_len] = '\0';
-        } else {
-            strcpy(output_filename, input_filename);
-        }
-        strcat(output_filename, ".bc");
-    }
-
-    FILE *input_file = fopen(input_filename, "r");
-    if (!input_file) {
-        fprintf(stderr, "Error: Could not open input file '%s'\n", input_filename);
-        return 1;
-    }
-
-    yyin = input_file;
-
-    symbol_table = create_symbol_table();
-    function_table = create_function_table();
-    cmd_list = create_command_list(symbol_table);
-    block_stack = create_block_stack();
-    condition_stack = create_condition_stack();
-
-    int parse_result = yyparse();
-    fclose(input_file);
-
-    if (parse_result == 0) {
-        printf("Parsing successful. Generating code to %s\n", output_filename);
-
-        print_symbol_table(symbol_table);
-        print_function_table(function_table);
-        print_command_list(cmd_list);
+  if (state->pipeline) {
+    pipeline_submit_commands(state->pipeline, state->cmd_list);
+    return;
+  }
 
-        init_code_generation(output_filename, symbol_table, function_table);
-
-        // Generate code for the entire command list
-        generate_code_for_command_list(cmd_list);
-
-        printf("Generating code for main function\n");
-
-        // Finalize code generation
-        finalize_code_generation();
+  CompilePhase previous_phase = time_report_enter(state->time_report, PHASE_CODEGEN);
+  generate_streamed_commands(state->codegen, state->cmd_list);
+  time_report_leave(state->time_report, previous_phase);
+}
 
-        printf("Code generation complete.\n");
-    } else {
-        printf("Parsing failed.\n");
-    }
+int yyerror(ParserState *state, yyscan_t scanner, const char *s)
+{
+  // The entry simply is not finished yet
+  if (state->allow_incomplete_input && state->at_end_of_input) {
+    state->incomplete_input = 1;
+    return 0;
+  }
 
-    free_symbol_table(symbol_table);
-    free_function_table(function_table);
-    free_command_list(cmd_list);
-    free_block_stack(block_stack);
+  // The scanner belongs to the lexer thread, which may be further ahead
+  const char *text = state->pipeline ? state->pipeline->current.text : yyget_text(scanner);
 
-    return parse_result;
+  fprintf(stderr, "%s: %s: Error found in:  '%s' - line %d\n",
+          state->input_filename, s, text, state->line_number);
+  return 0;
 }
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sched.h>
+
+#include "pipeline.h"
+#include "log.h"
+
+void yyset_extra(struct ParserState *state, yyscan_t scanner);
+char *yyget_text(yyscan_t scanner);
+
+static int init_ring(Ring *ring, size_t element_size, size_t capacity) {
+    ring->slots = (char *)malloc(element_size * capacity);
+    ring->element_size = element_size;
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return ring->slots != NULL;
+}
+
+// Spin until there is room, yielding the CPU while the consumer catches up.
+// Returns 0 without pushing once the pipeline is cancelled.
+static int ring_push(Pipeline *pipeline, Ring *ring, const void *element) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask) {
+        if (atomic_load_explicit(&pipeline->cancelled, memory_order_relaxed)) return 0;
+        sched_yield();
+    }
+
+    memcpy(ring->slots + (tail & ring->mask) * ring->element_size, element, ring->element_size);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static int ring_pop(Pipeline *pipeline, Ring *ring, void *element) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head) {
+        if (atomic_load_explicit(&pipeline->cancelled, memory_order_relaxed)) return 0;
+        sched_yield();
+    }
+
+    memcpy(element, ring->slots + (head & ring->mask) * ring->element_size, ring->element_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Only called once both threads are gone
+static int ring_take(Ring *ring, void *element) {
+    size_t head = atomic_load(&ring->head);
+    if (atomic_load(&ring->tail) == head) return 0;
+
+    memcpy(element, ring->slots + (head & ring->mask) * ring->element_size, ring->element_size);
+    atomic_store(&ring->head, head + 1);
+    return 1;
+}
+
+static void free_token_value(PipelineToken *token) {
+    if (token->kind == ID || token->kind == STRING) {
+        free(token->value.sval);
+    }
+}
+
+static void *lex_tokens(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+    PipelineToken token;
+
+    do {
+        token.kind = scan_token(&token.value, pipeline->scanner);
+        token.line_number = pipeline->lexer_state.line_number;
+
+        const char *text = yyget_text(pipeline->scanner);
+        size_t length = strnlen(text, PIPELINE_TOKEN_TEXT_SIZE - 1);
+        memcpy(token.text, text, length);
+        token.text[length] = '\0';
+
+        if (!ring_push(pipeline, &pipeline->tokens, &token)) {
+            free_token_value(&token);
+            break;
+        }
+    } while (token.kind != 0);
+
+    return NULL;
+}
+
+static void *generate_commands(void *arg) {
+    Pipeline *pipeline = (Pipeline *)arg;
+    jmp_buf abort_target;
+
+    if (setjmp(abort_target) != 0) {
+        // The error is reported; make the parser give up as well
+        set_compilation_abort_target(NULL);
+        atomic_store(&pipeline->codegen_failed, 1);
+        atomic_store(&pipeline->cancelled, 1);
+        return NULL;
+    }
+    set_compilation_abort_target(&abort_target);
+
+    Command *cmd;
+    while (ring_pop(pipeline, &pipeline->commands, &cmd) && cmd != NULL) {
+        add_command(pipeline->incoming, cmd);
+        generate_streamed_commands(pipeline->codegen, pipeline->incoming);
+    }
+
+    set_compilation_abort_target(NULL);
+    return NULL;
+}
+
+static void free_pipeline(Pipeline *pipeline) {
+    free(pipeline->tokens.slots);
+    free(pipeline->commands.slots);
+    free_command_list(pipeline->incoming);
+    free(pipeline);
+}
+
+Pipeline *start_pipeline(ParserState *state, yyscan_t scanner) {
+    Pipeline *pipeline = (Pipeline *)calloc(1, sizeof(Pipeline));
+    if (!pipeline) return NULL;
+
+    if (!init_ring(&pipeline->tokens, sizeof(PipelineToken), PIPELINE_TOKEN_RING_SIZE) ||
+        !init_ring(&pipeline->commands, sizeof(Command *), PIPELINE_COMMAND_RING_SIZE)) {
+        free_pipeline(pipeline);
+        return NULL;
+    }
+
+    pipeline->scanner = scanner;
+    pipeline->parser_state = state;
+    pipeline->lexer_state.input_filename = state->input_filename;
+    pipeline->lexer_state.line_number = state->line_number;
+    pipeline->codegen = state->codegen;
+    pipeline->incoming = create_command_list(state->symbol_table);
+    atomic_init(&pipeline->cancelled, 0);
+    atomic_init(&pipeline->codegen_failed, 0);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, COMPILE_THREAD_STACK_SIZE);
+
+    // Start the consumer first, so no input has been read if the lexer cannot start
+    if (pipeline->codegen) {
+        // Phases overlap, so the code generation thread does not report its own
+        pipeline->time_report = pipeline->codegen->time_report;
+        pipeline->codegen->time_report = NULL;
+
+        if (pthread_create(&pipeline->codegen_thread, &attr, generate_commands, pipeline) != 0) {
+            pipeline->codegen->time_report = pipeline->time_report;
+            pthread_attr_destroy(&attr);
+            free_pipeline(pipeline);
+            return NULL;
+        }
+    }
+
+    yyset_extra(&pipeline->lexer_state, scanner);
+    if (pthread_create(&pipeline->lexer_thread, &attr, lex_tokens, pipeline) != 0) {
+        yyset_extra(state, scanner);
+        if (pipeline->codegen) {
+            atomic_store(&pipeline->cancelled, 1);
+            pthread_join(pipeline->codegen_thread, NULL);
+            pipeline->codegen->time_report = pipeline->time_report;
+        }
+        pthread_attr_destroy(&attr);
+        free_pipeline(pipeline);
+        return NULL;
+    }
+
+    pthread_attr_destroy(&attr);
+    return pipeline;
+}
+
+int pipeline_next_token(Pipeline *pipeline, YYSTYPE *value) {
+    if (!ring_pop(pipeline, &pipeline->tokens, &pipeline->current)) {
+        // Only cancelled when code generation failed
+        abort_compilation();
+    }
+
+    *value = pipeline->current.value;
+    pipeline->parser_state->line_number = pipeline->current.line_number;
+    return pipeline->current.kind;
+}
+
+void pipeline_submit_commands(Pipeline *pipeline, CommandList *list) {
+    Command *cmd;
+    while ((cmd = remove_first_command(list)) != NULL) {
+        if (!ring_push(pipeline, &pipeline->commands, &cmd)) {
+            free_command(cmd);
+            abort_compilation();
+        }
+    }
+}
+
+int finish_pipeline(Pipeline *pipeline, int cancel) {
+    if (!pipeline) return 0;
+
+    if (pipeline->codegen && !cancel) {
+        // Close the ring; the thread drains it before it sees the NULL
+        Command *end = NULL;
+        ring_push(pipeline, &pipeline->commands, &end);
+    }
+    if (cancel) {
+        atomic_store(&pipeline->cancelled, 1);
+    }
+
+    pthread_join(pipeline->lexer_thread, NULL);
+    if (pipeline->codegen) {
+        pthread_join(pipeline->codegen_thread, NULL);
+        pipeline->codegen->time_report = pipeline->time_report;
+    }
+    yyset_extra(pipeline->parser_state, pipeline->scanner);
+
+    // Whatever was still on its way when the pipeline stopped
+    PipelineToken token;
+    while (ring_take(&pipeline->tokens, &token)) {
+        free_token_value(&token);
+    }
+    Command *cmd;
+    while (ring_take(&pipeline->commands, &cmd)) {
+        free_command(cmd);
+    }
+
+    int failed = atomic_load(&pipeline->codegen_failed);
+    free_pipeline(pipeline);
+    return failed;
+}
@@ -0,0 +1,76 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "compiler.h"
+
+// --pipeline: lex, parse and generate code for one file on three threads.
+// A lexer thread runs the flex scanner ahead of the parser and hands it the
+// tokens through a ring buffer; every top-level declaration the parser
+// reduces goes through a second ring to a code generation thread. Both
+// rings have a single producer and a single consumer and need no locks.
+
+#define PIPELINE_TOKEN_RING_SIZE   4096  // Powers of two
+#define PIPELINE_COMMAND_RING_SIZE 256
+#define PIPELINE_TOKEN_TEXT_SIZE   32    // Enough of the token text for syntax errors
+
+typedef struct Ring {
+    char *slots;
+    size_t element_size;
+    size_t mask;
+
+    // Producer and consumer each write one index; keep them on separate cache lines
+    _Alignas(64) atomic_size_t head;  // Next slot to read
+    _Alignas(64) atomic_size_t tail;  // Next slot to write
+} Ring;
+
+typedef struct PipelineToken {
+    int kind;  // 0 at the end of input
+    YYSTYPE value;
+    int line_number;  // Line of the scanner once it returned this token
+    char text[PIPELINE_TOKEN_TEXT_SIZE];
+} PipelineToken;
+
+typedef struct Pipeline {
+    Ring tokens;
+    Ring commands;  // Command pointers; NULL closes the ring
+
+    yyscan_t scanner;
+    ParserState *parser_state;
+    ParserState lexer_state;  // What the scanner updates on the lexer thread
+    PipelineToken current;    // Token the parser read last
+
+    CodegenContext *codegen;  // NULL when the parser keeps the whole AST
+    CommandList *incoming;    // Declarations received by the code generation thread
+    TimeReport *time_report;  // Put back into codegen once the threads are done
+
+    pthread_t lexer_thread;
+    pthread_t codegen_thread;
+    atomic_int cancelled;
+    atomic_int codegen_failed;
+} Pipeline;
+
+// The flex scanner itself, without the timing yylex adds
+int scan_token(YYSTYPE *yylval_param, yyscan_t scanner);
+
+// Start the lexer thread on scanner, and a code generation thread when
+// state->codegen is set. Returns NULL if the threads could not be started.
+// Allocations of these threads are not counted by --mem-report, and their
+// time shows up as waiting in the parse phase of --time-report.
+Pipeline *start_pipeline(ParserState *state, yyscan_t scanner);
+
+// yylex of the parsing thread: the next token from the lexer thread
+int pipeline_next_token(Pipeline *pipeline, YYSTYPE *value);
+
+// Hand the top-level commands of list to the code generation thread.
+// Aborts the compilation if code generation has already failed.
+void pipeline_submit_commands(Pipeline *pipeline, CommandList *list);
+
+// Wait for the threads to finish, or stop them first when cancel is set,
+// and free the pipeline. Returns 0 if code generation succeeded.
+int finish_pipeline(Pipeline *pipeline, int cancel);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "profile.h"
+#include "command.h"
+
+Profile *create_profile() {
+    Profile *profile = (Profile *)calloc(1, sizeof(Profile));
+    if (!profile) {
+        fprintf(stderr, "Error: Memory allocation failed for profile\n");
+        abort_compilation();
+    }
+    return profile;
+}
+
+ProfileFunction *find_profile_function(Profile *profile, const char *name) {
+    for (ProfileFunction *function = profile->functions; function != NULL; function = function->next) {
+        if (strcmp(function->name, name) == 0) {
+            return function;
+        }
+    }
+    return NULL;
+}
+
+ProfileFunction *add_profile_function(Profile *profile, const char *name, uint64_t hash) {
+    ProfileFunction *function = (ProfileFunction *)calloc(1, sizeof(ProfileFunction));
+    if (!function) {
+        fprintf(stderr, "Error: Memory allocation failed for profile\n");
+        abort_compilation();
+    }
+    function->name = strdup(name);
+    function->hash = hash;
+
+    if (profile->last) {
+        profile->last->next = function;
+    } else {
+        profile->functions = function;
+    }
+    profile->last = function;
+    return function;
+}
+
+void add_profile_site(ProfileFunction *function, LLVMValueRef counters) {
+    if (function->site_count == function->site_capacity) {
+        function->site_capacity = function->site_capacity ? function->site_capacity * 2 : 8;
+        function->site_counters = (LLVMValueRef *)realloc(function->site_counters,
+                                                          function->site_capacity * sizeof(LLVMValueRef));
+        if (!function->site_counters) {
+            fprintf(stderr, "Error: Memory allocation failed for profile\n");
+            abort_compilation();
+        }
+    }
+    function->site_counters[function->site_count++] = counters;
+}
+
+Profile *read_profile(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open profile '%s'\n", filename);
+        return NULL;
+    }
+
+    int version = 0;
+    if (fscanf(file, "ptl-profile %d", &version) != 1 || version != PROFILE_FORMAT_VERSION) {
+        fprintf(stderr, "Error: '%s' is not a version %d profile\n", filename, PROFILE_FORMAT_VERSION);
+        fclose(file);
+        return NULL;
+    }
+
+    Profile *profile = create_profile();
+    char name[256];
+    uint64_t hash, entry_count;
+    int site_count;
+
+    int fields;
+    while ((fields = fscanf(file, " function %255s %" SCNx64 " %" SCNu64 " %d",
+                            name, &hash, &entry_count, &site_count)) == 4) {
+        if (site_count < 0) break;
+
+        ProfileFunction *function = add_profile_function(profile, name, hash);
+        function->entry_count = entry_count;
+        function->site_count = site_count;
+        function->site_counts = (uint64_t *)calloc(2 * site_count + 1, sizeof(uint64_t));
+
+        for (int i = 0; i < 2 * site_count; i++) {
+            if (fscanf(file, "%" SCNu64, &function->site_counts[i]) != 1) {
+                site_count = -1;
+                break;
+            }
+        }
+        if (site_count < 0) break;
+    }
+
+    if (fields != EOF) {
+        fprintf(stderr, "Error: Malformed profile '%s'\n", filename);
+        free_profile(profile);
+        profile = NULL;
+    }
+
+    fclose(file);
+    return profile;
+}
+
+void free_profile(Profile *profile) {
+    if (!profile) return;
+
+    ProfileFunction *function = profile->functions;
+    while (function != NULL) {
+        ProfileFunction *next = function->next;
+        free(function->name);
+        free(function->site_counts);
+        free(function->site_counters);
+        free(function);
+        function = next;
+    }
+    free(profile);
+}
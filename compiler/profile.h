@@ -0,0 +1,54 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <llvm-c/Core.h>
+
+// Branch profiles of .ptl programs. An --instrument build counts how often
+// each function is entered and which way each conditional branch goes,
+// and writes the counts when the program exits:
+//
+//   ptl-profile 1
+//   function <name> <hash> <entry count> <branch count>
+//   <taken> <not taken>      one line per branch, in code generation order
+//
+// --profile-use reads the file back. Functions whose hash no longer matches
+// the source are ignored.
+
+#define PROFILE_DEFAULT_FILENAME "ptl.profile"
+#define PROFILE_FILE_ENV         "PTL_PROFILE_FILE"  // Overrides the path at run time
+#define PROFILE_FORMAT_VERSION   1
+
+typedef struct ProfileFunction {
+    char *name;
+    uint64_t hash;  // Structural hash of the definition the counts belong to
+    uint64_t entry_count;
+    int site_count;
+    int site_capacity;
+
+    uint64_t *site_counts;        // Read profile: taken/not-taken pair per branch
+    LLVMValueRef entry_counter;   // Instrumented build: counter globals
+    LLVMValueRef *site_counters;  // [2 x i64] per branch
+
+    struct ProfileFunction *next;
+} ProfileFunction;
+
+typedef struct Profile {
+    ProfileFunction *functions;
+    ProfileFunction *last;  // Keeps the file in code generation order
+} Profile;
+
+Profile *create_profile();
+
+// Returns NULL after reporting the problem if the file is missing or malformed
+Profile *read_profile(const char *filename);
+
+ProfileFunction *find_profile_function(Profile *profile, const char *name);
+ProfileFunction *add_profile_function(Profile *profile, const char *name, uint64_t hash);
+
+// Record the counter global of a new branch site of function
+void add_profile_site(ProfileFunction *function, LLVMValueRef counters);
+
+void free_profile(Profile *profile);
+
+#endif
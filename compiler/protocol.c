@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+void default_server_socket_path(char *path, int size) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && runtime_dir[0] != '\0') {
+        snprintf(path, size, "%s/ptl-compiler.sock", runtime_dir);
+    } else {
+        snprintf(path, size, "/tmp/ptl-compiler-%d.sock", (int)getuid());
+    }
+}
+
+int write_all(int fd, const void *data, int size) {
+    const char *bytes = (const char *)data;
+    while (size > 0) {
+        ssize_t count = write(fd, bytes, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;
+        bytes += count;
+        size -= count;
+    }
+    return 0;
+}
+
+int read_all(int fd, void *data, int size) {
+    char *bytes = (char *)data;
+    while (size > 0) {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return -1;
+        bytes += count;
+        size -= count;
+    }
+    return 0;
+}
+
+int send_request_header(int socket_fd, const CompileRequestHeader *header, const int *fds) {
+    struct iovec data = { (void *)header, sizeof(CompileRequestHeader) };
+
+    union {
+        char buffer[CMSG_SPACE(COMPILE_REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    struct cmsghdr *fd_message = CMSG_FIRSTHDR(&message);
+    fd_message->cmsg_level = SOL_SOCKET;
+    fd_message->cmsg_type = SCM_RIGHTS;
+    fd_message->cmsg_len = CMSG_LEN(COMPILE_REQUEST_FDS * sizeof(int));
+    memcpy(CMSG_DATA(fd_message), fds, COMPILE_REQUEST_FDS * sizeof(int));
+
+    ssize_t count;
+    do {
+        count = sendmsg(socket_fd, &message, 0);
+    } while (count < 0 && errno == EINTR);
+
+    return count == (ssize_t)sizeof(CompileRequestHeader) ? 0 : -1;
+}
+
+int receive_request_header(int socket_fd, CompileRequestHeader *header, int *fds) {
+    struct iovec data = { header, sizeof(CompileRequestHeader) };
+
+    union {
+        char buffer[CMSG_SPACE(COMPILE_REQUEST_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t count;
+    do {
+        count = recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC);
+    } while (count < 0 && errno == EINTR);
+
+    if (count != (ssize_t)sizeof(CompileRequestHeader) || header->magic != COMPILE_REQUEST_MAGIC) {
+        return -1;
+    }
+
+    struct cmsghdr *fd_message = CMSG_FIRSTHDR(&message);
+    if (!fd_message || fd_message->cmsg_type != SCM_RIGHTS ||
+        fd_message->cmsg_len != CMSG_LEN(COMPILE_REQUEST_FDS * sizeof(int))) {
+        return -1;
+    }
+
+    memcpy(fds, CMSG_DATA(fd_message), COMPILE_REQUEST_FDS * sizeof(int));
+    return 0;
+}
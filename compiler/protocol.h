@@ -0,0 +1,38 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+// Wire format between the thin client and `compiler --serve`.
+//
+// The client sends one CompileRequestHeader. The same sendmsg carries its
+// stdin, stdout and stderr as SCM_RIGHTS descriptors. A payload follows
+// with the working directory, argc arguments and envc environment entries,
+// each NUL terminated. The server answers with one int32 exit code once
+// the compilation has finished.
+
+#define COMPILE_REQUEST_MAGIC 0x50544c31  // "PTL1"
+#define COMPILE_REQUEST_FDS   3
+#define COMPILE_PAYLOAD_MAX   (1024 * 1024)
+
+typedef struct CompileRequestHeader {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payload_size;
+} CompileRequestHeader;
+
+// Socket used when neither --serve nor $PTL_COMPILE_SERVER names one
+void default_server_socket_path(char *path, int size);
+
+// Loop over write/read until size bytes moved. Returns 0 on success.
+int write_all(int fd, const void *data, int size);
+int read_all(int fd, void *data, int size);
+
+// Send the header together with fds[COMPILE_REQUEST_FDS]. Returns 0 on success.
+int send_request_header(int socket_fd, const CompileRequestHeader *header, const int *fds);
+
+// Receive the header and the descriptors sent with it. Returns 0 on success.
+int receive_request_header(int socket_fd, CompileRequestHeader *header, int *fds);
+
+#endif
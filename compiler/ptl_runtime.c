@@ -0,0 +1,89 @@
+// Runtime library of compiled programs. The Makefile compiles it to bitcode
+// (ptl_runtime.bc), which the compiler embeds and links into every program
+// before optimizing it, so these helpers are inlined into the code calling
+// them like any other function of the program. Keep them small and free of
+// global state: each program gets its own copy.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PTL_STRING_SIZE 256  // Size of a string variable, terminator included
+
+void __ptl_write_int(int value) {
+    char digits[12];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        *--start = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--start = '-';
+
+    fwrite(start, 1, (size_t)(end - start), stdout);
+}
+
+void __ptl_write_float(float value) {
+    printf("%f", (double)value);
+}
+
+void __ptl_write_char(int value) {
+    putchar(value);
+}
+
+void __ptl_write_bool(int value) {
+    fputs(value ? "true" : "false", stdout);
+}
+
+void __ptl_write_string(const char *text) {
+    fputs(text, stdout);
+}
+
+void __ptl_write_newline(void) {
+    putchar('\n');
+}
+
+void __ptl_prompt(const char *name) {
+    printf("Enter value for %s: ", name);
+}
+
+void __ptl_read_int(int *value) {
+    scanf("%d", value);
+}
+
+void __ptl_read_float(float *value) {
+    scanf("%f", value);
+}
+
+void __ptl_read_char(char *value) {
+    scanf(" %c", value);
+}
+
+void __ptl_read_string(char *text) {
+    scanf("%255s", text);
+}
+
+int __ptl_read_bool(void) {
+    char word[10] = "";
+    scanf("%9s", word);
+    return strcmp(word, "true") == 0 || strcmp(word, "1") == 0;
+}
+
+// Copies at most what fits in a string variable
+void __ptl_string_copy(char *dest, const char *src) {
+    size_t length = strlen(src);
+    if (length > PTL_STRING_SIZE - 1) length = PTL_STRING_SIZE - 1;
+    memmove(dest, src, length);
+    dest[length] = '\0';
+}
+
+// Reached by --bounds-check code when an index falls outside its array
+__attribute__((noreturn, cold))
+void __ptl_bounds_error(const char *array, int index, int size, int line) {
+    fflush(stdout);
+    fprintf(stderr, "Error: Index %d is out of bounds for array '%s' of size %d at line %d\n",
+            index, array, size, line);
+    abort();
+}
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <llvm-c/Support.h>
+
+#include "remarks.h"
+#include "compiler.h"
+
+// Line range of a function of the .ptl source, before inlining moves its code
+typedef struct FunctionLines {
+    char *file;
+    unsigned first;
+    unsigned last;
+    char *name;
+} FunctionLines;
+
+static pthread_once_t remarks_once = PTHREAD_ONCE_INIT;
+static int remarks_enabled = 0;
+
+// The passes only emit the remarks LLVM's command line options ask for.
+// Those options are global to the process, so they are set once.
+static void enable_pass_remarks(void) {
+    const char *args[] = {
+        "ptl",
+        "-pass-remarks=" REMARKS_PASSES,
+        "-pass-remarks-missed=" REMARKS_PASSES,
+        "-pass-remarks-analysis=" REMARKS_PASSES,
+    };
+    LLVMParseCommandLineOptions(sizeof(args) / sizeof(args[0]), args, NULL);
+    remarks_enabled = 1;
+}
+
+static char *copy_string(const char *s, size_t length) {
+    char *copy = (char *)malloc(length + 1);
+    if (!copy) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void collect_function_lines(CodegenContext *ctx, RemarkLog *log) {
+    int count = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        count++;
+    }
+    log->functions = (FunctionLines *)calloc(count > 0 ? count : 1, sizeof(FunctionLines));
+    if (!log->functions) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    for (LLVMValueRef function = LLVMGetFirstFunction(ctx->module); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        // Runtime helpers and imported modules carry no lines of this file
+        unsigned first = LLVMGetDebugLocLine(function);
+        if (LLVMIsDeclaration(function) || first == 0) continue;
+
+        unsigned last = first;
+        for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function); block != NULL;
+             block = LLVMGetNextBasicBlock(block)) {
+            for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != NULL;
+                 inst = LLVMGetNextInstruction(inst)) {
+                unsigned line = LLVMGetDebugLocLine(inst);
+                if (line > last) last = line;
+            }
+        }
+
+        unsigned file_length;
+        size_t name_length;
+        const char *file = LLVMGetDebugLocFilename(function, &file_length);
+        const char *name = LLVMGetValueName2(function, &name_length);
+
+        FunctionLines *lines = &log->functions[log->function_count++];
+        lines->file = copy_string(file ? file : "", file ? file_length : 0);
+        lines->first = first;
+        lines->last = last;
+        lines->name = copy_string(name, name_length);
+    }
+}
+
+// main spans the whole file, so the innermost range is the function
+// the line was written in
+static const char *find_function(RemarkLog *log, const char *file, int line) {
+    const FunctionLines *found = NULL;
+    for (int i = 0; i < log->function_count; i++) {
+        const FunctionLines *lines = &log->functions[i];
+        if ((unsigned)line < lines->first || (unsigned)line > lines->last) continue;
+        if (strcmp(lines->file, file) != 0) continue;
+        if (!found || lines->last - lines->first < found->last - found->first) {
+            found = lines;
+        }
+    }
+    return found ? found->name : NULL;
+}
+
+static int is_reported(RemarkLog *log, const Remark *remark) {
+    for (Remark *other = log->head; other != NULL; other = other->next) {
+        if (other->line == remark->line && other->column == remark->column &&
+            strcmp(other->file, remark->file) == 0 && strcmp(other->message, remark->message) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void free_remark(Remark *remark) {
+    free(remark->file);
+    free(remark->function);
+    free(remark->message);
+    free(remark);
+}
+
+// Remarks are described as "file:line:column: message"
+static void add_remark(RemarkLog *log, const char *description) {
+    const char *location_end = NULL;
+    long line = 0;
+    long column = 0;
+    for (const char *p = strchr(description, ':'); p != NULL; p = strchr(p + 1, ':')) {
+        char *end;
+        line = strtol(p + 1, &end, 10);
+        if (end == p + 1 || *end != ':' || !isdigit((unsigned char)end[1])) continue;
+        column = strtol(end + 1, &end, 10);
+        if (end[0] != ':' || end[1] != ' ') continue;
+        location_end = p;
+        break;
+    }
+
+    // Code without a line of the source, such as the runtime library, is
+    // not the program's
+    if (!location_end || line <= 0) return;
+
+    Remark *remark = (Remark *)calloc(1, sizeof(Remark));
+    if (!remark) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+    remark->file = copy_string(description, (size_t)(location_end - description));
+    remark->line = (int)line;
+    remark->column = (int)column;
+    const char *message = strstr(location_end + 1, ": ") + 2;
+    remark->message = copy_string(message, strlen(message));
+
+    // Passes that run more than once repeat their remarks
+    if (is_reported(log, remark)) {
+        free_remark(remark);
+        return;
+    }
+
+    const char *function = find_function(log, remark->file, remark->line);
+    if (function) remark->function = copy_string(function, strlen(function));
+    remark->index = log->count++;
+
+    if (log->last) {
+        log->last->next = remark;
+    } else {
+        log->head = remark;
+    }
+    log->last = remark;
+}
+
+static void handle_diagnostic(LLVMDiagnosticInfoRef info, void *context) {
+    RemarkLog *log = (RemarkLog *)context;
+    LLVMDiagnosticSeverity severity = LLVMGetDiagInfoSeverity(info);
+
+    // Another compilation of this process may have asked for remarks, and
+    // the vectorizer reports on the loops it was asked to vectorize anyway
+    if (severity == LLVMDSRemark && log->format == REMARKS_NONE) return;
+
+    char *description = LLVMGetDiagInfoDescription(info);
+    if (severity == LLVMDSRemark) {
+        add_remark(log, description);
+    } else if (severity == LLVMDSWarning && log->float_loop_hints && strstr(description, "loop not vectorized")) {
+        // The compiler asked to vectorize the loop, not the user, so a loop
+        // that could not be is only worth a remark
+        if (log->format != REMARKS_NONE) add_remark(log, description);
+    } else if (severity == LLVMDSError) {
+        fprintf(stderr, "Error: %s\n", description);
+    } else if (severity == LLVMDSWarning) {
+        fprintf(stderr, "Warning: %s\n", description);
+    }
+    LLVMDisposeMessage(description);
+}
+
+void begin_remarks(CodegenContext *ctx, RemarkLog *log) {
+    memset(log, 0, sizeof(*log));
+    log->format = ctx->options.remarks;
+    log->float_loop_hints = (ctx->options.float_math & FLOAT_REASSOC) != 0;
+
+    if (log->format != REMARKS_NONE) {
+        pthread_once(&remarks_once, enable_pass_remarks);
+        collect_function_lines(ctx, log);
+    } else if (!remarks_enabled && !log->float_loop_hints) {
+        return;
+    }
+
+    log->previous_handler = LLVMContextGetDiagnosticHandler(ctx->context);
+    log->previous_context = LLVMContextGetDiagnosticContext(ctx->context);
+    LLVMContextSetDiagnosticHandler(ctx->context, handle_diagnostic, log);
+    log->installed = 1;
+}
+
+// Sorted by position in the source, in the order the passes reported
+// remarks on the same line
+static int compare_remarks(const void *a, const void *b) {
+    const Remark *x = *(const Remark *const *)a;
+    const Remark *y = *(const Remark *const *)b;
+    int order = strcmp(x->file, y->file);
+    if (order == 0) order = x->line - y->line;
+    if (order == 0) order = x->column - y->column;
+    if (order == 0) order = x->index - y->index;
+    return order;
+}
+
+static void print_text_remarks(FILE *out, Remark **remarks, int count) {
+    // Compilations on other threads may report at the same time
+    flockfile(out);
+    for (int i = 0; i < count; i++) {
+        Remark *remark = remarks[i];
+        if (remark->function) {
+            fprintf(out, "%s:%d: Remark in function '%s': %s\n", remark->file, remark->line,
+                    remark->function, remark->message);
+        } else {
+            fprintf(out, "%s:%d: Remark: %s\n", remark->file, remark->line, remark->message);
+        }
+    }
+    funlockfile(out);
+}
+
+static void print_yaml_string(FILE *out, const char *s) {
+    fputc('\'', out);
+    for (; *s; s++) {
+        if (*s == '\'') fputc('\'', out);
+        fputc(*s, out);
+    }
+    fputc('\'', out);
+}
+
+// Laid out like the remark files of clang's -fsave-optimization-record
+static void write_yaml_remarks(FILE *out, Remark **remarks, int count) {
+    for (int i = 0; i < count; i++) {
+        Remark *remark = remarks[i];
+        fprintf(out, "--- !Remark\n");
+        fprintf(out, "DebugLoc:        { File: ");
+        print_yaml_string(out, remark->file);
+        fprintf(out, ", Line: %d, Column: %d }\n", remark->line, remark->column);
+        if (remark->function) {
+            fprintf(out, "Function:        ");
+            print_yaml_string(out, remark->function);
+            fputc('\n', out);
+        }
+        fprintf(out, "Message:         ");
+        print_yaml_string(out, remark->message);
+        fprintf(out, "\n...\n");
+    }
+}
+
+static void print_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c == '\n') {
+            fprintf(out, "\\n");
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_json_remarks(FILE *out, Remark **remarks, int count) {
+    fprintf(out, "{\"remarks\": [");
+    for (int i = 0; i < count; i++) {
+        Remark *remark = remarks[i];
+        fprintf(out, "%s\n  {\"file\": ", i > 0 ? "," : "");
+        print_json_string(out, remark->file);
+        fprintf(out, ", \"line\": %d, \"column\": %d, \"function\": ", remark->line, remark->column);
+        if (remark->function) {
+            print_json_string(out, remark->function);
+        } else {
+            fprintf(out, "null");
+        }
+        fprintf(out, ", \"message\": ");
+        print_json_string(out, remark->message);
+        fprintf(out, "}");
+    }
+    fprintf(out, "%s]}\n", count > 0 ? "\n" : "");
+}
+
+static void free_remark_log(RemarkLog *log) {
+    Remark *remark = log->head;
+    while (remark) {
+        Remark *next = remark->next;
+        free_remark(remark);
+        remark = next;
+    }
+
+    for (int i = 0; i < log->function_count; i++) {
+        free(log->functions[i].file);
+        free(log->functions[i].name);
+    }
+    free(log->functions);
+    memset(log, 0, sizeof(*log));
+}
+
+void end_remarks(CodegenContext *ctx, RemarkLog *log) {
+    if (!log->installed) return;
+    LLVMContextSetDiagnosticHandler(ctx->context, log->previous_handler, log->previous_context);
+
+    if (log->format == REMARKS_NONE) {
+        free_remark_log(log);
+        return;
+    }
+
+    Remark **remarks = (Remark **)malloc((log->count > 0 ? log->count : 1) * sizeof(Remark *));
+    if (!remarks) {
+        free_remark_log(log);
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+    int count = 0;
+    for (Remark *remark = log->head; remark != NULL; remark = remark->next) {
+        remarks[count++] = remark;
+    }
+    qsort(remarks, count, sizeof(Remark *), compare_remarks);
+
+    if (log->format == REMARKS_TEXT || !ctx->options.remarks_filename) {
+        print_text_remarks(stderr, remarks, count);
+    } else {
+        FILE *out = fopen(ctx->options.remarks_filename, "w");
+        if (!out) {
+            free(remarks);
+            free_remark_log(log);
+            fprintf(stderr, "Error: Could not write remarks to file '%s'\n", ctx->options.remarks_filename);
+            abort_compilation();
+        }
+        if (log->format == REMARKS_YAML) {
+            write_yaml_remarks(out, remarks, count);
+        } else {
+            write_json_remarks(out, remarks, count);
+        }
+        fclose(out);
+    }
+
+    free(remarks);
+    free_remark_log(log);
+}
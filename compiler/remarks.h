@@ -0,0 +1,54 @@
+#ifndef REMARKS_H
+#define REMARKS_H
+
+#include "code_generator.h"
+
+// --remarks reports what the optimizer did and failed to do to the
+// program: loops vectorized or not, calls inlined or not, code hoisted
+// out of loops and loads eliminated (the passed, missed and analysis
+// remarks of loop-vectorize, inline, licm and gvn). Once those are asked
+// for, LLVM also hands over the remarks of the other passes that report
+// any, such as loop unrolling, and the C API does not say which pass a
+// remark came from, so they are reported too. Each remark names the .ptl
+// line and function it is about; the compiler tracks source lines for
+// this without emitting debug info.
+//
+// --remarks prints them to stderr, --remarks=yaml and --remarks=json
+// write them next to the output file for tools.
+
+#define REMARKS_PASSES "^(loop-vectorize|inline|licm|gvn)$"
+
+typedef struct Remark {
+    char *file;
+    int line;
+    int column;
+    char *function;  // Function of the .ptl source the line belongs to
+    char *message;
+    int index;  // Order the remark was reported in
+    struct Remark *next;
+} Remark;
+
+// Remarks of one run of the optimization pipeline
+typedef struct RemarkLog {
+    RemarksFormat format;
+    Remark *head;
+    Remark *last;
+    int count;
+
+    struct FunctionLines *functions;  // Line range of each function, to name the function of a remark
+    int function_count;
+
+    int float_loop_hints;  // Float loops carry vectorize hints of the compiler, see hint_float_loop
+
+    LLVMDiagnosticHandler previous_handler;
+    void *previous_context;
+    int installed;
+} RemarkLog;
+
+// Collect the remarks of the passes about to run on ctx->module
+void begin_remarks(CodegenContext *ctx, RemarkLog *log);
+
+// Stop collecting and report the remarks in the format of ctx->options
+void end_remarks(CodegenContext *ctx, RemarkLog *log);
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "repl.h"
+#include "compiler.h"
+
+#define REPL_INPUT_NAME "<stdin>"
+
+typedef enum {
+    ENTRY_DONE,
+    ENTRY_FAILED,
+    ENTRY_INCOMPLETE  // Valid so far, but ends in the middle of something
+} EntryResult;
+
+// Defining a name twice would leave two definitions of it in the JIT
+static int check_redefinitions(JitSession *session, CommandList *list) {
+    for (Command *cmd = list->head; cmd != NULL; cmd = cmd->next) {
+        const char *name = NULL;
+        if (cmd->type == CMD_FUNC_DEF) {
+            name = cmd->data.func_def.name;
+        } else if (cmd->type == CMD_DECLARE_VAR) {
+            name = cmd->data.declare_var.name;
+        }
+
+        if (name && jit_session_defines(session, name)) {
+            fprintf(stderr, "Error: '%s' is already defined\n", name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static EntryResult compile_entry(JitSession *session, SymbolTable *symbol_table,
+                                 FunctionTable *function_table, const CodegenOptions *options,
+                                 const char *text, int first_line, int allow_incomplete) {
+    FILE *input = fmemopen((void *)text, strlen(text), "r");
+    if (!input) {
+        perror("fmemopen");
+        return ENTRY_FAILED;
+    }
+
+    // Symbol and function tables live for the whole session
+    ParserState state;
+    memset(&state, 0, sizeof(state));
+    state.input_filename = REPL_INPUT_NAME;
+    state.line_number = first_line;
+    state.symbol_table = symbol_table;
+    state.function_table = function_table;
+    state.cmd_list = create_command_list(symbol_table);
+    state.block_stack = create_block_stack();
+    state.condition_stack = create_condition_stack();
+    state.allow_incomplete_input = allow_incomplete;
+
+    yyscan_t scanner;
+    yylex_init_extra(&state, &scanner);
+    yyset_in(input, scanner);
+
+    Symbol *previous_symbols = symbol_table->head;
+    CodegenContext *volatile ctx = NULL;
+    volatile EntryResult result = ENTRY_FAILED;
+    jmp_buf abort_target;
+
+    if (setjmp(abort_target) == 0) {
+        set_compilation_abort_target(&abort_target);
+
+        if (yyparse(&state, scanner) != 0) {
+            result = state.incomplete_input ? ENTRY_INCOMPLETE : ENTRY_FAILED;
+        } else if (check_redefinitions(session, state.cmd_list)) {
+            ctx = begin_jit_entry(session, symbol_table, function_table, options);
+            generate_code_for_command_list(ctx, state.cmd_list);
+            run_jit_entry(session, ctx);
+            result = ENTRY_DONE;
+        }
+    }
+    set_compilation_abort_target(NULL);
+
+    // A rejected entry must not leave its variables behind
+    if (result != ENTRY_DONE) {
+        remove_symbols_since(symbol_table, previous_symbols);
+    }
+
+    dispose_code_generation(ctx);
+    yylex_destroy(scanner);
+    fclose(input);
+    free_command_list(state.cmd_list);
+    free_block_stack(state.block_stack);
+    free_condition_stack(state.condition_stack);
+
+    return result;
+}
+
+// Whether text holds nothing but whitespace
+static int is_blank(const char *text) {
+    for (; *text; text++) {
+        if (*text != ' ' && *text != '\t' && *text != '\n' && *text != '\r' && *text != '\f') return 0;
+    }
+    return 1;
+}
+
+int run_repl(const CodegenOptions *options) {
+    int interactive = isatty(STDIN_FILENO);
+    if (interactive) {
+        fprintf(stderr, "PTL REPL. Entries run as soon as they are complete; end of input exits.\n");
+    }
+
+    JitSession *session = create_jit_session();
+    SymbolTable *symbol_table = create_symbol_table();
+    FunctionTable *function_table = create_function_table();
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    char *entry = NULL;
+    size_t entry_length = 0;
+    int lines_read = 0;
+    int entry_first_line = 1;
+
+    while (1) {
+        if (interactive) {
+            fputs(entry_length > 0 ? "...> " : "ptl> ", stdout);
+            fflush(stdout);
+        }
+
+        ssize_t length = getline(&line, &line_capacity, stdin);
+        if (length < 0) break;
+        lines_read++;
+
+        entry = (char *)realloc(entry, entry_length + length + 1);
+        memcpy(entry + entry_length, line, length + 1);
+        entry_length += length;
+
+        if (is_blank(entry)) {
+            entry_length = 0;
+            entry_first_line = lines_read + 1;
+            continue;
+        }
+
+        if (compile_entry(session, symbol_table, function_table, options,
+                          entry, entry_first_line, 1) == ENTRY_INCOMPLETE) {
+            continue;
+        }
+
+        entry_length = 0;
+        entry_first_line = lines_read + 1;
+    }
+
+    // Input ended in the middle of an entry: report what is missing
+    if (entry_length > 0) {
+        compile_entry(session, symbol_table, function_table, options, entry, entry_first_line, 0);
+    }
+    if (interactive) {
+        fputc('\n', stdout);
+    }
+
+    free(line);
+    free(entry);
+    free_symbol_table(symbol_table);
+    free_function_table(function_table);
+    dispose_jit_session(session);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include "code_generator.h"
+
+// Read entries from stdin until end of input. Each complete declaration,
+// function or statement is parsed with the normal grammar, compiled into
+// a module of its own and run at once in a JIT session that keeps the
+// globals and functions of earlier entries.
+int run_repl(const CodegenOptions *options);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <llvm-c/BitReader.h>
+#include <llvm-c/Linker.h>
+
+#include "runtime.h"
+#include "compiler.h"
+
+// ptl_runtime.bc, built by the Makefile from ptl_runtime.c
+__asm__(".section .rodata\n"
+        ".global ptl_runtime_bitcode\n"
+        ".global ptl_runtime_bitcode_end\n"
+        ".balign 16\n"
+        "ptl_runtime_bitcode:\n"
+        ".incbin \"ptl_runtime.bc\"\n"
+        "ptl_runtime_bitcode_end:\n"
+        ".previous\n");
+
+extern const char ptl_runtime_bitcode[];
+extern const char ptl_runtime_bitcode_end[];
+
+// Signatures are spelled with one letter per type, return type first:
+// v void, i int, f float, s char *, I int *, F float *
+typedef struct {
+    const char *name;
+    const char *signature;
+} RuntimeFunctionInfo;
+
+static const RuntimeFunctionInfo runtime_functions[RUNTIME_FUNCTION_COUNT] = {
+    [RUNTIME_WRITE_INT]     = { RUNTIME_PREFIX "write_int", "vi" },
+    [RUNTIME_WRITE_FLOAT]   = { RUNTIME_PREFIX "write_float", "vf" },
+    [RUNTIME_WRITE_CHAR]    = { RUNTIME_PREFIX "write_char", "vi" },
+    [RUNTIME_WRITE_BOOL]    = { RUNTIME_PREFIX "write_bool", "vi" },
+    [RUNTIME_WRITE_STRING]  = { RUNTIME_PREFIX "write_string", "vs" },
+    [RUNTIME_WRITE_NEWLINE] = { RUNTIME_PREFIX "write_newline", "v" },
+    [RUNTIME_PROMPT]        = { RUNTIME_PREFIX "prompt", "vs" },
+    [RUNTIME_READ_INT]      = { RUNTIME_PREFIX "read_int", "vI" },
+    [RUNTIME_READ_FLOAT]    = { RUNTIME_PREFIX "read_float", "vF" },
+    [RUNTIME_READ_CHAR]     = { RUNTIME_PREFIX "read_char", "vs" },
+    [RUNTIME_READ_STRING]   = { RUNTIME_PREFIX "read_string", "vs" },
+    [RUNTIME_READ_BOOL]     = { RUNTIME_PREFIX "read_bool", "i" },
+    [RUNTIME_STRING_COPY]   = { RUNTIME_PREFIX "string_copy", "vss" },
+    [RUNTIME_BOUNDS_ERROR]  = { RUNTIME_PREFIX "bounds_error", "vsiii" },
+};
+
+#define RUNTIME_MAX_PARAMS 4
+
+static LLVMTypeRef get_runtime_type(CodegenContext *ctx, char code) {
+    switch (code) {
+        case 'i': return LLVMInt32TypeInContext(ctx->context);
+        case 'f': return LLVMFloatTypeInContext(ctx->context);
+        case 's': return LLVMPointerType(LLVMInt8TypeInContext(ctx->context), 0);
+        case 'I': return LLVMPointerType(LLVMInt32TypeInContext(ctx->context), 0);
+        case 'F': return LLVMPointerType(LLVMFloatTypeInContext(ctx->context), 0);
+        default:  return LLVMVoidTypeInContext(ctx->context);
+    }
+}
+
+static LLVMValueRef get_runtime_function(CodegenContext *ctx, RuntimeFunction function) {
+    const RuntimeFunctionInfo *info = &runtime_functions[function];
+    LLVMValueRef func = LLVMGetNamedFunction(ctx->module, info->name);
+    if (func) {
+        return func;
+    }
+
+    int param_count = (int)strlen(info->signature) - 1;
+    LLVMTypeRef param_types[RUNTIME_MAX_PARAMS];
+    for (int i = 0; i < param_count; i++) {
+        param_types[i] = get_runtime_type(ctx, info->signature[i + 1]);
+    }
+
+    LLVMTypeRef func_type = LLVMFunctionType(get_runtime_type(ctx, info->signature[0]), param_types, param_count, 0);
+    return LLVMAddFunction(ctx->module, info->name, func_type);
+}
+
+static LLVMValueRef convert_runtime_arg(CodegenContext *ctx, LLVMValueRef value, LLVMTypeRef type) {
+    LLVMTypeRef value_type = LLVMTypeOf(value);
+    if (value_type == type) {
+        return value;
+    }
+
+    LLVMTypeKind from = LLVMGetTypeKind(value_type);
+    LLVMTypeKind to = LLVMGetTypeKind(type);
+
+    if (from == LLVMIntegerTypeKind && to == LLVMIntegerTypeKind) {
+        // Booleans and chars are unsigned
+        return LLVMBuildZExtOrBitCast(ctx->builder, value, type, "runtime_arg");
+    } else if (from == LLVMIntegerTypeKind && to == LLVMFloatTypeKind) {
+        return LLVMBuildSIToFP(ctx->builder, value, type, "runtime_arg");
+    } else if (from == LLVMFloatTypeKind && to == LLVMIntegerTypeKind) {
+        return LLVMBuildFPToSI(ctx->builder, value, type, "runtime_arg");
+    } else if (from == LLVMPointerTypeKind && to == LLVMPointerTypeKind) {
+        return LLVMBuildPointerCast(ctx->builder, value, type, "runtime_arg");
+    }
+    return LLVMBuildFPCast(ctx->builder, value, type, "runtime_arg");
+}
+
+LLVMValueRef build_runtime_call(CodegenContext *ctx, RuntimeFunction function, LLVMValueRef *args) {
+    LLVMValueRef func = get_runtime_function(ctx, function);
+    LLVMTypeRef func_type = LLVMGlobalGetValueType(func);
+
+    unsigned param_count = LLVMCountParamTypes(func_type);
+    LLVMTypeRef param_types[RUNTIME_MAX_PARAMS];
+    LLVMValueRef converted[RUNTIME_MAX_PARAMS];
+    LLVMGetParamTypes(func_type, param_types);
+    for (unsigned i = 0; i < param_count; i++) {
+        converted[i] = convert_runtime_arg(ctx, args[i], param_types[i]);
+    }
+
+    return LLVMBuildCall2(ctx->builder, func_type, func, converted, param_count, "");
+}
+
+void link_runtime(CodegenContext *ctx) {
+    LLVMMemoryBufferRef bitcode = LLVMCreateMemoryBufferWithMemoryRange(
+        ptl_runtime_bitcode, (size_t)(ptl_runtime_bitcode_end - ptl_runtime_bitcode), "ptl_runtime", 0);
+
+    LLVMModuleRef runtime = NULL;
+    int failed = LLVMParseBitcodeInContext2(ctx->context, bitcode, &runtime);
+    LLVMDisposeMemoryBuffer(bitcode);
+    if (failed) {
+        fprintf(stderr, "Error: Could not read the runtime library\n");
+        abort_compilation();
+    }
+
+    // Linking consumes the runtime module, so collect the names of its helpers first
+    int count = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(runtime); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        count++;
+    }
+    char **names = (char **)malloc((count > 0 ? count : 1) * sizeof(char *));
+    if (!names) {
+        LLVMDisposeModule(runtime);
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        abort_compilation();
+    }
+
+    count = 0;
+    for (LLVMValueRef function = LLVMGetFirstFunction(runtime); function != NULL;
+         function = LLVMGetNextFunction(function)) {
+        if (LLVMIsDeclaration(function)) continue;
+
+        size_t length;
+        const char *name = LLVMGetValueName2(function, &length);
+        LLVMValueRef existing = LLVMGetNamedFunction(ctx->module, name);
+        if (existing && !LLVMIsDeclaration(existing)) {
+            for (int i = 0; i < count; i++) free(names[i]);
+            free(names);
+            LLVMDisposeModule(runtime);
+            fprintf(stderr, "Error: Function name '%s' is reserved for the runtime library\n", name);
+            abort_compilation();
+        }
+        names[count++] = strdup(name);
+    }
+
+    if (LLVMLinkModules2(ctx->module, runtime)) {
+        for (int i = 0; i < count; i++) free(names[i]);
+        free(names);
+        fprintf(stderr, "Error: Could not link the runtime library\n");
+        abort_compilation();
+    }
+
+    // Unused helpers are then dropped by the optimizer, and JIT entries
+    // each keep their own copy instead of exporting it
+    for (int i = 0; i < count; i++) {
+        LLVMValueRef function = LLVMGetNamedFunction(ctx->module, names[i]);
+        if (function) {
+            LLVMSetLinkage(function, LLVMInternalLinkage);
+        }
+        free(names[i]);
+    }
+    free(names);
+}
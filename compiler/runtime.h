@@ -0,0 +1,39 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "code_generator.h"
+
+// Generated code reads and writes values through the helpers of
+// ptl_runtime.c instead of calling printf and scanf itself. The helpers are
+// compiled to bitcode when the compiler is built and embedded in it; the
+// program is linked with them before the optimization pipeline runs, so
+// they are inlined and specialized like the program's own functions.
+
+#define RUNTIME_PREFIX "__ptl_"  // Names of runtime helpers start with this
+
+typedef enum {
+    RUNTIME_WRITE_INT,
+    RUNTIME_WRITE_FLOAT,
+    RUNTIME_WRITE_CHAR,
+    RUNTIME_WRITE_BOOL,
+    RUNTIME_WRITE_STRING,
+    RUNTIME_WRITE_NEWLINE,
+    RUNTIME_PROMPT,
+    RUNTIME_READ_INT,
+    RUNTIME_READ_FLOAT,
+    RUNTIME_READ_CHAR,
+    RUNTIME_READ_STRING,
+    RUNTIME_READ_BOOL,
+    RUNTIME_STRING_COPY,
+    RUNTIME_BOUNDS_ERROR,
+    RUNTIME_FUNCTION_COUNT
+} RuntimeFunction;
+
+// Call a runtime helper, declaring it on first use. Integer and float
+// arguments are converted to the parameter types of the helper.
+LLVMValueRef build_runtime_call(CodegenContext *ctx, RuntimeFunction function, LLVMValueRef *args);
+
+// Link the runtime into ctx->module and make its helpers internal to it
+void link_runtime(CodegenContext *ctx);
+
+#endif
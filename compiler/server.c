@@ -0,0 +1,188 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "protocol.h"
+#include "code_generator.h"
+#include "log.h"
+
+static const char *served_socket_path;
+
+static void stop_serving(int signal_number) {
+    unlink(served_socket_path);
+    _exit(0);
+}
+
+// Runs in the forked child: adopt the client's context, compile, report back
+static void handle_request(int connection, CompilerDriver driver) {
+    CompileRequestHeader header;
+    int fds[COMPILE_REQUEST_FDS];
+
+    // Every string needs at least its terminating NUL in the payload
+    if (receive_request_header(connection, &header, fds) != 0 || header.argc == 0 ||
+        header.payload_size == 0 || header.payload_size > COMPILE_PAYLOAD_MAX ||
+        (uint64_t)header.argc + header.envc + 1 > header.payload_size) {
+        LOG_WARN("Warning: Ignoring malformed compile request\n");
+        _exit(1);
+    }
+
+    char *payload = (char *)malloc(header.payload_size + 1);
+    int string_count = 1 + header.argc + header.envc;
+    char **strings = (char **)malloc((string_count + 1) * sizeof(char *));
+    if (!payload || !strings || read_all(connection, payload, header.payload_size) != 0) {
+        LOG_WARN("Warning: Could not read compile request\n");
+        _exit(1);
+    }
+    payload[header.payload_size] = '\0';
+
+    // Split the payload into working directory, arguments and environment
+    char *cursor = payload;
+    char *end = payload + header.payload_size;
+    for (int i = 0; i < string_count; i++) {
+        if (cursor >= end) {
+            LOG_WARN("Warning: Truncated compile request\n");
+            _exit(1);
+        }
+        strings[i] = cursor;
+        cursor += strlen(cursor) + 1;
+    }
+
+    for (int i = 0; i < COMPILE_REQUEST_FDS; i++) {
+        dup2(fds[i], i);
+        if (fds[i] >= COMPILE_REQUEST_FDS) close(fds[i]);
+    }
+
+    int32_t exit_code = 1;
+    if (chdir(strings[0]) != 0) {
+        fprintf(stderr, "Error: Could not enter directory '%s'\n", strings[0]);
+    } else {
+        clearenv();
+        for (int i = 0; i < (int)header.envc; i++) {
+            putenv(strings[1 + header.argc + i]);
+        }
+
+        char **argv = strings + 1;
+        char *saved = argv[header.argc];
+        argv[header.argc] = NULL;
+        exit_code = driver(header.argc, argv);
+        argv[header.argc] = saved;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    write_all(connection, &exit_code, sizeof(exit_code));
+    _exit(0);
+}
+
+// Make way for binding address: only a socket nobody listens on any more
+// may be removed. Returns 0 when the path is free.
+static int remove_stale_socket(const struct sockaddr_un *address) {
+    const char *socket_path = address->sun_path;
+    struct stat info;
+    if (lstat(socket_path, &info) != 0) {
+        if (errno == ENOENT) return 0;
+        fprintf(stderr, "Error: Could not check '%s': %s\n", socket_path, strerror(errno));
+        return -1;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        fprintf(stderr, "Error: '%s' exists and is not a socket\n", socket_path);
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) {
+        perror("socket");
+        return -1;
+    }
+    int live = connect(probe, (const struct sockaddr *)address, sizeof(*address)) == 0;
+    close(probe);
+    if (live) {
+        fprintf(stderr, "Error: A server is already listening on '%s'\n", socket_path);
+        return -1;
+    }
+
+    if (unlink(socket_path) != 0 && errno != ENOENT) {
+        fprintf(stderr, "Error: Could not remove stale socket '%s': %s\n", socket_path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int serve_compile_requests(const char *socket_path, CompilerDriver driver) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    // Pay for LLVM initialization once; every request forks from here
+    initialize_native_target();
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    if (remove_stale_socket(&address) != 0) {
+        close(listener);
+        return 1;
+    }
+
+    // Requests run with the server's privileges, so only its user may connect
+    mode_t old_mask = umask(0077);
+    int bound = bind(listener, (struct sockaddr *)&address, sizeof(address));
+    umask(old_mask);
+
+    if (bound != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "Error: Could not listen on '%s': %s\n", socket_path, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    served_socket_path = socket_path;
+    signal(SIGINT, stop_serving);
+    signal(SIGTERM, stop_serving);
+    signal(SIGCHLD, SIG_IGN);  // Finished requests are reaped automatically
+
+    LOG_INFO("Serving compile requests on %s\n", socket_path);
+
+    while (1) {
+        int connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);  // The linker step waits for its child
+            handle_request(connection, driver);
+        }
+        if (pid < 0) {
+            perror("fork");
+        }
+        close(connection);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    return 1;
+}
@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Entry point run for every request, with the client's command line
+typedef int (*CompilerDriver)(int argc, char *argv[]);
+
+// Listen on a Unix domain socket and run driver for each client request.
+// LLVM is initialized once. Every request is forked from this warm process,
+// inside the client's working directory, environment and stdio. Only
+// returns if the socket fails.
+int serve_compile_requests(const char *socket_path, CompilerDriver driver);
+
+#endif
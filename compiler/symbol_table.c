@@ -1,17 +1,56 @@
 #include "symbol_table.h"
 #include "command.h"
+#include "hash.h"
+#include "mem_report.h"
+#include "log.h"
+
+#define SYMBOL_TABLE_INITIAL_BUCKETS 64
 
 SymbolTable* create_symbol_table() {
-    SymbolTable *table = (SymbolTable*) malloc(sizeof(SymbolTable));
+    SymbolTable *table = (SymbolTable*) tracked_malloc(ALLOC_OTHER, sizeof(SymbolTable));
     if (table == NULL) {
         fprintf(stderr, "Error: Memory allocation failed for symbol table\n");
-        exit(1);
+        abort_compilation();
     }
     table->head = NULL;
     table->size = 0;
+    table->bucket_count = SYMBOL_TABLE_INITIAL_BUCKETS;
+    table->buckets = (Symbol**) tracked_calloc(ALLOC_OTHER, table->bucket_count, sizeof(Symbol*));
+    if (table->buckets == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed for symbol table\n");
+        abort_compilation();
+    }
     return table;
 }
 
+static Symbol **find_bucket(SymbolTable *table, const char *name) {
+    uint64_t hash = fnv1a_update(FNV_OFFSET_BASIS, name, strlen(name));
+    return &table->buckets[hash & (uint64_t)(table->bucket_count - 1)];
+}
+
+// Keep the chains short as the table grows
+static void grow_buckets(SymbolTable *table) {
+    Symbol **old_buckets = table->buckets;
+    int old_count = table->bucket_count;
+
+    Symbol **buckets = (Symbol**) tracked_calloc(ALLOC_OTHER, old_count * 2, sizeof(Symbol*));
+    if (buckets == NULL) return;
+
+    table->buckets = buckets;
+    table->bucket_count = old_count * 2;
+    for (int i = 0; i < old_count; i++) {
+        Symbol *symbol = old_buckets[i];
+        while (symbol != NULL) {
+            Symbol *next = symbol->bucket_next;
+            Symbol **bucket = find_bucket(table, symbol->name);
+            symbol->bucket_next = *bucket;
+            *bucket = symbol;
+            symbol = next;
+        }
+    }
+    free(old_buckets);
+}
+
 const char* data_type_to_string(DataType type) {
     switch(type) {
         case TYPE_INT:    return "int";
@@ -33,23 +72,20 @@ DataType string_to_data_type(const char* type_str) {
 }
 
 void insert_symbol(SymbolTable *table, const char *name, DataType type, int line, ArrayDimension *dims) {
-    Symbol *current = table->head;
-    while (current != NULL) {
-        if (strcmp(current->name, name) == 0) {
-            fprintf(stderr, "Warning: Redefinition of symbol '%s' at line %d (originally defined at line %d)\n",
-                    name, line, current->line_defined);
-            return;
-        }
-        current = current->next;
+    Symbol *current = lookup_symbol(table, name);
+    if (current != NULL) {
+        LOG_WARN("Warning: Redefinition of symbol '%s' at line %d (originally defined at line %d)\n",
+                name, line, current->line_defined);
+        return;
     }
 
-    Symbol *symbol = (Symbol*) malloc(sizeof(Symbol));
+    Symbol *symbol = (Symbol*) tracked_malloc(ALLOC_SYMBOL, sizeof(Symbol));
     if (symbol == NULL) {
         fprintf(stderr, "Error: Memory allocation failed for symbol\n");
-        exit(1);
+        abort_compilation();
     }
 
-    symbol->name = strdup(name);
+    symbol->name = tracked_strdup(name);
     symbol->type = type;
     symbol->line_defined = line;
     symbol->is_initialized = 0;
@@ -68,7 +104,7 @@ void insert_symbol(SymbolTable *table, const char *name, DataType type, int line
         }
 
         symbol->num_dimensions = count;
-        symbol->array_dimensions = (int*)malloc(count * sizeof(int));
+        symbol->array_dimensions = (int*)tracked_malloc(ALLOC_SYMBOL, count * sizeof(int));
 
         // Store dimensions
         d = dims;
@@ -84,7 +120,7 @@ void insert_symbol(SymbolTable *table, const char *name, DataType type, int line
         }
 
         int element_size = get_type_size(type);
-        symbol->array_data = calloc(total_size, element_size);
+        symbol->array_data = tracked_calloc(ALLOC_SYMBOL, total_size, element_size);
         symbol->is_initialized = 1;  // Arrays are zero-initialized
     } else {
         symbol->is_array = 0;
@@ -95,6 +131,13 @@ void insert_symbol(SymbolTable *table, const char *name, DataType type, int line
 
     table->head = symbol;
     table->size++;
+
+    if (table->size > 2 * table->bucket_count) {
+        grow_buckets(table);
+    }
+    Symbol **bucket = find_bucket(table, name);
+    symbol->bucket_next = *bucket;
+    *bucket = symbol;
 }
 
 int calculate_array_offset(Symbol *symbol, int *indices) {
@@ -139,12 +182,12 @@ void get_array_element(Symbol *symbol, int *indices, void *result) {
 }
 
 Symbol* lookup_symbol(SymbolTable *table, const char *name) {
-    Symbol *current = table->head;
+    Symbol *current = *find_bucket(table, name);
     while (current != NULL) {
         if (strcmp(current->name, name) == 0) {
             return current;
         }
-        current = current->next;
+        current = current->bucket_next;
     }
     return NULL;
 }
@@ -202,20 +245,41 @@ void print_symbol_table(SymbolTable *table) {
     printf("=================================\n");
 }
 
+static void free_symbol(Symbol *symbol) {
+    free(symbol->name);
+    if (symbol->array_dimensions) {
+        free(symbol->array_dimensions);
+    }
+    if (symbol->array_data) {
+        free(symbol->array_data);
+    }
+    free(symbol);
+}
+
+void remove_symbols_since(SymbolTable *table, Symbol *previous_head) {
+    while (table->head != previous_head && table->head != NULL) {
+        Symbol *symbol = table->head;
+        table->head = symbol->next;
+        table->size--;
+
+        Symbol **link = find_bucket(table, symbol->name);
+        while (*link != symbol) {
+            link = &(*link)->bucket_next;
+        }
+        *link = symbol->bucket_next;
+
+        free_symbol(symbol);
+    }
+}
+
 void free_symbol_table(SymbolTable *table) {
     Symbol *current = table->head;
     while (current != NULL) {
         Symbol *next = current->next;
-        free(current->name);
-        if (current->array_dimensions) {
-            free(current->array_dimensions);
-        }
-        if (current->array_data) {
-            free(current->array_data);
-        }
-        free(current);
+        free_symbol(current);
         current = next;
     }
+    free(table->buckets);
     free(table);
 }
 
@@ -267,7 +331,7 @@ void set_string_value(SymbolTable *table, const char *name, const char *value) {
             return;
         }
         free(symbol->value.string_val);
-        symbol->value.string_val = strdup(value);
+        symbol->value.string_val = tracked_strdup(value);
         symbol->is_initialized = 1;
     }
 }
@@ -36,11 +36,14 @@ typedef struct Symbol {
     Value value;  // For scalars
     void *array_data;  // For arrays
     struct Symbol *next;
+    struct Symbol *bucket_next;  // Next symbol in the same bucket
 } Symbol;
 
 typedef struct {
-    Symbol *head;
+    Symbol *head;  // Newest first
     int size;
+    Symbol **buckets;  // Symbols by the hash of their name
+    int bucket_count;  // Power of two
 } SymbolTable;
 
 SymbolTable* create_symbol_table();
@@ -54,6 +57,9 @@ DataType get_symbol_type(SymbolTable *table, const char *name);
 void print_symbol_table(SymbolTable *table);
 void free_symbol_table(SymbolTable *table);
 
+// Drop the symbols inserted after previous_head was the newest one
+void remove_symbols_since(SymbolTable *table, Symbol *previous_head);
+
 // Value setters and getters
 void set_int_value(SymbolTable *table, const char *name, int value);
 void set_float_value(SymbolTable *table, const char *name, float value);
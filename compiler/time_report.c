@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "time_report.h"
+
+static const char *phase_names[PHASE_COUNT] = {
+    "other",
+    "cache",
+    "lex",
+    "parse",
+    "functions",
+    "codegen",
+    "optimize",
+    "write-output",
+    "link",
+    "print-ir",
+    "jit",
+    "execute",
+};
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Charge the time since the last mark to the running phase
+static void charge_current_phase(TimeReport *report) {
+    // Thread CPU time keeps -j workers from being charged for each other
+    double wall = clock_seconds(CLOCK_MONOTONIC);
+    double cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+
+    report->wall_seconds[report->current] += wall - report->wall_mark;
+    report->cpu_seconds[report->current] += cpu - report->cpu_mark;
+    report->wall_mark = wall;
+    report->cpu_mark = cpu;
+}
+
+void time_report_begin(TimeReport *report) {
+    if (!report) return;
+
+    memset(report, 0, sizeof(TimeReport));
+    report->current = PHASE_OTHER;
+    report->wall_mark = clock_seconds(CLOCK_MONOTONIC);
+    report->cpu_mark = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+CompilePhase time_report_enter(TimeReport *report, CompilePhase phase) {
+    if (!report) return PHASE_OTHER;
+
+    charge_current_phase(report);
+    CompilePhase previous = report->current;
+    report->current = phase;
+    return previous;
+}
+
+void time_report_leave(TimeReport *report, CompilePhase previous) {
+    if (!report) return;
+
+    charge_current_phase(report);
+    report->current = previous;
+}
+
+void time_report_end(TimeReport *report) {
+    if (!report) return;
+
+    charge_current_phase(report);
+    report->current = PHASE_OTHER;
+}
+
+const char *phase_name(CompilePhase phase) {
+    return phase_names[phase];
+}
+
+static void sum_phases(const TimeReport *report, double *wall, double *cpu) {
+    *wall = 0;
+    *cpu = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        *wall += report->wall_seconds[i];
+        *cpu += report->cpu_seconds[i];
+    }
+}
+
+void print_time_report(FILE *out, const char *filename, const TimeReport *report) {
+    double total_wall, total_cpu;
+    sum_phases(report, &total_wall, &total_cpu);
+
+    fprintf(out, "Time report for %s\n", filename);
+    fprintf(out, "  %-14s %12s %12s %8s\n", "phase", "wall (ms)", "cpu (ms)", "% wall");
+
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        // Phases this compilation never entered would only add noise
+        if (report->wall_seconds[i] == 0 && report->cpu_seconds[i] == 0) continue;
+
+        fprintf(out, "  %-14s %12.3f %12.3f %7.1f%%\n", phase_names[i],
+                report->wall_seconds[i] * 1000, report->cpu_seconds[i] * 1000,
+                total_wall > 0 ? 100 * report->wall_seconds[i] / total_wall : 0.0);
+    }
+
+    fprintf(out, "  %-14s %12.3f %12.3f %7.1f%%\n", "total", total_wall * 1000, total_cpu * 1000, 100.0);
+}
+
+void print_time_report_json(FILE *out, const char *filename, const TimeReport *report) {
+    double total_wall, total_cpu;
+    sum_phases(report, &total_wall, &total_cpu);
+
+    fprintf(out, "{\"file\": \"");
+    for (const char *c = filename; *c; c++) {
+        if (*c == '"' || *c == '\\') fputc('\\', out);
+        fputc(*c, out);
+    }
+    fprintf(out, "\", \"total_wall_ms\": %.3f, \"total_cpu_ms\": %.3f, \"phases\": [",
+            total_wall * 1000, total_cpu * 1000);
+
+    int first = 1;
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (report->wall_seconds[i] == 0 && report->cpu_seconds[i] == 0) continue;
+
+        fprintf(out, "%s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"percent\": %.2f}",
+                first ? "" : ", ", phase_names[i],
+                report->wall_seconds[i] * 1000, report->cpu_seconds[i] * 1000,
+                total_wall > 0 ? 100 * report->wall_seconds[i] / total_wall : 0.0);
+        first = 0;
+    }
+
+    fprintf(out, "]}");
+}
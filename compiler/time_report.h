@@ -0,0 +1,55 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <stdio.h>
+
+// Compilation phases. Each phase is charged only its own time: entering a
+// nested phase (lexing inside parsing, function bodies inside codegen)
+// pauses the enclosing one.
+typedef enum {
+    PHASE_OTHER,
+    PHASE_CACHE,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_FUNCTIONS,
+    PHASE_CODEGEN,
+    PHASE_OPTIMIZE,
+    PHASE_WRITE_OUTPUT,
+    PHASE_LINK,
+    PHASE_PRINT_IR,
+    PHASE_JIT,
+    PHASE_EXECUTE,
+    PHASE_COUNT
+} CompilePhase;
+
+typedef struct TimeReport {
+    double wall_seconds[PHASE_COUNT];
+    double cpu_seconds[PHASE_COUNT];
+
+    CompilePhase current;
+    double wall_mark;
+    double cpu_mark;
+} TimeReport;
+
+// Reset the report and start charging time to PHASE_OTHER
+void time_report_begin(TimeReport *report);
+
+// Switch to phase and return the phase that was running. Does nothing and
+// returns PHASE_OTHER when report is NULL, so callers need no checks.
+CompilePhase time_report_enter(TimeReport *report, CompilePhase phase);
+
+// Leave the current phase and resume previous
+void time_report_leave(TimeReport *report, CompilePhase previous);
+
+// Charge the time since the last switch and stop the clock
+void time_report_end(TimeReport *report);
+
+const char *phase_name(CompilePhase phase);
+
+// Print a table with wall time, CPU time and share of the total per phase
+void print_time_report(FILE *out, const char *filename, const TimeReport *report);
+
+// Print the same data as one JSON object
+void print_time_report_json(FILE *out, const char *filename, const TimeReport *report);
+
+#endif
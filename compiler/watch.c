@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+
+// Editors often save in several steps (truncate, write, rename), so wait
+// until the directory has been quiet this long before rebuilding
+#define WATCH_SETTLE_MS 50
+
+#define WATCH_EVENT_BUFFER_SIZE 4096
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void build(CompileJob *job, FunctionCache *cache) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    compile_file(job);
+
+    if (job->report_times) {
+        print_time_report(stderr, job->input_filename, &job->times);
+    }
+    if (job->report_memory) {
+        print_mem_report(stderr, job->input_filename, &job->memory);
+    }
+
+    // With --run the exit code is the program's, so only report it
+    if (job->exit_code != 0 && !job->run_mode) {
+        fprintf(stderr, "Watch: Build of %s failed\n", job->input_filename);
+    } else {
+        fprintf(stderr, "Watch: Built %s in %.1f ms (%d functions generated, %d reused)\n",
+                job->input_filename, elapsed_ms(&start), cache->generated, cache->reused);
+    }
+}
+
+// Whether a batch of inotify events touches the file called name
+static int events_name_file(const char *buffer, ssize_t length, const char *name) {
+    const char *cursor = buffer;
+    while (cursor < buffer + length) {
+        const struct inotify_event *event = (const struct inotify_event *)cursor;
+        if (event->len > 0 && strcmp(event->name, name) == 0) {
+            return 1;
+        }
+        cursor += sizeof(struct inotify_event) + event->len;
+    }
+    return 0;
+}
+
+int watch_and_compile(CompileJob *job) {
+    // Watch the directory, not the file: saving by rename replaces the inode
+    char directory_buffer[1024];
+    char name_buffer[1024];
+    snprintf(directory_buffer, sizeof(directory_buffer), "%s", job->input_filename);
+    snprintf(name_buffer, sizeof(name_buffer), "%s", job->input_filename);
+    const char *directory = dirname(directory_buffer);
+    const char *name = basename(name_buffer);
+
+    int notify = inotify_init1(IN_CLOEXEC);
+    if (notify < 0 || inotify_add_watch(notify, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Error: Could not watch '%s': %s\n", directory, strerror(errno));
+        if (notify >= 0) close(notify);
+        return 1;
+    }
+
+    FunctionCache cache;
+    memset(&cache, 0, sizeof(cache));
+    job->function_cache = &cache;
+
+    build(job, &cache);
+
+    char buffer[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        fprintf(stderr, "Watch: Waiting for changes to %s\n", job->input_filename);
+
+        int changed = 0;
+        while (!changed) {
+            ssize_t length = read(notify, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) continue;
+            if (length <= 0) {
+                perror("inotify");
+                free_function_cache(&cache);
+                close(notify);
+                return 1;
+            }
+            changed = events_name_file(buffer, length, name);
+        }
+
+        // Drain the rest of the save before reading the file
+        struct pollfd pending = { notify, POLLIN, 0 };
+        while (poll(&pending, 1, WATCH_SETTLE_MS) > 0) {
+            if (read(notify, buffer, sizeof(buffer)) <= 0) break;
+        }
+
+        build(job, &cache);
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "compiler.h"
+
+// Compile job, then compile it again every time its input file is saved.
+// Top-level functions whose definition did not change keep the IR of the
+// previous build. Runs until interrupted; returns 1 if watching fails.
+int watch_and_compile(CompileJob *job);
+
+#endif